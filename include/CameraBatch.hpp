@@ -0,0 +1,474 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Batch projection with per point status.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_BATCH_HPP
+#define CAMERA_BATCH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraPointBlock.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraFrameArena.hpp>
+
+namespace camera
+{
+
+/**
+ * Outcome of projecting a point. Non-finite input is a NumericalFailure, otherwise when
+ * several apply the first of BehindCamera, NumericalFailure, OutsideImage and
+ * OutsideCircularFOV is reported. NoPose is for points without a pose at their time.
+ */
+enum class ProjectionStatus : std::uint8_t
+{
+    Ok = 0,
+    BehindCamera,
+    OutsideImage,
+    OutsideCircularFOV,
+    NumericalFailure,
+    NoPose
+};
+
+/**
+ * What a depth image stores: z of the point (pinhole style) or its distance from the camera
+ * centre (usual for fisheye and wide angle depth).
+ */
+enum class DepthType
+{
+    ZDepth = 0,
+    Range
+};
+
+namespace internal
+{
+
+// branch-free, the conditions are combined in reverse priority order
+EIGEN_DEVICE_FUNC inline ProjectionStatus resolveProjectionStatus(bool finite_in, bool in_front, bool finite_out, bool in_image, bool in_fov)
+{
+    std::uint8_t s = static_cast<std::uint8_t>(ProjectionStatus::Ok);
+    s = select(in_fov, s, static_cast<std::uint8_t>(ProjectionStatus::OutsideCircularFOV));
+    s = select(in_image, s, static_cast<std::uint8_t>(ProjectionStatus::OutsideImage));
+    s = select(finite_out, s, static_cast<std::uint8_t>(ProjectionStatus::NumericalFailure));
+    s = select(in_front, s, static_cast<std::uint8_t>(ProjectionStatus::BehindCamera));
+    s = select(finite_in, s, static_cast<std::uint8_t>(ProjectionStatus::NumericalFailure));
+    return static_cast<ProjectionStatus>(s);
+}
+
+template<typename T>
+struct ProjectionStatusWriter
+{
+    typedef typename ScalarMask<T>::Type MaskT;
+    static constexpr int Lanes = 1;
+    
+    EIGEN_DEVICE_FUNC static inline void write(MaskT finite_in, MaskT in_front, MaskT finite_out, MaskT in_image, MaskT in_fov, ProjectionStatus* out)
+    {
+        *out = resolveProjectionStatus(finite_in, in_front, finite_out, in_image, in_fov);
+    }
+};
+
+template<typename T, int N>
+struct ProjectionStatusWriter<Packet<T,N>>
+{
+    typedef PacketMask<T,N> MaskT;
+    static constexpr int Lanes = N;
+    
+    EIGEN_DEVICE_FUNC static inline void write(const MaskT& finite_in, const MaskT& in_front, const MaskT& finite_out, const MaskT& in_image, const MaskT& in_fov, ProjectionStatus* out)
+    {
+        for(int i = 0 ; i < N ; ++i)
+        {
+            out[i] = resolveProjectionStatus(finite_in[i], in_front[i], finite_out[i], in_image[i], in_fov[i]);
+        }
+    }
+};
+
+// x - x is 0 unless x is inf or nan, per component (a sum could overflow)
+template<typename T>
+EIGEN_DEVICE_FUNC inline typename ProjectionStatusWriter<T>::MaskT allFinite(const T& a, const T& b)
+{
+    return (a - a == T(0.0)) && (b - b == T(0.0));
+}
+
+template<typename T>
+EIGEN_DEVICE_FUNC inline typename ProjectionStatusWriter<T>::MaskT allFinite(const T& a, const T& b, const T& c)
+{
+    return allFinite(a, b) && (c - c == T(0.0));
+}
+
+/**
+ * Packet used by the batch functions for a scalar type.
+ */
+template<typename T> struct BatchPacket;
+template<> struct BatchPacket<float> { typedef Packet8f Type; };
+template<> struct BatchPacket<double> { typedef Packet4d Type; };
+
+}
+
+/**
+ * forward with the status of every lane written to status (1 entry for scalars, N for packets).
+ * The pixel is computed regardless, status tells if it can be used.
+ */
+template<typename T, typename ModelT>
+EIGEN_DEVICE_FUNC inline typename ComplexTypes<T>::PixelT forwardWithStatus(const ModelT& model, const typename ComplexTypes<T>::PointT& pt, ProjectionStatus* status)
+{
+    const typename ComplexTypes<T>::PixelT pix = model.template forward<T>(pt);
+    
+    internal::ProjectionStatusWriter<T>::write(internal::allFinite(pt(0), pt(1), pt(2)),
+                                               model.template pointValid<T>(pt),
+                                               internal::allFinite(pix(0), pix(1)),
+                                               model.template pixelValidSquare<T>(pix(0), pix(1)),
+                                               model.template pixelValidCircular<T>(pix(0), pix(1)),
+                                               status);
+    return pix;
+}
+
+namespace internal
+{
+
+struct IdentityPointTransform
+{
+    template<typename PointT>
+    inline const PointT& operator()(const PointT& pt) const { return pt; }
+};
+
+template<typename T>
+struct RigidPointTransform
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit RigidPointTransform(const typename ComplexTypes<T>::TransformT& t) : rotation(t.rotationMatrix()), translation(t.translation()) { }
+    
+    inline typename ComplexTypes<T>::PointT operator()(const typename ComplexTypes<T>::PointT& pt) const { return rotation * pt + translation; }
+    
+    Eigen::Matrix<T,3,3> rotation;
+    Eigen::Matrix<T,3,1> translation;
+};
+
+template<typename T>
+struct RotationPointTransform
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit RotationPointTransform(const typename ComplexTypes<T>::RotationT& r) : world_to_camera(r.matrix()) { }
+    
+    inline typename ComplexTypes<T>::PointT operator()(const typename ComplexTypes<T>::PointT& pt) const { return world_to_camera * pt; }
+    
+    Eigen::Matrix<T,3,3> world_to_camera;
+};
+
+template<typename ModelT, typename XformT, typename InT, typename OutT>
+inline void forwardBatchImpl(const ModelT& model, const XformT& xform, const StridedView<InT,3>& points, const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    
+    assert(pixels.size() >= points.size());
+    const std::size_t count = points.size();
+    
+    std::size_t i = 0;
+    for( ; i + Lanes <= count ; i += Lanes)
+    {
+        typename ComplexTypes<PacketT>::PointT pt;
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            const typename ComplexTypes<Scalar>::PointT pc = xform(typename ComplexTypes<Scalar>::PointT(Scalar(points(i + l, 0)), Scalar(points(i + l, 1)), Scalar(points(i + l, 2))));
+            pt(0)[l] = pc(0);
+            pt(1)[l] = pc(1);
+            pt(2)[l] = pc(2);
+        }
+        
+        const typename ComplexTypes<PacketT>::PixelT pix = forwardWithStatus<PacketT>(model, pt, status + i);
+        
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            pixels(i + l, 0) = OutT(pix(0)[l]);
+            pixels(i + l, 1) = OutT(pix(1)[l]);
+        }
+    }
+    
+    for( ; i < count ; ++i)
+    {
+        const typename ComplexTypes<Scalar>::PointT pc = xform(typename ComplexTypes<Scalar>::PointT(Scalar(points(i, 0)), Scalar(points(i, 1)), Scalar(points(i, 2))));
+        const typename ComplexTypes<Scalar>::PixelT pix = forwardWithStatus<Scalar>(model, pc, status + i);
+        pixels(i, 0) = OutT(pix(0));
+        pixels(i, 1) = OutT(pix(1));
+    }
+}
+
+}
+
+/**
+ * Projects the points of a view into a pixel view (in place in foreign buffers, components
+ * are converted to / from the model scalar), one pass producing pixels and statuses.
+ * Runs on packets of the model scalar, the remainder is done with plain scalars.
+ */
+template<typename ModelT, typename InT, typename OutT>
+inline void forwardBatch(const ModelT& model, const StridedView<InT,3>& points, const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+{
+    internal::forwardBatchImpl(model, internal::IdentityPointTransform(), points, pixels, status);
+}
+
+/**
+ * As above, world points seen from pose (camera to world, as in forward(pose, pt)).
+ */
+template<typename ModelT, typename InT, typename OutT>
+inline void forwardBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::TransformT& pose,
+                         const StridedView<InT,3>& points, const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+{
+    internal::forwardBatchImpl(model, internal::RigidPointTransform<typename ModelT::Scalar>(pose.inverse()), points, pixels, status);
+}
+
+/**
+ * As above, rotation only (camera to world, as in forward(rotation, pt)).
+ */
+template<typename ModelT, typename InT, typename OutT>
+inline void forwardBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::RotationT& pose,
+                         const StridedView<InT,3>& points, const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+{
+    internal::forwardBatchImpl(model, internal::RotationPointTransform<typename ModelT::Scalar>(pose.inverse()), points, pixels, status);
+}
+
+/**
+ * Lifts the pixels of a view to rays, see inverse.
+ */
+template<typename ModelT, typename InT, typename OutT>
+inline void inverseBatch(const ModelT& model, const StridedView<InT,2>& pixels, const StridedView<OutT,3>& rays)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    
+    assert(rays.size() >= pixels.size());
+    const std::size_t count = pixels.size();
+    
+    std::size_t i = 0;
+    for( ; i + Lanes <= count ; i += Lanes)
+    {
+        PacketT x, y;
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            x[l] = Scalar(pixels(i + l, 0));
+            y[l] = Scalar(pixels(i + l, 1));
+        }
+        
+        const typename ComplexTypes<PacketT>::PointT ray = model.template inverse<PacketT>(x, y);
+        
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            rays(i + l, 0) = OutT(ray(0)[l]);
+            rays(i + l, 1) = OutT(ray(1)[l]);
+            rays(i + l, 2) = OutT(ray(2)[l]);
+        }
+    }
+    
+    for( ; i < count ; ++i)
+    {
+        const typename ComplexTypes<Scalar>::PointT ray = model.inverse(Scalar(pixels(i, 0)), Scalar(pixels(i, 1)));
+        rays(i, 0) = OutT(ray(0));
+        rays(i, 1) = OutT(ray(1));
+        rays(i, 2) = OutT(ray(2));
+    }
+}
+
+/**
+ * Projects count points, see the view version.
+ */
+template<typename ModelT>
+inline void forwardBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::PointT* points, std::size_t count,
+                         typename ComplexTypes<typename ModelT::Scalar>::PixelT* pixels, ProjectionStatus* status)
+{
+    forwardBatch(model, makePointView(points, count), makePixelView(pixels, count), status);
+}
+
+template<typename ModelT>
+inline void forwardBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::TransformT& pose,
+                         const typename ComplexTypes<typename ModelT::Scalar>::PointT* points, std::size_t count,
+                         typename ComplexTypes<typename ModelT::Scalar>::PixelT* pixels, ProjectionStatus* status)
+{
+    forwardBatch(model, pose, makePointView(points, count), makePixelView(pixels, count), status);
+}
+
+/**
+ * Lifts count pixels to rays, see inverse.
+ */
+template<typename ModelT>
+inline void inverseBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::PixelT* pixels, std::size_t count,
+                         typename ComplexTypes<typename ModelT::Scalar>::PointT* rays)
+{
+    inverseBatch(model, makePixelView(pixels, count), makePointView(rays, count));
+}
+
+namespace internal
+{
+
+// CameraFromCRTP's batch functions, declared in CameraModelHelpers.hpp
+template<typename ModelT>
+struct PolymorphicBatch
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    static inline void forward(const ModelT& model, const typename ComplexTypes<Scalar>::PointT* points, std::size_t count,
+                               typename ComplexTypes<Scalar>::PixelT* pixels, ProjectionStatus* status)
+    {
+        forwardBatch(model, points, count, pixels, status);
+    }
+    
+    static inline void inverse(const ModelT& model, const typename ComplexTypes<Scalar>::PixelT* pixels, std::size_t count,
+                               typename ComplexTypes<Scalar>::PointT* rays)
+    {
+        inverseBatch(model, pixels, count, rays);
+    }
+};
+
+}
+
+/**
+ * Pixels and statuses of forwardBatch, in arena memory valid until the arena is reset.
+ */
+template<typename T>
+struct ProjectionBatch
+{
+    PixelView<T> pixels;
+    ProjectionStatus* status;
+};
+
+/**
+ * forwardBatch with the outputs drawn from a per-frame arena.
+ */
+template<typename ModelT, typename InT>
+inline ProjectionBatch<typename ModelT::Scalar> forwardBatch(const ModelT& model, const StridedView<InT,3>& points, FrameArena& arena)
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    ProjectionBatch<Scalar> ret;
+    ret.pixels = PixelView<Scalar>(arena.allocate<Scalar>(2 * points.size()), points.size());
+    ret.status = arena.allocate<ProjectionStatus>(points.size());
+    forwardBatch(model, points, ret.pixels, ret.status);
+    return ret;
+}
+
+template<typename ModelT, typename InT>
+inline ProjectionBatch<typename ModelT::Scalar> forwardBatch(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::TransformT& pose,
+                                                             const StridedView<InT,3>& points, FrameArena& arena)
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    ProjectionBatch<Scalar> ret;
+    ret.pixels = PixelView<Scalar>(arena.allocate<Scalar>(2 * points.size()), points.size());
+    ret.status = arena.allocate<ProjectionStatus>(points.size());
+    forwardBatch(model, pose, points, ret.pixels, ret.status);
+    return ret;
+}
+
+/**
+ * inverseBatch with the rays drawn from a per-frame arena.
+ */
+template<typename ModelT, typename InT>
+inline PointView<typename ModelT::Scalar> inverseBatch(const ModelT& model, const StridedView<InT,2>& pixels, FrameArena& arena)
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    const PointView<Scalar> rays(arena.allocate<Scalar>(3 * pixels.size()), pixels.size());
+    inverseBatch(model, pixels, rays);
+    return rays;
+}
+
+/**
+ * Projects a point block array, blocks are loaded directly as Packet<Scalar,W>.
+ * status gets points.size() entries.
+ */
+template<typename ModelT, int W>
+inline void forwardBatch(const ModelT& model, const PointBlockArray<typename ModelT::Scalar,W>& points,
+                         PixelBlockArray<typename ModelT::Scalar,W>& pixels, ProjectionStatus* status)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef Packet<Scalar,W> PacketT;
+    
+    pixels.resize(points.size());
+    
+    for(std::size_t b = 0 ; b < points.getBlockCount() ; ++b)
+    {
+        const PointBlock<Scalar,W>& in = points.block(b);
+        PixelBlock<Scalar,W>& out = pixels.block(b);
+        const std::size_t lanes = points.getLanes(b);
+        
+        const typename ComplexTypes<PacketT>::PointT pt(PacketT::load(in.x), PacketT::load(in.y), PacketT::load(in.z));
+        
+        ProjectionStatus block_status[W];
+        const typename ComplexTypes<PacketT>::PixelT pix = forwardWithStatus<PacketT>(model, pt, block_status);
+        
+        pix(0).store(out.x);
+        pix(1).store(out.y);
+        std::copy(block_status, block_status + lanes, status + b * W);
+    }
+    
+    // resize resets the padding lanes
+    pixels.resize(points.size());
+}
+
+/**
+ * Lifts a pixel block array to rays, see inverse.
+ */
+template<typename ModelT, int W>
+inline void inverseBatch(const ModelT& model, const PixelBlockArray<typename ModelT::Scalar,W>& pixels,
+                         PointBlockArray<typename ModelT::Scalar,W>& rays)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef Packet<Scalar,W> PacketT;
+    
+    rays.resize(pixels.size());
+    
+    for(std::size_t b = 0 ; b < pixels.getBlockCount() ; ++b)
+    {
+        const PixelBlock<Scalar,W>& in = pixels.block(b);
+        PointBlock<Scalar,W>& out = rays.block(b);
+        
+        const typename ComplexTypes<PacketT>::PointT ray = model.template inverse<PacketT>(PacketT::load(in.x), PacketT::load(in.y));
+        
+        ray(0).store(out.x);
+        ray(1).store(out.y);
+        ray(2).store(out.z);
+    }
+    
+    rays.resize(pixels.size());
+}
+
+}
+
+#endif // CAMERA_BATCH_HPP
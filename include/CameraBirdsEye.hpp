@@ -0,0 +1,328 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Bird's-eye view (inverse perspective mapping) gather tables for camera rigs.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_BIRDS_EYE_HPP
+#define CAMERA_BIRDS_EYE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+/**
+ * Bird's-eye view grid on the ground plane z = ground_height of the world frame,
+ * cell (0,0) has its corner at origin, cells are resolution wide along world x (columns)
+ * and y (rows).
+ */
+template<typename T>
+struct BirdsEyeGrid
+{
+    BirdsEyeGrid(std::size_t w, std::size_t h, T res, const Eigen::Matrix<T,2,1>& o = Eigen::Matrix<T,2,1>::Zero(), T ground = T(0.0))
+        : width(w), height(h), resolution(res), origin(o), ground_height(ground) { }
+    
+    inline typename ComplexTypes<T>::PointT getCellCentre(std::size_t x, std::size_t y) const
+    {
+        return typename ComplexTypes<T>::PointT(origin(0) + (T(x) + T(0.5)) * resolution, origin(1) + (T(y) + T(0.5)) * resolution, ground_height);
+    }
+    
+    std::size_t width;
+    std::size_t height;
+    T resolution;
+    Eigen::Matrix<T,2,1> origin;
+    T ground_height;
+};
+
+/**
+ * Intersection of the ray of pixel (x,y) with the ground plane z = ground_height of the world,
+ * pose is camera to world. False if the ray does not hit the plane in front of the camera.
+ */
+template<typename ModelT>
+inline bool inverseOnGround(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::TransformT& pose,
+                            typename ModelT::Scalar x, typename ModelT::Scalar y, typename ModelT::Scalar ground_height,
+                            typename ComplexTypes<typename ModelT::Scalar>::PointT& out)
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    const typename ComplexTypes<Scalar>::PointT dir = pose.so3() * model.inverse(x, y);
+    const typename ComplexTypes<Scalar>::PointT& centre = pose.translation();
+    const Scalar lambda = (ground_height - centre(2)) / dir(2);
+    if(!(lambda > Scalar(0.0)))
+    {
+        return false;
+    }
+    
+    out = centre + lambda * dir;
+    return true;
+}
+
+/**
+ * Precomputed bird's-eye view: every cell gathers up to MaxSources taps, each a bilinear
+ * footprint in one camera image with the blending weight folded into 4 fixed point weights
+ * (all weights of a cell sum to One), so rendering a frame is lookups and integer madds.
+ */
+class BirdsEyeTable
+{
+public:
+    // enumerators, a non-template class in a header cannot define static members out of class
+    enum : std::uint32_t
+    {
+        MaxSources = 2,
+        NoCamera = 0xFF,
+        FractionBits = 14,
+        One = 1u << FractionBits
+    };
+    
+    struct Tap
+    {
+        std::uint32_t offset; // top-left pixel in the image of camera, row stride as given to the builder
+        std::uint8_t camera;
+        std::uint16_t weight[4]; // top-left, top-right, bottom-left, bottom-right
+    };
+    
+    BirdsEyeTable() : w(0), h(0) { }
+    BirdsEyeTable(std::size_t width, std::size_t height, const std::vector<std::size_t>& image_strides)
+        : w(width), h(height), strides(image_strides), taps(width * height * MaxSources) { }
+    
+    inline std::size_t width() const { return w; }
+    inline std::size_t height() const { return h; }
+    inline std::size_t getCameraCount() const { return strides.size(); }
+    inline std::size_t getImageStride(std::size_t camera) const { return strides[camera]; }
+    inline const Tap* getTaps(std::size_t x, std::size_t y) const { return &taps[(y * w + x) * MaxSources]; }
+    inline Tap* getTaps(std::size_t x, std::size_t y) { return &taps[(y * w + x) * MaxSources]; }
+    
+    inline bool isCovered(std::size_t x, std::size_t y) const { return getTaps(x, y)[0].camera != NoCamera; }
+    
+    /**
+     * Renders from one interleaved 8 bit image per camera (channels per pixel), uncovered cells are 0.
+     */
+    inline void render(const std::uint8_t* const* images, std::size_t channels, std::uint8_t* out) const
+    {
+        for(std::size_t c = 0 ; c < w * h ; ++c)
+        {
+            const Tap* tap = &taps[c * MaxSources];
+            for(std::size_t ch = 0 ; ch < channels ; ++ch)
+            {
+                std::uint32_t acc = One / 2;
+                for(std::size_t s = 0 ; s < MaxSources && tap[s].camera != NoCamera ; ++s)
+                {
+                    const std::uint8_t* img = images[tap[s].camera];
+                    const std::size_t row = strides[tap[s].camera] * channels;
+                    const std::uint8_t* p = img + tap[s].offset * channels + ch;
+                    acc += p[0] * tap[s].weight[0] + p[channels] * tap[s].weight[1] +
+                           p[row] * tap[s].weight[2] + p[row + channels] * tap[s].weight[3];
+                }
+                out[c * channels + ch] = (std::uint8_t)std::min<std::uint32_t>(acc >> FractionBits, 255);
+            }
+        }
+    }
+    
+private:
+    std::size_t w, h;
+    std::vector<std::size_t> strides;
+    std::vector<Tap> taps;
+};
+
+/**
+ * Builds a BirdsEyeTable for a rig. Each camera (any model, poses are camera to world as in
+ * forward(pose, pt)) projects all cell centres in one batch, a cell sees a camera where the
+ * projection is Ok, weighted by the distance to the image border (feathering the seams).
+ * The MaxSources best cameras of a cell are blended.
+ */
+template<typename T>
+class BirdsEyeTableBuilder
+{
+public:
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit BirdsEyeTableBuilder(const BirdsEyeGrid<T>& g) : grid(g)
+    {
+        cells.reserve(grid.width * grid.height);
+        for(std::size_t y = 0 ; y < grid.height ; ++y)
+        {
+            for(std::size_t x = 0 ; x < grid.width ; ++x)
+            {
+                cells.push_back(grid.getCellCentre(x, y));
+            }
+        }
+    }
+    
+    inline const BirdsEyeGrid<T>& getGrid() const { return grid; }
+    inline std::size_t getCameraCount() const { return cameras.size(); }
+    
+    /**
+     * Adds a camera, images are width x height with a row stride (pixels, 0: width).
+     * Weights fall linearly to 0 within feather (fraction of the smaller image side) of the border.
+     */
+    template<typename ModelT>
+    inline std::size_t addCamera(const ModelT& model, const TransformT& pose, T feather = T(0.2), std::size_t stride = 0)
+    {
+        using std::min;
+        
+        assert(cameras.size() < BirdsEyeTable::NoCamera);
+        
+        cameras.push_back(CameraSamples());
+        CameraSamples& cam = cameras.back();
+        cam.width = model.width();
+        cam.height = model.height();
+        cam.stride = stride > 0 ? stride : (std::size_t)model.width();
+        cam.pixels.resize(cells.size());
+        cam.weights.resize(cells.size());
+        
+        std::vector<ProjectionStatus> status(cells.size());
+        forwardBatch(model.template cast<T>(), pose, makePointView(cells.data(), cells.size()), makePixelView(cam.pixels.data(), cam.pixels.size()), status.data());
+        
+        const T band = std::max(feather * min(cam.width, cam.height), T(1e-6));
+        for(std::size_t i = 0 ; i < cells.size() ; ++i)
+        {
+            const PixelT& pix = cam.pixels[i];
+            const T border = min(min(pix(0), cam.width - T(1.0) - pix(0)), min(pix(1), cam.height - T(1.0) - pix(1)));
+            cam.weights[i] = (status[i] == ProjectionStatus::Ok && border >= T(0.0)) ? min(T(1.0), (border + T(1e-3)) / band) : T(0.0);
+        }
+        
+        return cameras.size() - 1;
+    }
+    
+    BirdsEyeTable build() const
+    {
+        using std::floor;
+        
+        std::vector<std::size_t> strides;
+        for(std::size_t c = 0 ; c < cameras.size() ; ++c) { strides.push_back(cameras[c].stride); }
+        
+        BirdsEyeTable ret(grid.width, grid.height, strides);
+        
+        for(std::size_t i = 0 ; i < cells.size() ; ++i)
+        {
+            BirdsEyeTable::Tap* taps = ret.getTaps(i % grid.width, i / grid.width);
+            
+            // best cameras of the cell
+            std::size_t best[BirdsEyeTable::MaxSources];
+            std::size_t count = 0;
+            for(std::size_t c = 0 ; c < cameras.size() ; ++c)
+            {
+                const T weight = cameras[c].weights[i];
+                if(!(weight > T(0.0))) { continue; }
+                
+                std::size_t k = count;
+                if(count < BirdsEyeTable::MaxSources)
+                {
+                    count++;
+                }
+                else if(weight <= cameras[best[count - 1]].weights[i])
+                {
+                    continue;
+                }
+                else
+                {
+                    k = count - 1;
+                }
+                
+                for( ; k > 0 && cameras[best[k - 1]].weights[i] < weight ; --k) { best[k] = best[k - 1]; }
+                best[k] = c;
+            }
+            
+            T total = T(0.0);
+            for(std::size_t s = 0 ; s < count ; ++s) { total += cameras[best[s]].weights[i]; }
+            
+            std::uint32_t sum = 0;
+            std::uint16_t* largest = nullptr;
+            for(std::size_t s = 0 ; s < BirdsEyeTable::MaxSources ; ++s)
+            {
+                BirdsEyeTable::Tap& tap = taps[s];
+                if(s >= count)
+                {
+                    tap.offset = 0;
+                    tap.camera = BirdsEyeTable::NoCamera;
+                    std::fill(tap.weight, tap.weight + 4, 0);
+                    continue;
+                }
+                
+                const CameraSamples& cam = cameras[best[s]];
+                const T blend = cam.weights[i] / total;
+                const T fx = std::min(std::max(cam.pixels[i](0), T(0.0)), cam.width - T(1.001));
+                const T fy = std::min(std::max(cam.pixels[i](1), T(0.0)), cam.height - T(1.001));
+                const T x0 = floor(fx), y0 = floor(fy), ax = fx - x0, ay = fy - y0;
+                const T bilinear[4] = { (T(1.0) - ax) * (T(1.0) - ay), ax * (T(1.0) - ay), (T(1.0) - ax) * ay, ax * ay };
+                
+                tap.offset = (std::uint32_t)((std::size_t)y0 * cam.stride + (std::size_t)x0);
+                tap.camera = (std::uint8_t)best[s];
+                for(std::size_t k = 0 ; k < 4 ; ++k)
+                {
+                    tap.weight[k] = (std::uint16_t)std::floor(blend * bilinear[k] * T(BirdsEyeTable::One) + T(0.5));
+                    sum += tap.weight[k];
+                    if(largest == nullptr || tap.weight[k] > *largest) { largest = &tap.weight[k]; }
+                }
+            }
+            
+            // rounding leftovers go to the largest weight, so the weights sum to One exactly
+            if(largest != nullptr)
+            {
+                *largest = (std::uint16_t)(std::int32_t(*largest) + std::int32_t(BirdsEyeTable::One) - std::int32_t(sum));
+            }
+        }
+        
+        return ret;
+    }
+    
+private:
+    struct CameraSamples
+    {
+        T width, height;
+        std::size_t stride;
+        std::vector<PixelT, Eigen::aligned_allocator<PixelT>> pixels;
+        std::vector<T> weights;
+    };
+    
+    BirdsEyeGrid<T> grid;
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> cells;
+    std::vector<CameraSamples> cameras;
+};
+
+}
+
+#endif // CAMERA_BIRDS_EYE_HPP
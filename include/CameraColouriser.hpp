@@ -0,0 +1,276 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Multi-view colourisation of point clouds with occlusion tests.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_COLOURISER_HPP
+#define CAMERA_COLOURISER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+#include <CameraThreads.hpp>
+#include <CameraProjectedView.hpp>
+
+namespace camera
+{
+
+/**
+ * How the colours seen by several views are combined.
+ */
+enum class ColourMode
+{
+    Blend = 0, // weighted average
+    Best       // the view with the largest weight, the first one on ties
+};
+
+/**
+ * Colours point clouds from images of several cameras (any models, mixed). Each view
+ * projects all points in batches, a point is seen by a view when its projection is Ok and
+ * it is not behind the view's depth buffer by more than depth_tolerance (relative).
+ * The depth buffer is either given (range, i.e. distance from the camera centre, per pixel)
+ * or rendered from the cloud itself, splatting every point over (2 * splat_radius + 1)^2
+ * pixels to close the gaps between points. With normals the weight of a view is the
+ * cosine of the viewing angle and views more grazing than min_cosine are skipped.
+ * Colours are sampled bilinearly. Views reference their image and depth, which have
+ * to outlive colourise. Threads split the points, so the result does not depend on their count.
+ */
+template<typename T>
+class PointCloudColouriser
+{
+public:
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit PointCloudColouriser(std::size_t image_channels = 3, unsigned int thread_count = 0, T depth_tolerance = T(0.02),
+                                  int splat_radius = 1, T min_cosine = T(0.1), ColourMode colour_mode = ColourMode::Blend)
+        : channels(image_channels), threads(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency())),
+          tolerance(depth_tolerance), splat(splat_radius), min_cos(min_cosine), mode(colour_mode)
+    {
+    }
+    
+    inline std::size_t getViewCount() const { return views.size(); }
+    inline void clearViews() { views.clear(); }
+    
+    /**
+     * Adds a view, pose is camera to world, image is interleaved 8 bit with a row stride
+     * in pixels (0: width), depth (range, same size and stride) can be null.
+     */
+    template<typename ModelT>
+    std::size_t addView(const ModelT& model, const TransformT& pose, const std::uint8_t* image, std::size_t stride = 0, const float* depth = nullptr)
+    {
+        views.push_back(View(model, pose, image, stride, depth));
+        return views.size() - 1;
+    }
+    
+    /**
+     * Colours (channels per point) of the points, with optional normals (world frame).
+     * Points no view sees get 0. Returns the number of coloured points.
+     */
+    template<typename InT>
+    std::size_t colourise(const StridedView<InT,3>& points, const PointT* normals, std::uint8_t* colours)
+    {
+        const std::size_t count = points.size();
+        world.resize(count);
+        pixels.resize(count);
+        status.resize(count);
+        accumulated.assign(count * channels, 0.0f);
+        weights.assign(count, 0.0f);
+        
+        const std::size_t chunk = (count + threads - 1) / threads;
+        internal::runOnThreads(threads, [&](unsigned int t)
+        {
+            const std::size_t begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+            for(std::size_t i = begin ; i < end ; ++i)
+            {
+                world[i] = PointT(T(points(i, 0)), T(points(i, 1)), T(points(i, 2)));
+            }
+        });
+        
+        for(std::size_t v = 0 ; v < views.size() ; ++v)
+        {
+            const View& view = views[v];
+            
+            internal::runOnThreads(threads, [&](unsigned int t)
+            {
+                const std::size_t begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+                view.project(makePointView(world.data() + begin, end - begin), makePixelView(pixels.data() + begin, end - begin), status.data() + begin);
+            });
+            
+            if(view.depth == nullptr)
+            {
+                renderDepth(view, count, chunk);
+            }
+            
+            internal::runOnThreads(threads, [&](unsigned int t)
+            {
+                const std::size_t begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+                accumulate(view, normals, begin, end);
+            });
+        }
+        
+        std::size_t coloured = 0;
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            const float weight = mode == ColourMode::Blend ? weights[i] : (weights[i] > 0.0f ? 1.0f : 0.0f);
+            for(std::size_t c = 0 ; c < channels ; ++c)
+            {
+                colours[i * channels + c] = weight > 0.0f ? (std::uint8_t)std::min(255.0f, std::floor(accumulated[i * channels + c] / weight + 0.5f)) : 0;
+            }
+            if(weight > 0.0f) { coloured++; }
+        }
+        return coloured;
+    }
+    
+    template<typename InT>
+    inline std::size_t colourise(const StridedView<InT,3>& points, std::uint8_t* colours)
+    {
+        return colourise(points, nullptr, colours);
+    }
+    
+private:
+    struct View : public internal::ProjectedView<T>
+    {
+        template<typename ModelT>
+        View(const ModelT& model, const TransformT& pose, const std::uint8_t* rgb, std::size_t row_stride, const float* depth_image)
+            : internal::ProjectedView<T>(model, pose, depth_image, row_stride), image(rgb) { }
+        
+        const std::uint8_t* image;
+    };
+    
+    void renderDepth(const View& view, std::size_t count, std::size_t chunk)
+    {
+        zbuffer.reset(view.width, view.height);
+        
+        internal::runOnThreads(threads, [&](unsigned int t)
+        {
+            const std::size_t begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+            for(std::size_t i = begin ; i < end ; ++i)
+            {
+                std::size_t u, v;
+                if(!view.getPixel(pixels[i], status[i], u, v)) { continue; }
+                
+                const float range = float((world[i] - view.centre).norm());
+                for(int dv = -splat ; dv <= splat ; ++dv)
+                {
+                    for(int du = -splat ; du <= splat ; ++du)
+                    {
+                        const std::size_t x = u + du, y = v + dv; // wraps around below 0
+                        if(x < view.width && y < view.height)
+                        {
+                            zbuffer.write(x, y, range);
+                        }
+                    }
+                }
+            }
+        });
+    }
+    
+    void accumulate(const View& view, const PointT* normals, std::size_t begin, std::size_t end)
+    {
+        using std::abs;
+        using std::floor;
+        
+        for(std::size_t i = begin ; i < end ; ++i)
+        {
+            std::size_t u, v;
+            if(!view.getPixel(pixels[i], status[i], u, v)) { continue; }
+            
+            const PointT to_camera = view.centre - world[i];
+            const T range = to_camera.norm();
+            const T depth = T(view.getRange(zbuffer, u, v));
+            if(range > depth * (T(1.0) + tolerance)) { continue; } // occluded
+            
+            T weight = T(1.0);
+            if(normals != nullptr)
+            {
+                weight = abs(normals[i].dot(to_camera)) / (normals[i].norm() * range);
+                if(!(weight >= min_cos)) { continue; }
+            }
+            
+            if(mode == ColourMode::Best && !(float(weight) > weights[i])) { continue; }
+            
+            // bilinear sample
+            const T fx = std::min(std::max(pixels[i](0), T(0.0)), T(view.width) - T(1.001));
+            const T fy = std::min(std::max(pixels[i](1), T(0.0)), T(view.height) - T(1.001));
+            const std::size_t x0 = (std::size_t)floor(fx), y0 = (std::size_t)floor(fy);
+            const float ax = float(fx - T(x0)), ay = float(fy - T(y0));
+            const std::uint8_t* p00 = view.image + (y0 * view.stride + x0) * channels;
+            const std::uint8_t* p10 = p00 + channels;
+            const std::uint8_t* p01 = p00 + view.stride * channels;
+            const std::uint8_t* p11 = p01 + channels;
+            
+            float* acc = &accumulated[i * channels];
+            const float w = mode == ColourMode::Blend ? float(weight) : 1.0f;
+            for(std::size_t c = 0 ; c < channels ; ++c)
+            {
+                const float top = p00[c] + ax * (float(p10[c]) - float(p00[c]));
+                const float bottom = p01[c] + ax * (float(p11[c]) - float(p01[c]));
+                const float sample = top + ay * (bottom - top);
+                acc[c] = mode == ColourMode::Blend ? acc[c] + w * sample : sample;
+            }
+            weights[i] = mode == ColourMode::Blend ? weights[i] + w : float(weight);
+        }
+    }
+    
+    std::size_t channels;
+    unsigned int threads;
+    T tolerance;
+    int splat;
+    T min_cos;
+    ColourMode mode;
+    std::vector<View, Eigen::aligned_allocator<View>> views;
+    
+    // scratch, kept between calls
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> world;
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> pixels;
+    std::vector<ProjectionStatus> status;
+    std::vector<float> accumulated;
+    std::vector<float> weights;
+    internal::RangeBuffer zbuffer;
+};
+
+}
+
+#endif // CAMERA_COLOURISER_HPP
@@ -0,0 +1,309 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Hierarchical min / max depth pyramids and batched occlusion queries.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_DEPTH_PYRAMID_HPP
+#define CAMERA_DEPTH_PYRAMID_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+#include <CameraThreads.hpp>
+
+namespace camera
+{
+
+/**
+ * Min and max depth pyramid of a depth map, level l pixel covers 2^l x 2^l pixels of
+ * level 0 (clamped at the borders). Missing depth (non-positive or NaN) is infinitely far.
+ */
+class DepthPyramid
+{
+public:
+    DepthPyramid() { }
+    
+    DepthPyramid(const float* depth, std::size_t width, std::size_t height, std::size_t stride = 0, std::size_t levels = 0)
+    {
+        build(depth, width, height, stride, levels);
+    }
+    
+    /**
+     * (Re)builds the pyramid, reusing the buffers. levels = 0 goes down to a single pixel.
+     */
+    void build(const float* depth, std::size_t width, std::size_t height, std::size_t stride = 0, std::size_t levels = 0)
+    {
+        if(stride == 0) { stride = width; }
+        
+        std::size_t max_levels = 1;
+        for(std::size_t w = width, h = height ; w > 1 || h > 1 ; w = (w + 1) / 2, h = (h + 1) / 2) { max_levels++; }
+        levels = levels == 0 ? max_levels : std::min(levels, max_levels);
+        
+        sizes.resize(levels);
+        mins.resize(levels);
+        maxs.resize(levels);
+        
+        sizes[0] = Size(width, height);
+        mins[0].resize(width * height);
+        for(std::size_t y = 0 ; y < height ; ++y)
+        {
+            for(std::size_t x = 0 ; x < width ; ++x)
+            {
+                const float d = depth[y * stride + x];
+                mins[0][y * width + x] = d > 0.0f ? d : std::numeric_limits<float>::infinity();
+            }
+        }
+        maxs[0] = mins[0];
+        
+        for(std::size_t l = 1 ; l < levels ; ++l)
+        {
+            const Size& prev = sizes[l - 1];
+            sizes[l] = Size((prev.w + 1) / 2, (prev.h + 1) / 2);
+            reduce(mins[l - 1], prev, mins[l], sizes[l], [](float a, float b) { return std::min(a, b); });
+            reduce(maxs[l - 1], prev, maxs[l], sizes[l], [](float a, float b) { return std::max(a, b); });
+        }
+    }
+    
+    inline std::size_t getLevelCount() const { return sizes.size(); }
+    inline std::size_t width(std::size_t level = 0) const { return sizes[level].w; }
+    inline std::size_t height(std::size_t level = 0) const { return sizes[level].h; }
+    inline float getMin(std::size_t level, std::size_t x, std::size_t y) const { return mins[level][y * sizes[level].w + x]; }
+    inline float getMax(std::size_t level, std::size_t x, std::size_t y) const { return maxs[level][y * sizes[level].w + x]; }
+    
+    /**
+     * Is depth at level 0 pixel (x,y) not behind the map by more than tolerance (relative),
+     * descending from level only as far as needed.
+     */
+    inline bool isVisible(float depth, std::size_t x, std::size_t y, float tolerance, std::size_t level = 0) const
+    {
+        for(std::size_t l = std::min(level, sizes.size() - 1) + 1 ; l-- > 0 ; )
+        {
+            const std::size_t i = (y >> l) * sizes[l].w + (x >> l);
+            if(depth <= mins[l][i] * (1.0f + tolerance)) { return true; }
+            if(depth > maxs[l][i] * (1.0f + tolerance)) { return false; }
+        }
+        return false; // not reached, min and max are equal at level 0
+    }
+    
+private:
+    struct Size
+    {
+        Size(std::size_t ww = 0, std::size_t hh = 0) : w(ww), h(hh) { }
+        std::size_t w, h;
+    };
+    
+    template<typename OpT>
+    static inline void reduce(const std::vector<float>& src, const Size& src_size, std::vector<float>& dst, const Size& dst_size, OpT op)
+    {
+        dst.resize(dst_size.w * dst_size.h);
+        for(std::size_t y = 0 ; y < dst_size.h ; ++y)
+        {
+            const float* r0 = &src[(2 * y) * src_size.w];
+            const float* r1 = &src[std::min(2 * y + 1, src_size.h - 1) * src_size.w];
+            for(std::size_t x = 0 ; x < dst_size.w ; ++x)
+            {
+                const std::size_t x0 = 2 * x, x1 = std::min(2 * x + 1, src_size.w - 1);
+                dst[y * dst_size.w + x] = op(op(r0[x0], r0[x1]), op(r1[x0], r1[x1]));
+            }
+        }
+    }
+    
+    std::vector<Size> sizes;
+    std::vector<std::vector<float>> mins;
+    std::vector<std::vector<float>> maxs;
+};
+
+struct OcclusionQueryStatistics
+{
+    OcclusionQueryStatistics() : points(0), visible(0), accepted_in_tiles(0), rejected_in_tiles(0) { }
+    
+    std::size_t points;
+    std::size_t visible;
+    std::size_t accepted_in_tiles;
+    std::size_t rejected_in_tiles;
+};
+
+/**
+ * Batched visibility of world points in a camera with a depth pyramid of its depth map.
+ * Points are projected in batches (forwardBatch with pose), then consecutive points falling
+ * into the same tile of tile_level are accepted or rejected together from the range of their
+ * depths against the tile's min / max, only the undecided ones descend the pyramid per point.
+ * Clouds stored in a spatially coherent order (scans, voxels) form long runs.
+ * Points that do not project Ok are not visible.
+ */
+template<typename ModelT>
+class OcclusionQuery
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::PointT PointT;
+    typedef typename ComplexTypes<Scalar>::PixelT PixelT;
+    typedef typename ComplexTypes<Scalar>::TransformT TransformT;
+    static constexpr std::size_t ChunkSize = 4096;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    OcclusionQuery(const ModelT& m, DepthType type = DepthType::Range, float depth_tolerance = 0.01f, std::size_t tile_level = 4, unsigned int thread_count = 0)
+        : model(m), depth_type(type), tolerance(depth_tolerance), level(tile_level),
+          threads(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency())) { }
+    
+    inline const ModelT& getModel() const { return model; }
+    
+    /**
+     * Writes 1 / 0 per point to visible, pose is camera to world.
+     */
+    template<typename InT>
+    OcclusionQueryStatistics query(const DepthPyramid& pyramid, const TransformT& pose, const StridedView<InT,3>& points, std::uint8_t* visible) const
+    {
+        assert(pyramid.width() == (std::size_t)model.width() && pyramid.height() == (std::size_t)model.height());
+        
+        const TransformT world_to_camera = pose.inverse();
+        const Eigen::Matrix<Scalar,3,3> rot = world_to_camera.rotationMatrix();
+        const PointT trans = world_to_camera.translation();
+        const std::size_t tile = std::min(level, pyramid.getLevelCount() - 1);
+        const std::size_t chunks = (points.size() + ChunkSize - 1) / ChunkSize;
+        
+        std::atomic<std::size_t> next_chunk(0), cnt_visible(0), cnt_accepted(0), cnt_rejected(0);
+        internal::runOnThreads(threads, [&](unsigned int)
+        {
+            std::vector<PixelT, Eigen::aligned_allocator<PixelT>> pixels(ChunkSize);
+            std::vector<ProjectionStatus> status(ChunkSize);
+            std::vector<float> depths(ChunkSize);
+            std::vector<std::uint32_t> cells(ChunkSize);
+            std::size_t local_visible = 0, local_accepted = 0, local_rejected = 0;
+            
+            for(std::size_t c = next_chunk.fetch_add(1) ; c < chunks ; c = next_chunk.fetch_add(1))
+            {
+                const std::size_t begin = c * ChunkSize, count = std::min(ChunkSize, points.size() - begin);
+                const StridedView<InT,3> chunk = points.segment(begin, count);
+                forwardBatch(model, pose, chunk, makePixelView(pixels.data(), count), status.data());
+                
+                // level 0 pixel of the point, its depth as the map stores it
+                for(std::size_t i = 0 ; i < count ; ++i)
+                {
+                    cells[i] = 0xFFFFFFFFu;
+                    if(status[i] != ProjectionStatus::Ok) { continue; }
+                    
+                    const Scalar fu = std::floor(pixels[i](0) + Scalar(0.5)), fv = std::floor(pixels[i](1) + Scalar(0.5));
+                    if(!(fu >= Scalar(0.0) && fv >= Scalar(0.0) && fu < Scalar(pyramid.width()) && fv < Scalar(pyramid.height()))) { continue; }
+                    const std::size_t u = (std::size_t)fu, v = (std::size_t)fv;
+                    
+                    const PointT pc = rot * PointT(Scalar(chunk(i, 0)), Scalar(chunk(i, 1)), Scalar(chunk(i, 2))) + trans;
+                    depths[i] = float(depth_type == DepthType::ZDepth ? pc(2) : pc.norm());
+                    cells[i] = (std::uint32_t)(v * pyramid.width() + u);
+                }
+                
+                // runs of points in the same tile
+                std::size_t i = 0;
+                while(i < count)
+                {
+                    if(cells[i] == 0xFFFFFFFFu)
+                    {
+                        visible[begin + i] = 0;
+                        ++i;
+                        continue;
+                    }
+                    
+                    const std::size_t tx = (cells[i] % pyramid.width()) >> tile, ty = (cells[i] / pyramid.width()) >> tile;
+                    float lo = depths[i], hi = depths[i];
+                    std::size_t end = i + 1;
+                    for( ; end < count && cells[end] != 0xFFFFFFFFu &&
+                           ((cells[end] % pyramid.width()) >> tile) == tx && ((cells[end] / pyramid.width()) >> tile) == ty ; ++end)
+                    {
+                        lo = std::min(lo, depths[end]);
+                        hi = std::max(hi, depths[end]);
+                    }
+                    
+                    const float scale = 1.0f + tolerance;
+                    if(end - i > 1 && hi <= pyramid.getMin(tile, tx, ty) * scale)
+                    {
+                        std::fill(visible + begin + i, visible + begin + end, 1);
+                        local_visible += end - i;
+                        local_accepted += end - i;
+                    }
+                    else if(end - i > 1 && lo > pyramid.getMax(tile, tx, ty) * scale)
+                    {
+                        std::fill(visible + begin + i, visible + begin + end, 0);
+                        local_rejected += end - i;
+                    }
+                    else
+                    {
+                        for(std::size_t k = i ; k < end ; ++k)
+                        {
+                            const bool seen = pyramid.isVisible(depths[k], cells[k] % pyramid.width(), cells[k] / pyramid.width(), tolerance, tile);
+                            visible[begin + k] = seen ? 1 : 0;
+                            if(seen) { local_visible++; }
+                        }
+                    }
+                    
+                    i = end;
+                }
+            }
+            
+            cnt_visible.fetch_add(local_visible);
+            cnt_accepted.fetch_add(local_accepted);
+            cnt_rejected.fetch_add(local_rejected);
+        });
+        
+        OcclusionQueryStatistics ret;
+        ret.points = points.size();
+        ret.visible = cnt_visible.load();
+        ret.accepted_in_tiles = cnt_accepted.load();
+        ret.rejected_in_tiles = cnt_rejected.load();
+        return ret;
+    }
+    
+private:
+    ModelT model;
+    DepthType depth_type;
+    float tolerance;
+    std::size_t level;
+    unsigned int threads;
+};
+
+template<typename ModelT>
+constexpr std::size_t OcclusionQuery<ModelT>::ChunkSize;
+
+}
+
+#endif // CAMERA_DEPTH_PYRAMID_HPP
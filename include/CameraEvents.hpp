@@ -0,0 +1,250 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Event camera stream undistortion through per-pixel tables.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_EVENTS_HPP
+#define CAMERA_EVENTS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <limits>
+
+#include <CameraModelHelpers.hpp>
+#include <PinholeCameraModel.hpp>
+#include <CameraTables.hpp>
+#include <CameraPacket.hpp>
+#include <CameraStridedView.hpp>
+
+namespace camera
+{
+
+/**
+ * DVS event, timestamp in microseconds. The undistorter works on any type with
+ * integer x, y (and t for rotation compensation) members.
+ */
+struct CameraEvent
+{
+    std::uint16_t x;
+    std::uint16_t y;
+    std::int64_t t;
+    std::int8_t polarity;
+};
+
+/**
+ * Undistorts event coordinates into an ideal pinhole camera. Events sit on integer pixels,
+ * so the whole model is precomputed per sensor pixel: the undistorted pixel for the plain
+ * path and the ray for rotation compensation. Both paths run on packets of 8 events with
+ * the table entries gathered per lane, no model function is evaluated per event.
+ */
+template<typename SrcModelT>
+class EventUndistorter
+{
+public:
+    typedef PinholeCameraModel<float> DstModelT;
+    typedef Packet8f PacketT;
+    static constexpr int Lanes = PacketT::Size;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    /**
+     * Into a pinhole with the intrinsics of the source.
+     */
+    explicit EventUndistorter(const SrcModelT& src) 
+        : EventUndistorter(src, DstModelT((float)src.fx(), (float)src.fy(), (float)src.u0(), (float)src.v0(), (float)src.width(), (float)src.height())) { }
+    
+    EventUndistorter(const SrcModelT& src, const DstModelT& dst) : source(src), target(dst), w((std::size_t)src.width()), h((std::size_t)src.height()),
+        pixels(w, h), rays(w, h)
+    {
+        typedef typename SrcModelT::Scalar Scalar;
+        
+        for(std::size_t y = 0 ; y < h ; ++y)
+        {
+            for(std::size_t x = 0 ; x < w ; ++x)
+            {
+                const typename ComplexTypes<Scalar>::PointT r = src.inverse((Scalar)x, (Scalar)y);
+                const Eigen::Vector3f ray = r.template cast<float>().normalized();
+                const bool valid = src.pixelValidCircular((Scalar)x, (Scalar)y) && ray(2) > 0.0f;
+                
+                float* ro = rays.mutablePixel(x,y);
+                ro[0] = ray(0);
+                ro[1] = ray(1);
+                ro[2] = valid ? ray(2) : 0.0f; // z = 0 never projects in front
+                
+                // outside the target or invalid is flagged with a NaN
+                const Eigen::Vector2f pix = dst.forward(ray);
+                const bool inside = valid && dst.pixelValidSquare(pix);
+                float* po = pixels.mutablePixel(x,y);
+                po[0] = inside ? pix(0) : std::numeric_limits<float>::quiet_NaN();
+                po[1] = inside ? pix(1) : std::numeric_limits<float>::quiet_NaN();
+            }
+        }
+    }
+    
+    inline const SrcModelT& getSource() const { return source; }
+    inline const DstModelT& getTarget() const { return target; }
+    inline const RemapTable<float>& getPixelTable() const { return pixels; }
+    inline const RayTable<float>& getRayTable() const { return rays; }
+    
+    /**
+     * Undistorted positions, valid[i] (optional) is 0 for events not landing in the target.
+     * Returns the number of valid events.
+     */
+    template<typename EventT>
+    std::size_t undistort(const EventT* events, std::size_t count, const PixelView<float>& out, std::uint8_t* valid = nullptr) const
+    {
+        assert(out.size() >= count);
+        std::size_t ret = 0;
+        
+        std::size_t i = 0;
+        for( ; i + Lanes <= count ; i += Lanes)
+        {
+            PacketT px, py;
+            for(int l = 0 ; l < Lanes ; ++l)
+            {
+                const float* p = lookup(pixels, events[i + l]);
+                px[l] = p[0];
+                py[l] = p[1];
+            }
+            
+            ret += write(px, py, px == px, out, valid, i);
+        }
+        
+        for( ; i < count ; ++i)
+        {
+            const float* p = lookup(pixels, events[i]);
+            ret += write(p[0], p[1], p[0] == p[0], out, valid, i);
+        }
+        
+        return ret;
+    }
+    
+    /**
+     * As above, also removing the camera rotation since t_ref (microseconds, same clock as the
+     * events) at constant angular velocity omega (rad/s, camera frame, e.g. the gyro sample
+     * of the batch). Every event is brought back to the orientation at t_ref. First order in
+     * the rotation angle, accurate for the short intervals of an event batch.
+     */
+    template<typename EventT>
+    std::size_t undistort(const EventT* events, std::size_t count, const Eigen::Vector3f& omega, std::int64_t t_ref,
+                          const PixelView<float>& out, std::uint8_t* valid = nullptr) const
+    {
+        assert(out.size() >= count);
+        std::size_t ret = 0;
+        
+        const PacketT wx(omega(0) * 1e-6f), wy(omega(1) * 1e-6f), wz(omega(2) * 1e-6f);
+        const PacketT fx(target.fx()), fy(target.fy()), u0(target.u0()), v0(target.v0());
+        
+        std::size_t i = 0;
+        for( ; i + Lanes <= count ; i += Lanes)
+        {
+            PacketT rx, ry, rz, dt;
+            for(int l = 0 ; l < Lanes ; ++l)
+            {
+                const float* r = lookup(rays, events[i + l]);
+                rx[l] = r[0];
+                ry[l] = r[1];
+                rz[l] = r[2];
+                dt[l] = float(events[i + l].t - t_ref);
+            }
+            
+            PacketT px, py;
+            const typename PacketT::Mask ok = rotateProject(rx, ry, rz, dt * wx, dt * wy, dt * wz, fx, fy, u0, v0, px, py);
+            ret += write(px, py, ok, out, valid, i);
+        }
+        
+        for( ; i < count ; ++i)
+        {
+            const float* r = lookup(rays, events[i]);
+            const float dt = float(events[i].t - t_ref);
+            float px, py;
+            const bool ok = rotateProject(r[0], r[1], r[2], dt * omega(0) * 1e-6f, dt * omega(1) * 1e-6f, dt * omega(2) * 1e-6f,
+                                          target.fx(), target.fy(), target.u0(), target.v0(), px, py);
+            ret += write(px, py, ok, out, valid, i);
+        }
+        
+        return ret;
+    }
+    
+private:
+    template<typename TableT, typename EventT>
+    inline const float* lookup(const TableT& table, const EventT& e) const
+    {
+        assert((std::size_t)e.x < w && (std::size_t)e.y < h);
+        return table((std::size_t)e.x, (std::size_t)e.y);
+    }
+    
+    // ray + (omega dt) x ray, projected by the target pinhole
+    template<typename T>
+    inline typename ScalarMask<T>::Type rotateProject(const T& rx, const T& ry, const T& rz, const T& ax, const T& ay, const T& az,
+                                                      const T& fx, const T& fy, const T& u0, const T& v0, T& px, T& py) const
+    {
+        const T qx = rx + (ay * rz - az * ry);
+        const T qy = ry + (az * rx - ax * rz);
+        const T qz = rz + (ax * ry - ay * rx);
+        const typename ScalarMask<T>::Type front = (rz > T(0.0f)) && (qz > T(0.0f));
+        const T inv_z = T(1.0f) / select(front, qz, T(1.0f));
+        px = fx * qx * inv_z + u0;
+        py = fy * qy * inv_z + v0;
+        return front && target.template pixelValidSquare<T>(px, py);
+    }
+    
+    inline std::size_t write(float px, float py, bool ok, const PixelView<float>& out, std::uint8_t* valid, std::size_t i) const
+    {
+        out(i, 0) = px;
+        out(i, 1) = py;
+        if(valid != nullptr) { valid[i] = ok ? 1 : 0; }
+        return ok ? 1 : 0;
+    }
+    
+    inline std::size_t write(const PacketT& px, const PacketT& py, const typename PacketT::Mask& ok, const PixelView<float>& out, std::uint8_t* valid, std::size_t i) const
+    {
+        std::size_t ret = 0;
+        for(int l = 0 ; l < Lanes ; ++l)
+        {
+            ret += write(px[l], py[l], ok[l], out, valid, i + l);
+        }
+        return ret;
+    }
+    
+    SrcModelT source;
+    DstModelT target;
+    std::size_t w, h;
+    RemapTable<float> pixels;
+    RayTable<float> rays;
+};
+
+}
+
+#endif // CAMERA_EVENTS_HPP
@@ -0,0 +1,217 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Prediction of feature positions under a rotation (gyro aided tracking).
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_FEATURE_PREDICTION_HPP
+#define CAMERA_FEATURE_PREDICTION_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <type_traits>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+// undistorted pinhole (also the disparity one, same projection), a rotation maps pixels by the homography K R^-1 K^-1
+template<typename ModelT>
+struct IsHomographyModel : std::integral_constant<bool, ModelT::ModelType == CameraModelType::Pinhole ||
+                                                        ModelT::ModelType == CameraModelType::PinholeDisparity> { };
+
+template<typename T, typename ModelT>
+EIGEN_DEVICE_FUNC inline typename ComplexTypes<T>::PixelT predictFeature(const ModelT& model, const Eigen::Matrix<typename ModelT::Scalar,3,3>& world_to_camera,
+                                                                         const T& x, const T& y, ProjectionStatus* status, std::false_type)
+{
+    const typename ComplexTypes<T>::PointT ray = model.template inverse<T>(x, y);
+    typename ComplexTypes<T>::PointT pt;
+    for(int r = 0 ; r < 3 ; ++r)
+    {
+        pt(r) = T(world_to_camera(r,0)) * ray(0) + T(world_to_camera(r,1)) * ray(1) + T(world_to_camera(r,2)) * ray(2);
+    }
+    
+    return forwardWithStatus<T>(model, pt, status);
+}
+
+// world_to_camera is the homography here
+template<typename T, typename ModelT>
+EIGEN_DEVICE_FUNC inline typename ComplexTypes<T>::PixelT predictFeature(const ModelT& model, const Eigen::Matrix<typename ModelT::Scalar,3,3>& hmg,
+                                                                         const T& x, const T& y, ProjectionStatus* status, std::true_type)
+{
+    const T hx = T(hmg(0,0)) * x + T(hmg(0,1)) * y + T(hmg(0,2));
+    const T hy = T(hmg(1,0)) * x + T(hmg(1,1)) * y + T(hmg(1,2));
+    const T hz = T(hmg(2,0)) * x + T(hmg(2,1)) * y + T(hmg(2,2));
+    
+    typename ComplexTypes<T>::PixelT pix;
+    pix(0) = hx / hz;
+    pix(1) = hy / hz;
+    
+    // as forwardWithStatus, K keeps the sign of z
+    ProjectionStatusWriter<T>::write(allFinite(x, y),
+                                     hz > T(0.0),
+                                     allFinite(pix(0), pix(1)),
+                                     model.template pixelValidSquare<T>(pix(0), pix(1)),
+                                     model.template pixelValidCircular<T>(pix(0), pix(1)),
+                                     status);
+    return pix;
+}
+
+template<typename ModelT>
+inline Eigen::Matrix<typename ModelT::Scalar,3,3> getPredictionMatrix(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::RotationT& rotation, std::false_type)
+{
+    return rotation.inverse().matrix();
+}
+
+template<typename ModelT>
+inline Eigen::Matrix<typename ModelT::Scalar,3,3> getPredictionMatrix(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::RotationT& rotation, std::true_type)
+{
+    const Eigen::Matrix<typename ModelT::Scalar,3,3> K = model.getIntrinsicMatrix();
+    return K * rotation.inverse().matrix() * K.inverse();
+}
+
+}
+
+/**
+ * Positions of features at pixels in the next frame, rotated by rotation (camera to world,
+ * as in forward(rotation, pt), with the previous frame as the world): unproject, rotate and
+ * project fused in one pass over packets. For the undistorted pinhole model this is a single
+ * homography per pixel. Status tells if the predicted position can be used.
+ */
+template<typename ModelT, typename InT, typename OutT>
+inline void predictFeatures(const ModelT& model, const typename ComplexTypes<typename ModelT::Scalar>::RotationT& rotation,
+                            const StridedView<InT,2>& pixels, const StridedView<OutT,2>& predicted, ProjectionStatus* status)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    typedef typename internal::IsHomographyModel<ModelT>::type PathT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    
+    assert(predicted.size() >= pixels.size());
+    const std::size_t count = pixels.size();
+    const Eigen::Matrix<Scalar,3,3> m = internal::getPredictionMatrix(model, rotation, PathT());
+    
+    std::size_t i = 0;
+    for( ; i + Lanes <= count ; i += Lanes)
+    {
+        PacketT x, y;
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            x[l] = Scalar(pixels(i + l, 0));
+            y[l] = Scalar(pixels(i + l, 1));
+        }
+        
+        const typename ComplexTypes<PacketT>::PixelT pix = internal::predictFeature<PacketT>(model, m, x, y, status + i, PathT());
+        
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            predicted(i + l, 0) = OutT(pix(0)[l]);
+            predicted(i + l, 1) = OutT(pix(1)[l]);
+        }
+    }
+    
+    for( ; i < count ; ++i)
+    {
+        const typename ComplexTypes<Scalar>::PixelT pix = internal::predictFeature<Scalar>(model, m, Scalar(pixels(i, 0)), Scalar(pixels(i, 1)), status + i, PathT());
+        predicted(i, 0) = OutT(pix(0));
+        predicted(i, 1) = OutT(pix(1));
+    }
+}
+
+/**
+ * Tracked features with their rays cached, so that predicting them under the rotation
+ * measured by a gyro is a batch rotation-only forward. Update the features that the
+ * tracker refined (setFeature) and reset the set on re-detection (setFeatures).
+ */
+template<typename ModelT>
+class FeaturePredictor
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::PointT PointT;
+    typedef typename ComplexTypes<Scalar>::RotationT RotationT;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit FeaturePredictor(const ModelT& m) : model(m) { }
+    
+    inline const ModelT& getModel() const { return model; }
+    inline std::size_t getFeatureCount() const { return rays.size(); }
+    inline const PointT& getRay(std::size_t i) const { return rays[i]; }
+    
+    template<typename InT>
+    inline void setFeatures(const StridedView<InT,2>& pixels)
+    {
+        rays.resize(pixels.size());
+        inverseBatch(model, pixels, makePointView(rays.data(), rays.size()));
+    }
+    
+    inline void setFeature(std::size_t i, Scalar x, Scalar y)
+    {
+        assert(i < rays.size());
+        rays[i] = model.inverse(x, y);
+    }
+    
+    inline std::size_t addFeature(Scalar x, Scalar y)
+    {
+        rays.push_back(model.inverse(x, y));
+        return rays.size() - 1;
+    }
+    
+    inline void clear() { rays.clear(); }
+    
+    /**
+     * Predicted positions of all features under rotation, see predictFeatures.
+     */
+    template<typename OutT>
+    inline void predict(const RotationT& rotation, const StridedView<OutT,2>& predicted, ProjectionStatus* status) const
+    {
+        forwardBatch(model, rotation, makePointView(rays.data(), rays.size()), predicted, status);
+    }
+    
+private:
+    ModelT model;
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> rays;
+};
+
+}
+
+#endif // CAMERA_FEATURE_PREDICTION_HPP
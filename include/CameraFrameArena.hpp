@@ -0,0 +1,212 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Per-frame monotonic arena for batch temporaries.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_FRAME_ARENA_HPP
+#define CAMERA_FRAME_ARENA_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <Eigen/Core>
+
+namespace camera
+{
+
+/**
+ * Monotonic allocator for per-frame scratch buffers. Allocation is a pointer bump,
+ * nothing is freed until reset(). After a reset the chunks used during the frame are
+ * merged into one, so a steady state loop stops touching the heap after the first frames.
+ * Objects are not destroyed, only trivially destructible types (scalars, fixed size Eigen
+ * types) can be allocated. Not thread safe, use one arena per thread.
+ */
+class FrameArena
+{
+public:
+    // at least what Eigen needs for vectorised types, a cache line to avoid false sharing
+    static constexpr std::size_t DefaultAlignment = EIGEN_MAX_ALIGN_BYTES > 64 ? EIGEN_MAX_ALIGN_BYTES : 64;
+    
+    explicit FrameArena(std::size_t initial_bytes = 1 << 20) : used_total(0), high_water(0), heap_allocations(0)
+    {
+        addChunk(initial_bytes);
+    }
+    
+    ~FrameArena()
+    {
+        for(std::size_t i = 0 ; i < chunks.size() ; ++i)
+        {
+            Eigen::internal::aligned_free(chunks[i].begin);
+        }
+    }
+    
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    
+    /**
+     * Uninitialized bytes, alignment must be a power of two.
+     */
+    inline void* allocate(std::size_t bytes, std::size_t alignment = DefaultAlignment)
+    {
+        assert((alignment & (alignment - 1)) == 0);
+        
+        void* ret = bump(chunks.back(), bytes, alignment);
+        if(ret == nullptr)
+        {
+            addChunk(std::max(bytes + alignment, 2 * chunks.back().size()));
+            ret = bump(chunks.back(), bytes, alignment);
+        }
+        
+        used_total += bytes;
+        high_water = std::max(high_water, used_total);
+        return ret;
+    }
+    
+    /**
+     * Default constructed array of n objects.
+     */
+    template<typename T>
+    inline T* allocate(std::size_t n, std::size_t alignment = DefaultAlignment)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        
+        T* ret = static_cast<T*>(allocate(n * sizeof(T), std::max(alignment, (std::size_t)alignof(T))));
+        for(std::size_t i = 0 ; i < n ; ++i)
+        {
+            new (ret + i) T;
+        }
+        return ret;
+    }
+    
+    /**
+     * Releases everything allocated, call once per frame.
+     */
+    inline void reset()
+    {
+        if(chunks.size() > 1)
+        {
+            std::size_t total = 0;
+            for(std::size_t i = 0 ; i < chunks.size() ; ++i)
+            {
+                total += chunks[i].size();
+                Eigen::internal::aligned_free(chunks[i].begin);
+            }
+            chunks.clear();
+            addChunk(total);
+        }
+        
+        chunks.back().current = chunks.back().begin;
+        used_total = 0;
+    }
+    
+    inline std::size_t getUsedBytes() const { return used_total; }
+    inline std::size_t getHighWaterBytes() const { return high_water; }
+    inline std::size_t getHeapAllocations() const { return heap_allocations; }
+    
+    inline std::size_t getCapacityBytes() const
+    {
+        std::size_t ret = 0;
+        for(std::size_t i = 0 ; i < chunks.size() ; ++i) { ret += chunks[i].size(); }
+        return ret;
+    }
+    
+private:
+    struct Chunk
+    {
+        char* begin;
+        char* current;
+        char* end;
+        
+        inline std::size_t size() const { return end - begin; }
+    };
+    
+    static inline void* bump(Chunk& c, std::size_t bytes, std::size_t alignment)
+    {
+        const std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(c.current) + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+        if(p + bytes > reinterpret_cast<std::uintptr_t>(c.end))
+        {
+            return nullptr;
+        }
+        
+        c.current = reinterpret_cast<char*>(p + bytes);
+        return reinterpret_cast<void*>(p);
+    }
+    
+    inline void addChunk(std::size_t bytes)
+    {
+        Chunk c;
+        c.begin = static_cast<char*>(Eigen::internal::aligned_malloc(bytes));
+        c.current = c.begin;
+        c.end = c.begin + bytes;
+        chunks.push_back(c);
+        heap_allocations++;
+    }
+    
+    std::vector<Chunk> chunks;
+    std::size_t used_total;
+    std::size_t high_water;
+    std::size_t heap_allocations;
+};
+
+/**
+ * STL allocator drawing from a FrameArena, deallocation is a no-op.
+ */
+template<typename T>
+class FrameArenaAllocator
+{
+public:
+    typedef T value_type;
+    
+    explicit FrameArenaAllocator(FrameArena& a) : arena(&a) { }
+    template<typename U> FrameArenaAllocator(const FrameArenaAllocator<U>& other) : arena(&other.getArena()) { }
+    
+    inline T* allocate(std::size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), std::max((std::size_t)FrameArena::DefaultAlignment, (std::size_t)alignof(T)))); }
+    inline void deallocate(T*, std::size_t) { }
+    
+    inline FrameArena& getArena() const { return *arena; }
+    
+    template<typename U> inline bool operator==(const FrameArenaAllocator<U>& other) const { return arena == &other.getArena(); }
+    template<typename U> inline bool operator!=(const FrameArenaAllocator<U>& other) const { return arena != &other.getArena(); }
+    
+private:
+    FrameArena* arena;
+};
+
+}
+
+#endif // CAMERA_FRAME_ARENA_HPP
@@ -0,0 +1,489 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Runtime selection of the fastest batch kernel within an accuracy bound.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_KERNEL_TUNER_HPP
+#define CAMERA_KERNEL_TUNER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include <CameraModelHash.hpp>
+#include <CameraTables.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+/**
+ * Implementations a batch call can be dispatched to.
+ */
+enum class KernelPath : std::uint8_t
+{
+    Scalar = 0,     // analytic, one point at a time
+    Packet,         // analytic, packets (see CameraPacket.hpp)
+    RadialTable,    // 1D table, radially symmetric models only
+    RayTable        // 2D ray table, bilinear
+};
+
+inline const char* getKernelPathName(KernelPath p)
+{
+    switch(p)
+    {
+        case KernelPath::Scalar: return "Scalar";
+        case KernelPath::Packet: return "Packet";
+        case KernelPath::RadialTable: return "RadialTable";
+        case KernelPath::RayTable: return "RayTable";
+    }
+    return "Unknown";
+}
+
+/**
+ * Tuning outcome for one batch size class.
+ */
+struct KernelChoice
+{
+    KernelChoice() : inverse(KernelPath::Scalar), forward(KernelPath::Scalar), inverse_ns(0.0), forward_ns(0.0) { }
+    
+    KernelPath inverse;
+    KernelPath forward;
+    double inverse_ns;  // per point
+    double forward_ns;
+};
+
+/**
+ * Hash of the CPU model and thread count, so profiles do not move between different machines.
+ */
+inline std::uint64_t getCpuSignature()
+{
+    std::string model;
+#if defined(__linux__)
+    std::ifstream ifs("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        if(line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "CPU part") == 0)
+        {
+            model = line;
+            break;
+        }
+    }
+#endif // __linux__
+    
+    std::uint64_t h = internal::HashOffsetBasis;
+    for(std::size_t i = 0 ; i < model.size() ; ++i) { h = internal::hashAppendWord(h, (unsigned char)model[i], 1); }
+    return combineHash(h, std::thread::hardware_concurrency());
+}
+
+/**
+ * Saved tuning results, one line per model / CPU / tolerance key and size class.
+ */
+class KernelProfile
+{
+public:
+    static constexpr std::size_t SizeClasses = 3;
+    
+    inline bool find(std::uint64_t key, std::size_t size_class, KernelChoice& choice) const
+    {
+        std::map<std::pair<std::uint64_t,std::size_t>,KernelChoice>::const_iterator it = entries.find(std::make_pair(key, size_class));
+        if(it == entries.end()) { return false; }
+        choice = it->second;
+        return true;
+    }
+    
+    inline void set(std::uint64_t key, std::size_t size_class, const KernelChoice& choice)
+    {
+        entries[std::make_pair(key, size_class)] = choice;
+    }
+    
+    inline std::size_t size() const { return entries.size(); }
+    
+    bool save(const std::string& path) const
+    {
+        std::ofstream ofs(path.c_str());
+        if(!ofs.good()) { return false; }
+        
+        ofs << "# camera_models kernel profile 1" << std::endl;
+        for(std::map<std::pair<std::uint64_t,std::size_t>,KernelChoice>::const_iterator it = entries.begin() ; it != entries.end() ; ++it)
+        {
+            char key[32];
+            std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)it->first.first);
+            ofs << key << " " << it->first.second << " " << (int)it->second.inverse << " " << (int)it->second.forward 
+                << " " << it->second.inverse_ns << " " << it->second.forward_ns << std::endl;
+        }
+        return ofs.good();
+    }
+    
+    bool load(const std::string& path)
+    {
+        std::ifstream ifs(path.c_str());
+        std::string line;
+        if(!std::getline(ifs, line) || line != "# camera_models kernel profile 1") { return false; }
+        
+        while(std::getline(ifs, line))
+        {
+            unsigned long long key = 0;
+            unsigned long size_class = 0;
+            int inverse = 0, forward = 0;
+            KernelChoice choice;
+            if(std::sscanf(line.c_str(), "%llx %lu %d %d %lf %lf", &key, &size_class, &inverse, &forward, &choice.inverse_ns, &choice.forward_ns) != 6 ||
+               size_class >= SizeClasses || inverse > (int)KernelPath::RayTable || forward > (int)KernelPath::Packet)
+            {
+                return false;
+            }
+            choice.inverse = (KernelPath)inverse;
+            choice.forward = (KernelPath)forward;
+            set(key, size_class, choice);
+        }
+        return true;
+    }
+    
+private:
+    std::map<std::pair<std::uint64_t,std::size_t>,KernelChoice> entries;
+};
+
+namespace internal
+{
+
+template<typename ModelT, bool Radial = RadialSymmetry<ModelT::ModelType>::Value>
+struct RadialKernel
+{
+    static constexpr bool Supported = true;
+    
+    static inline RadialTable<typename ModelT::Scalar> build(const ModelT& model, std::size_t samples) { return buildRadialTable(model, samples); }
+    
+    static inline typename ComplexTypes<typename ModelT::Scalar>::PointT inverse(const RadialTable<typename ModelT::Scalar>& table, const ModelT& model, 
+                                                                                 typename ModelT::Scalar x, typename ModelT::Scalar y) 
+    { 
+        return inverseRadial(table, model, x, y); 
+    }
+};
+
+template<typename ModelT>
+struct RadialKernel<ModelT, false>
+{
+    static constexpr bool Supported = false;
+    
+    static inline RadialTable<typename ModelT::Scalar> build(const ModelT&, std::size_t) { return RadialTable<typename ModelT::Scalar>(); }
+    
+    static inline typename ComplexTypes<typename ModelT::Scalar>::PointT inverse(const RadialTable<typename ModelT::Scalar>&, const ModelT& model, 
+                                                                                 typename ModelT::Scalar x, typename ModelT::Scalar y) 
+    { 
+        return model.inverse(x, y); 
+    }
+};
+
+}
+
+/**
+ * Picks, per batch size class (< 64, < 1024, more), the fastest inverse (analytic scalar,
+ * packets, radial table, ray table) and forward (scalar, packets) path for one model
+ * instance on this machine. Table paths are only considered if their error against the
+ * analytic inverse stays within tolerance (ray difference, in the units the model returns)
+ * over the valid pixels. That is the only domain tables are used on, pixels outside the image
+ * or the valid circle (where tables clamp) always take the analytic inverse.
+ * Results can be stored in and restored from a KernelProfile.
+ */
+template<typename ModelT>
+class KernelTuner
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::PointT PointT;
+    typedef typename ComplexTypes<Scalar>::PixelT PixelT;
+    static constexpr std::size_t SizeClasses = KernelProfile::SizeClasses;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit KernelTuner(const ModelT& m, Scalar tolerance = Scalar(1e-4), std::size_t radial_samples = 4096) 
+        : model(m), tol(tolerance), samples(radial_samples)
+    {
+        key = combineHash(combineHash(getParameterHash(model), getCpuSignature()), hashScalars(&tol, 1));
+        key = combineHash(key, samples);
+    }
+    
+    inline std::uint64_t getProfileKey() const { return key; }
+    
+    static inline std::size_t getSizeClass(std::size_t count) 
+    { 
+        return count < 64 ? 0 : (count < 1024 ? 1 : 2); 
+    }
+    
+    static inline std::size_t getSizeClassBatch(std::size_t size_class)
+    {
+        static const std::size_t sizes[SizeClasses] = { 16, 256, 4096 };
+        return sizes[size_class];
+    }
+    
+    /**
+     * Micro-benchmarks every candidate, each for about budget per size class.
+     */
+    void tune(std::chrono::microseconds budget = std::chrono::microseconds(2000))
+    {
+        makeSamples(getSizeClassBatch(SizeClasses - 1));
+        
+        // candidates are the analytic paths plus the tables accurate enough
+        std::vector<KernelPath> inverse_paths;
+        inverse_paths.push_back(KernelPath::Scalar);
+        inverse_paths.push_back(KernelPath::Packet);
+        if(internal::RadialKernel<ModelT>::Supported)
+        {
+            radial = internal::RadialKernel<ModelT>::build(model, samples);
+            if(getInverseError(KernelPath::RadialTable) <= tol) { inverse_paths.push_back(KernelPath::RadialTable); }
+        }
+        rays = buildRayTable(model);
+        if(getInverseError(KernelPath::RayTable) <= tol) { inverse_paths.push_back(KernelPath::RayTable); }
+        
+        for(std::size_t c = 0 ; c < SizeClasses ; ++c)
+        {
+            const std::size_t n = getSizeClassBatch(c);
+            KernelChoice& choice = choices[c];
+            
+            choice.inverse_ns = std::numeric_limits<double>::max();
+            for(std::size_t i = 0 ; i < inverse_paths.size() ; ++i)
+            {
+                const double ns = timeInverse(inverse_paths[i], n, budget);
+                if(ns < choice.inverse_ns) { choice.inverse_ns = ns; choice.inverse = inverse_paths[i]; }
+            }
+            
+            choice.forward_ns = timeForward(KernelPath::Scalar, n, budget);
+            choice.forward = KernelPath::Scalar;
+            const double packet_ns = timeForward(KernelPath::Packet, n, budget);
+            if(packet_ns < choice.forward_ns) { choice.forward_ns = packet_ns; choice.forward = KernelPath::Packet; }
+        }
+        
+        releaseUnusedTables();
+    }
+    
+    /**
+     * Takes the choices from a profile, false (nothing changed) if it has no complete entry.
+     */
+    bool load(const KernelProfile& profile)
+    {
+        KernelChoice loaded[SizeClasses];
+        for(std::size_t c = 0 ; c < SizeClasses ; ++c)
+        {
+            if(!profile.find(key, c, loaded[c])) { return false; }
+            if(loaded[c].inverse == KernelPath::RadialTable && !internal::RadialKernel<ModelT>::Supported) { return false; }
+        }
+        
+        for(std::size_t c = 0 ; c < SizeClasses ; ++c)
+        {
+            choices[c] = loaded[c];
+            if(choices[c].inverse == KernelPath::RadialTable && radial.empty()) { radial = internal::RadialKernel<ModelT>::build(model, samples); }
+            if(choices[c].inverse == KernelPath::RayTable && rays.empty()) { rays = buildRayTable(model); }
+        }
+        releaseUnusedTables();
+        return true;
+    }
+    
+    void store(KernelProfile& profile) const
+    {
+        for(std::size_t c = 0 ; c < SizeClasses ; ++c)
+        {
+            profile.set(key, c, choices[c]);
+        }
+    }
+    
+    inline const KernelChoice& getChoice(std::size_t size_class) const { return choices[size_class]; }
+    
+    inline void inverseBatch(const PixelT* pixels, std::size_t count, PointT* out) const
+    {
+        runInverse(choices[getSizeClass(count)].inverse, pixels, count, out);
+    }
+    
+    inline void forwardBatch(const PointT* points, std::size_t count, PixelT* pixels, ProjectionStatus* status) const
+    {
+        runForward(choices[getSizeClass(count)].forward, points, count, pixels, status);
+    }
+    
+    inline const ModelT& getModel() const { return model; }
+    
+private:
+    void runInverse(KernelPath path, const PixelT* pixels, std::size_t count, PointT* out) const
+    {
+        switch(path)
+        {
+            case KernelPath::Packet:
+                camera::inverseBatch(model, pixels, count, out);
+                break;
+            case KernelPath::RadialTable:
+                for(std::size_t i = 0 ; i < count ; ++i) 
+                { 
+                    out[i] = isTabulated(pixels[i]) ? internal::RadialKernel<ModelT>::inverse(radial, model, pixels[i](0), pixels[i](1)) : model.inverse(pixels[i](0), pixels[i](1)); 
+                }
+                break;
+            case KernelPath::RayTable:
+                for(std::size_t i = 0 ; i < count ; ++i) 
+                { 
+                    out[i] = isTabulated(pixels[i]) ? sampleRayTable(rays, pixels[i](0), pixels[i](1)) : model.inverse(pixels[i](0), pixels[i](1)); 
+                }
+                break;
+            default:
+                for(std::size_t i = 0 ; i < count ; ++i) { out[i] = model.inverse(pixels[i](0), pixels[i](1)); }
+                break;
+        }
+    }
+    
+    // where the tables were validated, see makeSamples (NaN is not)
+    inline bool isTabulated(const PixelT& pix) const
+    {
+        return pix(0) >= Scalar(0.0) && pix(1) >= Scalar(0.0) && pix(0) <= model.width() - Scalar(1.0) && pix(1) <= model.height() - Scalar(1.0) &&
+               model.pixelValidCircular(pix(0), pix(1));
+    }
+    
+    void runForward(KernelPath path, const PointT* points, std::size_t count, PixelT* pixels, ProjectionStatus* status) const
+    {
+        if(path == KernelPath::Packet)
+        {
+            camera::forwardBatch(model, points, count, pixels, status);
+        }
+        else
+        {
+            for(std::size_t i = 0 ; i < count ; ++i) { pixels[i] = forwardWithStatus<Scalar>(model, points[i], status + i); }
+        }
+    }
+    
+    // deterministic sub-pixel positions over the valid part of the image
+    void makeSamples(std::size_t n)
+    {
+        sample_pixels.clear();
+        sample_rays.clear();
+        std::uint32_t state = 12345u;
+        while(sample_pixels.size() < n)
+        {
+            state = state * 1664525u + 1013904223u;
+            const Scalar x = Scalar((state >> 8) & 0xFFFF) / Scalar(65536.0) * (model.width() - Scalar(1.0));
+            state = state * 1664525u + 1013904223u;
+            const Scalar y = Scalar((state >> 8) & 0xFFFF) / Scalar(65536.0) * (model.height() - Scalar(1.0));
+            
+            if(!model.pixelValidCircular(x, y)) { continue; }
+            
+            sample_pixels.push_back(PixelT(x, y));
+            sample_rays.push_back(model.inverse(x, y));
+        }
+    }
+    
+    Scalar getInverseError(KernelPath path) const
+    {
+        std::vector<PointT, Eigen::aligned_allocator<PointT>> out(sample_pixels.size());
+        runInverse(path, sample_pixels.data(), sample_pixels.size(), out.data());
+        
+        Scalar ret = Scalar(0.0);
+        for(std::size_t i = 0 ; i < out.size() ; ++i)
+        {
+            const Scalar err = (out[i] - sample_rays[i]).norm();
+            if(!(err <= ret)) { ret = err; } // NaN counts as the worst
+        }
+        return ret;
+    }
+    
+    template<typename FunctorT>
+    static double timeLoop(std::size_t n, std::chrono::microseconds budget, FunctorT fn)
+    {
+        // best of three, each for a third of the budget
+        double best = std::numeric_limits<double>::max();
+        for(int trial = 0 ; trial < 3 ; ++trial)
+        {
+            std::size_t reps = 0;
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::duration elapsed;
+            do
+            {
+                fn();
+                ++reps;
+                elapsed = std::chrono::steady_clock::now() - t0;
+            } 
+            while(elapsed < budget / 3);
+            
+            const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / double(reps * n);
+            if(ns < best) { best = ns; }
+        }
+        return best;
+    }
+    
+    double timeInverse(KernelPath path, std::size_t n, std::chrono::microseconds budget) const
+    {
+        std::vector<PointT, Eigen::aligned_allocator<PointT>> out(n);
+        return timeLoop(n, budget, [&]() { runInverse(path, sample_pixels.data(), n, out.data()); });
+    }
+    
+    double timeForward(KernelPath path, std::size_t n, std::chrono::microseconds budget) const
+    {
+        std::vector<PixelT, Eigen::aligned_allocator<PixelT>> out(n);
+        std::vector<ProjectionStatus> status(n);
+        return timeLoop(n, budget, [&]() { runForward(path, sample_rays.data(), n, out.data(), status.data()); });
+    }
+    
+    void releaseUnusedTables()
+    {
+        bool uses_radial = false, uses_rays = false;
+        for(std::size_t c = 0 ; c < SizeClasses ; ++c)
+        {
+            uses_radial |= choices[c].inverse == KernelPath::RadialTable;
+            uses_rays |= choices[c].inverse == KernelPath::RayTable;
+        }
+        if(!uses_radial) { radial = RadialTable<Scalar>(); }
+        if(!uses_rays) { rays = RayTable<Scalar>(); }
+        
+        sample_pixels.clear();
+        sample_rays.clear();
+    }
+    
+    ModelT model;
+    Scalar tol;
+    std::size_t samples;
+    std::uint64_t key;
+    KernelChoice choices[SizeClasses];
+    
+    RadialTable<Scalar> radial;
+    RayTable<Scalar> rays;
+    
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> sample_pixels;
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> sample_rays;
+};
+
+}
+
+#endif // CAMERA_KERNEL_TUNER_HPP
@@ -0,0 +1,288 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Projection of timestamped (lidar) points along a pose trajectory.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_LIDAR_HPP
+#define CAMERA_LIDAR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+/**
+ * Camera to world poses (as in forward(pose, pt)) sampled at increasing times,
+ * interpolated with slerp on the rotation and linearly on the translation.
+ */
+template<typename T>
+class PoseTrajectory
+{
+public:
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    /**
+     * Appends a sample, times must be strictly increasing.
+     */
+    inline bool add(double t, const TransformT& pose)
+    {
+        if(!times.empty() && !(t > times.back()))
+        {
+            return false;
+        }
+        
+        times.push_back(t);
+        poses.push_back(pose);
+        return true;
+    }
+    
+    inline void clear() { times.clear(); poses.clear(); }
+    inline std::size_t size() const { return times.size(); }
+    inline bool empty() const { return times.empty(); }
+    inline double getStartTime() const { return times.front(); }
+    inline double getEndTime() const { return times.back(); }
+    inline double getTime(std::size_t i) const { return times[i]; }
+    inline const TransformT& getPose(std::size_t i) const { return poses[i]; }
+    
+    /**
+     * Pose at time t, false outside of the sampled interval. A single sample is valid at its time only.
+     */
+    inline bool interpolate(double t, TransformT& out) const
+    {
+        std::size_t hint = 0;
+        return interpolate(t, out, hint);
+    }
+    
+    /**
+     * As above, the search starts at segment hint which is updated, so that queries
+     * at increasing times are amortized constant.
+     */
+    inline bool interpolate(double t, TransformT& out, std::size_t& hint) const
+    {
+        if(times.empty() || !(t >= times.front() && t <= times.back()))
+        {
+            return false;
+        }
+        
+        if(times.size() == 1)
+        {
+            out = poses.front();
+            return true;
+        }
+        
+        std::size_t seg = std::min(hint, times.size() - 2);
+        if(t < times[seg])
+        {
+            seg = std::size_t(std::upper_bound(times.begin(), times.end(), t) - times.begin());
+            seg = seg > 0 ? seg - 1 : 0;
+        }
+        while(seg + 2 < times.size() && t > times[seg + 1])
+        {
+            ++seg;
+        }
+        hint = seg;
+        
+        const T alpha = T((t - times[seg]) / (times[seg + 1] - times[seg]));
+        const TransformT& p0 = poses[seg];
+        const TransformT& p1 = poses[seg + 1];
+        
+        out = TransformT(typename ComplexTypes<T>::RotationT(p0.unit_quaternion().slerp(alpha, p1.unit_quaternion())),
+                         (T(1.0) - alpha) * p0.translation() + alpha * p1.translation());
+        return true;
+    }
+    
+private:
+    std::vector<double> times;
+    std::vector<TransformT, Eigen::aligned_allocator<TransformT>> poses;
+};
+
+/**
+ * Projects points each seen from the pose at its own timestamp, e.g. a spinning lidar
+ * sweep taken by a moving platform. Points are visited in time order (the input order if
+ * already sorted), the pose is interpolated and inverted once per group of points within
+ * time_resolution (0: once per distinct timestamp, exact), groups end at the ends of the
+ * trajectory, and the points are projected in packets regardless of group boundaries. Outputs are in input order.
+ * Keeps its scratch buffers between calls, use one per thread.
+ */
+template<typename ModelT>
+class LidarProjector
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit LidarProjector(const ModelT& m, double time_resolution = 0.0) : model(m), resolution(time_resolution) { }
+    
+    inline const ModelT& getModel() const { return model; }
+    inline double getTimeResolution() const { return resolution; }
+    inline void setTimeResolution(double r) { resolution = r; }
+    
+    /**
+     * Projects points (taken at timestamps) into pixels with statuses, points outside of the
+     * trajectory get NoPose and NaN pixels. Returns the number of poses interpolated.
+     */
+    template<typename InT, typename OutT>
+    std::size_t project(const PoseTrajectory<Scalar>& trajectory, const StridedView<InT,3>& points, const double* timestamps,
+                        const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+    {
+        assert(pixels.size() >= points.size());
+        const std::size_t count = points.size();
+        
+        sortByTime(timestamps, count);
+        
+        std::size_t interpolated = 0, hint = 0, filled = 0;
+        typename ComplexTypes<PacketT>::PointT lanes;
+        std::size_t lane_index[Lanes];
+        
+        std::size_t k = 0;
+        while(k < count)
+        {
+            // group of points sharing a pose, not crossing the ends of the trajectory
+            const double t0 = timestamps[at(k)];
+            const bool inside = isCovered(trajectory, t0);
+            std::size_t end = k + 1;
+            while(end < count && (timestamps[at(end)] == t0 || timestamps[at(end)] - t0 < resolution) && isCovered(trajectory, timestamps[at(end)]) == inside)
+            {
+                ++end;
+            }
+            
+            typename ComplexTypes<Scalar>::TransformT pose;
+            if(!inside || !trajectory.interpolate(t0 + 0.5 * (timestamps[at(end - 1)] - t0), pose, hint))
+            {
+                for( ; k < end ; ++k)
+                {
+                    writeNoPose(at(k), pixels, status);
+                }
+                continue;
+            }
+            ++interpolated;
+            
+            const typename ComplexTypes<Scalar>::TransformT world_to_camera = pose.inverse();
+            const Eigen::Matrix<Scalar,3,3> rot = world_to_camera.rotationMatrix();
+            const typename ComplexTypes<Scalar>::PointT trans = world_to_camera.translation();
+            
+            for( ; k < end ; ++k)
+            {
+                const std::size_t i = at(k);
+                const typename ComplexTypes<Scalar>::PointT pc = rot * typename ComplexTypes<Scalar>::PointT(Scalar(points(i, 0)), Scalar(points(i, 1)), Scalar(points(i, 2))) + trans;
+                lanes(0)[filled] = pc(0);
+                lanes(1)[filled] = pc(1);
+                lanes(2)[filled] = pc(2);
+                lane_index[filled] = i;
+                
+                if(++filled == Lanes)
+                {
+                    flush(lanes, lane_index, pixels, status);
+                    filled = 0;
+                }
+            }
+        }
+        
+        for(std::size_t l = 0 ; l < filled ; ++l)
+        {
+            const typename ComplexTypes<Scalar>::PointT pc(lanes(0)[l], lanes(1)[l], lanes(2)[l]);
+            const typename ComplexTypes<Scalar>::PixelT pix = forwardWithStatus<Scalar>(model, pc, status + lane_index[l]);
+            pixels(lane_index[l], 0) = OutT(pix(0));
+            pixels(lane_index[l], 1) = OutT(pix(1));
+        }
+        
+        return interpolated;
+    }
+    
+private:
+    inline std::size_t at(std::size_t k) const { return order.empty() ? k : order[k]; }
+    
+    static inline bool isCovered(const PoseTrajectory<Scalar>& trajectory, double t)
+    {
+        return !trajectory.empty() && t >= trajectory.getStartTime() && t <= trajectory.getEndTime();
+    }
+    
+    // leaves order empty when the input is already sorted
+    inline void sortByTime(const double* timestamps, std::size_t count)
+    {
+        order.clear();
+        if(std::is_sorted(timestamps, timestamps + count))
+        {
+            return;
+        }
+        
+        order.resize(count);
+        for(std::size_t i = 0 ; i < count ; ++i) { order[i] = i; }
+        std::stable_sort(order.begin(), order.end(), [timestamps](std::size_t a, std::size_t b) { return timestamps[a] < timestamps[b]; });
+    }
+    
+    template<typename OutT>
+    inline void flush(const typename ComplexTypes<PacketT>::PointT& lanes, const std::size_t* lane_index, const StridedView<OutT,2>& pixels, ProjectionStatus* status) const
+    {
+        ProjectionStatus lane_status[Lanes];
+        const typename ComplexTypes<PacketT>::PixelT pix = forwardWithStatus<PacketT>(model, lanes, lane_status);
+        
+        for(std::size_t l = 0 ; l < Lanes ; ++l)
+        {
+            pixels(lane_index[l], 0) = OutT(pix(0)[l]);
+            pixels(lane_index[l], 1) = OutT(pix(1)[l]);
+            status[lane_index[l]] = lane_status[l];
+        }
+    }
+    
+    template<typename OutT>
+    static inline void writeNoPose(std::size_t i, const StridedView<OutT,2>& pixels, ProjectionStatus* status)
+    {
+        pixels(i, 0) = std::numeric_limits<OutT>::quiet_NaN();
+        pixels(i, 1) = std::numeric_limits<OutT>::quiet_NaN();
+        status[i] = ProjectionStatus::NoPose;
+    }
+    
+    ModelT model;
+    double resolution;
+    std::vector<std::size_t> order;
+};
+
+}
+
+#endif // CAMERA_LIDAR_HPP
@@ -0,0 +1,144 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Stable hashing of camera model parameters.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_MODEL_HASH_HPP
+#define CAMERA_MODEL_HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include <CameraModelHelpers.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+// 64-bit FNV-1a, fed byte by byte so the result does not depend on host endianness.
+static constexpr std::uint64_t HashOffsetBasis = 14695981039346656037ULL;
+static constexpr std::uint64_t HashPrime = 1099511628211ULL;
+
+// Bump when the hashed layout changes, so stale persisted tables are not reused.
+static constexpr std::uint32_t HashFormatVersion = 1;
+
+inline std::uint64_t hashAppendWord(std::uint64_t h, std::uint64_t word, std::size_t bytes)
+{
+    for(std::size_t i = 0 ; i < bytes ; ++i)
+    {
+        h ^= (word >> (8 * i)) & 0xFFu;
+        h *= HashPrime;
+    }
+
+    return h;
+}
+
+template<typename T>
+struct ScalarHashTraits;
+
+template<> struct ScalarHashTraits<float>
+{
+    static constexpr std::uint32_t Tag = 1;
+
+    static inline std::uint64_t append(std::uint64_t h, float v)
+    {
+        // one representation for zero and NaN
+        if(v == 0.0f) { v = 0.0f; }
+        std::uint32_t bits = 0x7FC00000u;
+        if(!std::isnan(v)) { std::memcpy(&bits, &v, sizeof(bits)); }
+        return hashAppendWord(h, bits, sizeof(bits));
+    }
+};
+
+template<> struct ScalarHashTraits<double>
+{
+    static constexpr std::uint32_t Tag = 2;
+
+    static inline std::uint64_t append(std::uint64_t h, double v)
+    {
+        if(v == 0.0) { v = 0.0; }
+        std::uint64_t bits = 0x7FF8000000000000ULL;
+        if(!std::isnan(v)) { std::memcpy(&bits, &v, sizeof(bits)); }
+        return hashAppendWord(h, bits, sizeof(bits));
+    }
+};
+}
+
+/**
+ * Mixes two hashes, e.g. to key a table depending on more than one model.
+ */
+inline std::uint64_t combineHash(std::uint64_t seed, std::uint64_t value)
+{
+    return internal::hashAppendWord(seed, value, sizeof(value));
+}
+
+/**
+ * Hashes the scalars of an arbitrary buffer (e.g. a rotation) with the same rules as the model parameters.
+ */
+template<typename T>
+inline std::uint64_t hashScalars(const T* data, std::size_t count, std::uint64_t seed = internal::HashOffsetBasis)
+{
+    std::uint64_t h = seed;
+    for(std::size_t i = 0 ; i < count ; ++i)
+    {
+        h = internal::ScalarHashTraits<T>::append(h, data[i]);
+    }
+    return h;
+}
+
+/**
+ * Hash of the model type, scalar type and parameter vector. Stable across runs and hosts,
+ * changes whenever any of the parameters (calibration or viewport) changes.
+ */
+template<typename ModelT>
+inline std::uint64_t getParameterHash(const ModelT& model)
+{
+    typedef typename ModelT::Scalar Scalar;
+    static_assert(std::is_same<Scalar,float>::value || std::is_same<Scalar,double>::value, "Only float and double models can be hashed");
+
+    std::uint64_t h = internal::HashOffsetBasis;
+    h = internal::hashAppendWord(h, internal::HashFormatVersion, sizeof(std::uint32_t));
+    h = internal::hashAppendWord(h, static_cast<std::uint32_t>(ModelT::ModelType), sizeof(std::uint32_t));
+    h = internal::hashAppendWord(h, internal::ScalarHashTraits<Scalar>::Tag, sizeof(std::uint32_t));
+    h = internal::hashAppendWord(h, ModelT::NumParameters, sizeof(std::uint32_t));
+
+    return hashScalars(model.data(), ModelT::NumParameters, h);
+}
+
+}
+
+#endif // CAMERA_MODEL_HASH_HPP
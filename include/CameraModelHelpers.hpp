@@ -36,6 +36,9 @@
 #ifndef CAMERA_MODEL_HELPERS_HPP
 #define CAMERA_MODEL_HELPERS_HPP
 
+#include <cstdint>
+#include <cstddef>
+
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
@@ -86,6 +89,34 @@ enum class CameraModelType
 template<CameraModelType cmt>
 struct CameraModelToTypeAndName;
 
+// defined in CameraBatch.hpp
+enum class ProjectionStatus : std::uint8_t;
+
+namespace internal
+{
+template<typename ModelT> struct PolymorphicBatch;
+}
+
+/**
+ * Result of comparing two T, bool for plain scalars. Packet types (see CameraPacket.hpp)
+ * specialise it with a per lane mask.
+ */
+template<typename T>
+struct ScalarMask
+{
+    typedef bool Type;
+};
+
+/**
+ * a where mask is set, b otherwise. Model functions use it instead of branching
+ * on values, so that they work for packet types as well.
+ */
+template<typename T>
+EIGEN_DEVICE_FUNC static inline T select(bool mask, const T& a, const T& b)
+{
+    return mask ? a : b;
+}
+
 /**
  * Collection of common 2D/3D types.
  */
@@ -167,6 +198,7 @@ public:
     virtual bool pixelValidSquare(const typename ComplexTypes<T>::PixelT& pt) const = 0;
     virtual bool pixelValidCircular(T x, T y) const = 0;
     virtual bool pixelValidCircular(const typename ComplexTypes<T>::PixelT& pt) const = 0;
+    virtual bool pointValid(const typename ComplexTypes<T>::PointT& pt) const = 0;
     virtual typename ComplexTypes<T>::PixelT forward(const typename ComplexTypes<T>::PointT& tmp_pt) const = 0;
     virtual typename ComplexTypes<T>::PointT inverse(T x, T y) const = 0;
     virtual typename ComplexTypes<T>::PixelT forward(const typename ComplexTypes<T>::TransformT& pose, 
@@ -185,6 +217,10 @@ public:
                                                              const typename ComplexTypes<T>::TransformT& pose2) const = 0;
     virtual typename ComplexTypes<T>::PixelT twoFrameProject(const typename ComplexTypes<T>::TransformT& pose1, 
                                                              T x, T y, T dist, const typename ComplexTypes<T>::TransformT& pose2) const = 0;
+    virtual void forwardBatch(const typename ComplexTypes<T>::PointT* points, std::size_t count, 
+                              typename ComplexTypes<T>::PixelT* pixels, ProjectionStatus* status) const = 0;
+    virtual void inverseBatch(const typename ComplexTypes<T>::PixelT* pixels, std::size_t count, 
+                              typename ComplexTypes<T>::PointT* rays) const = 0;
 };
 
 /**
@@ -222,19 +258,19 @@ public:
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValid(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValid(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
     {
         return Derived::template pixelValidSquare<T>(ccd, pt(0), pt(1));
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
     {
         return Derived::template pixelValidCircular<T>(ccd, pt(0), pt(1));
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(const Derived& ccd, const typename ComplexTypes<T>::PixelT& pt)
     {
         return Derived::template pixelValidSquare<T>(ccd, pt(0), pt(1));
     }
@@ -330,34 +366,41 @@ public:
     }
     
     template<typename T = Scalar>
-    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValid(T x, T y) const
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValid(T x, T y) const
     {
         return Derived::template pixelValidSquare<T>(*static_cast<const Derived*>(this), x, y);
     }
     
     template<typename T = Scalar>
-    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(T x, T y) const
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(T x, T y) const
     {
         return Derived::template pixelValidSquare<T>(*static_cast<const Derived*>(this), x, y);
     }
     
     template<typename T = Scalar>
-    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(const typename ComplexTypes<T>::PixelT& pt) const
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(const typename ComplexTypes<T>::PixelT& pt) const
     {
         return Derived::template pixelValidSquare<T>(*static_cast<const Derived*>(this), pt(0), pt(1));
     }
     
     template<typename T = Scalar>
-    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(T x, T y) const
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(T x, T y) const
     {
         return Derived::template pixelValidCircular<T>(*static_cast<const Derived*>(this), x, y);
     }
     
     template<typename T = Scalar>
-    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(const typename ComplexTypes<T>::PixelT& pt) const
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(const typename ComplexTypes<T>::PixelT& pt) const
     {
         return Derived::template pixelValidCircular<T>(*static_cast<const Derived*>(this), pt(0), pt(1));
     }
+    
+    // chirality, point in front of the camera (has a valid projection)
+    template<typename T = Scalar>
+    EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pointValid(const typename ComplexTypes<T>::PointT& pt) const
+    {
+        return Derived::template pointValid<T>(*static_cast<const Derived*>(this), pt);
+    }
         
     template<typename T = Scalar>
     EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ComplexTypes<T>::PixelT forward(const typename ComplexTypes<T>::PointT& tmp_pt) const
@@ -431,6 +474,7 @@ public:
 
 /**
  * Wraps templated typed camera model into a polymorphic class.
+ * The batch functions need CameraBatch.hpp (CameraModels.hpp includes it after the models).
  */
 template <typename ModelT>
 class CameraFromCRTP : public ModelT, public CameraInterface<typename ModelT::Scalar>
@@ -480,6 +524,11 @@ public:
         return Derived::template pixelValidCircular<Scalar>(pt); 
     }
     
+    virtual bool pointValid(const typename ComplexTypes<Scalar>::PointT& pt) const 
+    { 
+        return Derived::template pointValid<Scalar>(pt); 
+    }
+    
     virtual typename ComplexTypes<Scalar>::PixelT forward(const typename ComplexTypes<Scalar>::PointT& tmp_pt) const 
     { 
         return Derived::template forward<Scalar>(tmp_pt); 
@@ -545,6 +594,18 @@ public:
     { 
         return Derived::template twoFrameProject<Scalar>(pose1,x,y,dist,pose2); 
     }
+    
+    virtual void forwardBatch(const typename ComplexTypes<Scalar>::PointT* points, std::size_t count, 
+                              typename ComplexTypes<Scalar>::PixelT* pixels, ProjectionStatus* status) const 
+    { 
+        internal::PolymorphicBatch<Derived>::forward(*this, points, count, pixels, status); 
+    }
+    
+    virtual void inverseBatch(const typename ComplexTypes<Scalar>::PixelT* pixels, std::size_t count, 
+                              typename ComplexTypes<Scalar>::PointT* rays) const 
+    { 
+        internal::PolymorphicBatch<Derived>::inverse(*this, pixels, count, rays); 
+    }
 };
 
 }
@@ -92,6 +92,11 @@
  */
 #include <PinholeDisparityBrownConrady.hpp> 
 
+/**
+ * Packet batch functions, also behind CameraFromCRTP.
+ */
+#include <CameraBatch.hpp>
+
 namespace camera
 {
 
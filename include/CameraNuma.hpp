@@ -0,0 +1,382 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * NUMA aware placement of derived tables and binding of batch workers.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_NUMA_HPP
+#define CAMERA_NUMA_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#define CAMERA_MODELS_HAVE_NUMA
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif // __linux__
+
+#include <CameraTables.hpp>
+#include <CameraThreads.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+// "0-3,8,10-11" as used by sysfs
+inline std::vector<int> parseCpuList(const std::string& list)
+{
+    std::vector<int> ret;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ','))
+    {
+        int first = 0, last = 0;
+        const int n = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if(n < 1) { continue; }
+        if(n == 1) { last = first; }
+        for(int i = first ; i <= last ; ++i) { ret.push_back(i); }
+    }
+    return ret;
+}
+
+inline std::string readFirstLine(const std::string& path)
+{
+    std::ifstream ifs(path.c_str());
+    std::string ret;
+    std::getline(ifs, ret);
+    return ret;
+}
+
+#ifdef CAMERA_MODELS_HAVE_NUMA
+// from linux/mempolicy.h, no libnuma needed
+static constexpr int MemoryPolicyBind = 2;
+static constexpr std::size_t MaxNumaNodes = 1024;
+#endif // CAMERA_MODELS_HAVE_NUMA
+
+}
+
+/**
+ * Number of NUMA nodes, 1 where unknown.
+ */
+inline int getNumaNodeCount()
+{
+#ifdef CAMERA_MODELS_HAVE_NUMA
+    const std::vector<int> nodes = internal::parseCpuList(internal::readFirstLine("/sys/devices/system/node/online"));
+    if(!nodes.empty())
+    {
+        return *std::max_element(nodes.begin(), nodes.end()) + 1;
+    }
+#endif // CAMERA_MODELS_HAVE_NUMA
+    return 1;
+}
+
+/**
+ * CPUs of a node, all CPUs where unknown.
+ */
+inline std::vector<int> getNumaNodeCpus(int node)
+{
+#ifdef CAMERA_MODELS_HAVE_NUMA
+    const std::vector<int> cpus = internal::parseCpuList(internal::readFirstLine("/sys/devices/system/node/node" + std::to_string((long long)node) + "/cpulist"));
+    if(!cpus.empty())
+    {
+        return cpus;
+    }
+#endif // CAMERA_MODELS_HAVE_NUMA
+    std::vector<int> ret(std::max(1u, std::thread::hardware_concurrency()));
+    for(std::size_t i = 0 ; i < ret.size() ; ++i) { ret[i] = (int)i; }
+    return ret;
+}
+
+/**
+ * Node the calling thread currently runs on.
+ */
+inline int getCurrentNumaNode()
+{
+#if defined(CAMERA_MODELS_HAVE_NUMA) && defined(SYS_getcpu)
+    unsigned int cpu = 0, node = 0;
+    if(::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    {
+        return (int)node;
+    }
+#endif // CAMERA_MODELS_HAVE_NUMA && SYS_getcpu
+    return 0;
+}
+
+/**
+ * Restricts a thread to the CPUs of a node, false if not supported or failed.
+ */
+inline bool bindThreadToNumaNode(std::thread& th, int node)
+{
+#ifdef CAMERA_MODELS_HAVE_NUMA
+    return internal::setCpuAffinity(th.native_handle(), getNumaNodeCpus(node));
+#else // CAMERA_MODELS_HAVE_NUMA
+    (void)th; (void)node;
+    return false;
+#endif // CAMERA_MODELS_HAVE_NUMA
+}
+
+inline bool bindCurrentThreadToNumaNode(int node)
+{
+#ifdef CAMERA_MODELS_HAVE_NUMA
+    return internal::setCpuAffinity(pthread_self(), getNumaNodeCpus(node));
+#else // CAMERA_MODELS_HAVE_NUMA
+    (void)node;
+    return false;
+#endif // CAMERA_MODELS_HAVE_NUMA
+}
+
+/**
+ * Zeroed memory for count objects placed on a node. With node < 0 the pages are
+ * first-touched by the calling thread, so they land on its node. Huge pages
+ * (transparent, best effort) cut TLB misses on large tables. Placement is a hint,
+ * if the kernel refuses it the memory is still usable.
+ */
+template<typename T>
+inline std::shared_ptr<T> allocateOnNumaNode(std::size_t count, int node = -1, bool huge_pages = false)
+{
+#ifdef CAMERA_MODELS_HAVE_NUMA
+    const std::size_t page = huge_pages ? (std::size_t(2) << 20) : (std::size_t)::sysconf(_SC_PAGESIZE);
+    const std::size_t bytes = std::max<std::size_t>(((count * sizeof(T) + page - 1) / page) * page, page);
+    
+    void* mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED)
+    {
+        return std::shared_ptr<T>();
+    }
+    
+#ifdef MADV_HUGEPAGE
+    if(huge_pages)
+    {
+        ::madvise(mem, bytes, MADV_HUGEPAGE);
+    }
+#endif // MADV_HUGEPAGE
+    
+#ifdef SYS_mbind
+    if(node >= 0 && (std::size_t)node < internal::MaxNumaNodes)
+    {
+        unsigned long mask[internal::MaxNumaNodes / (8 * sizeof(unsigned long))] = { 0 };
+        mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        ::syscall(SYS_mbind, mem, bytes, internal::MemoryPolicyBind, mask, internal::MaxNumaNodes, 0);
+    }
+#endif // SYS_mbind
+    
+    // fault the pages in now, under the policy / on the calling thread's node
+    std::memset(mem, 0, bytes);
+    
+    return std::shared_ptr<T>(static_cast<T*>(mem), [bytes](T* p) { ::munmap(p, bytes); });
+#else // CAMERA_MODELS_HAVE_NUMA
+    (void)node; (void)huge_pages;
+    T* ptr = static_cast<T*>(Eigen::internal::aligned_malloc(count * sizeof(T)));
+    std::memset(ptr, 0, count * sizeof(T));
+    return std::shared_ptr<T>(ptr, [](T* p) { Eigen::internal::aligned_free(p); });
+#endif // CAMERA_MODELS_HAVE_NUMA
+}
+
+/**
+ * Copy of a table with its memory placed on a node, see allocateOnNumaNode.
+ */
+template<typename TableT>
+inline TableT copyTableToNumaNode(const TableT& table, int node = -1, bool huge_pages = false)
+{
+    typedef typename TableT::Scalar Scalar;
+    
+    std::shared_ptr<Scalar> mem = allocateOnNumaNode<Scalar>(table.scalars(), node, huge_pages);
+    if(!mem)
+    {
+        return table;
+    }
+    
+    std::memcpy(mem.get(), table.data(), table.bytes());
+    return TableT(table.width(), table.height(), mem);
+}
+
+/**
+ * One copy of a table per node, readers use the copy of the node they run on.
+ * On a single node machine the original table is used as is.
+ */
+template<typename TableT>
+class NumaReplicatedTable
+{
+public:
+    explicit NumaReplicatedTable(const TableT& table, bool huge_pages = false)
+    {
+        const int nodes = getNumaNodeCount();
+        if(nodes == 1 && !huge_pages)
+        {
+            replicas.push_back(table);
+            return;
+        }
+        
+        for(int n = 0 ; n < nodes ; ++n)
+        {
+            replicas.push_back(copyTableToNumaNode(table, n, huge_pages));
+        }
+    }
+    
+    inline std::size_t getReplicaCount() const { return replicas.size(); }
+    
+    inline const TableT& get(int node) const 
+    { 
+        return replicas[(std::size_t)node < replicas.size() ? node : 0]; 
+    }
+    
+    /**
+     * Replica local to the calling thread, bind the thread to a node for this to be stable.
+     */
+    inline const TableT& get() const 
+    { 
+        return get(getCurrentNumaNode()); 
+    }
+    
+private:
+    std::vector<TableT> replicas;
+};
+
+/**
+ * Persistent batch workers, bound to NUMA nodes (threads_per_node on each node, by default
+ * as many as the node has CPUs). parallelFor splits a range into chunks handed out dynamically,
+ * the functor gets the node of the worker so it can use node local data (NumaReplicatedTable::get(node)).
+ */
+class NumaWorkerPool
+{
+public:
+    typedef std::function<void(std::size_t, std::size_t, int)> RangeFunction;
+    
+    explicit NumaWorkerPool(std::size_t threads_per_node = 0) : generation(0), running(true), next(0), count(0), chunk(1), busy(0)
+    {
+        const int nodes = getNumaNodeCount();
+        for(int n = 0 ; n < nodes ; ++n)
+        {
+            const std::vector<int> cpus = getNumaNodeCpus(n);
+            const std::size_t threads = threads_per_node > 0 ? threads_per_node : cpus.size();
+            for(std::size_t t = 0 ; t < threads ; ++t)
+            {
+                workers.push_back(std::thread(&NumaWorkerPool::run, this, n));
+                bindThreadToNumaNode(workers.back(), n);
+            }
+        }
+    }
+    
+    ~NumaWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        start.notify_all();
+        for(std::size_t i = 0 ; i < workers.size() ; ++i) { workers[i].join(); }
+    }
+    
+    NumaWorkerPool(const NumaWorkerPool&) = delete;
+    NumaWorkerPool& operator=(const NumaWorkerPool&) = delete;
+    
+    inline std::size_t getThreadCount() const { return workers.size(); }
+    
+    /**
+     * Runs fn(begin, end, node) over [0, n) and waits for it. One call at a time.
+     */
+    void parallelFor(std::size_t n, const RangeFunction& fn, std::size_t chunk_size = 0)
+    {
+        if(n == 0) { return; }
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        job = fn;
+        count = n;
+        chunk = chunk_size > 0 ? chunk_size : std::max<std::size_t>(1, n / (workers.size() * 8));
+        next.store(0);
+        busy = workers.size();
+        generation++;
+        start.notify_all();
+        
+        done.wait(lock, [&]() { return busy == 0; });
+        job = RangeFunction();
+    }
+    
+private:
+    void run(int node)
+    {
+        std::size_t seen = 0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [&]() { return !running || generation != seen; });
+                if(!running) { return; }
+                seen = generation;
+            }
+            
+            while(true)
+            {
+                const std::size_t begin = next.fetch_add(chunk);
+                if(begin >= count) { break; }
+                job(begin, std::min(begin + chunk, count), node);
+            }
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--busy == 0) { done.notify_one(); }
+        }
+    }
+    
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start, done;
+    std::size_t generation;
+    bool running;
+    
+    RangeFunction job;
+    std::atomic<std::size_t> next;
+    std::size_t count;
+    std::size_t chunk;
+    std::size_t busy;
+};
+
+}
+
+#endif // CAMERA_NUMA_HPP
@@ -0,0 +1,304 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Fixed width packet scalar, for running the camera models on several points at once.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_PACKET_HPP
+#define CAMERA_PACKET_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+#include <CameraModelHelpers.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+// mask lanes as wide as the scalar, so that select compiles to a blend
+template<typename T> struct PacketMaskLane;
+template<> struct PacketMaskLane<float> { typedef std::int32_t Type; };
+template<> struct PacketMaskLane<double> { typedef std::int64_t Type; };
+}
+
+/**
+ * Per lane result of comparing two packets.
+ */
+template<typename T, int N>
+struct PacketMask
+{
+    typedef typename internal::PacketMaskLane<T>::Type Lane;
+    static constexpr int Size = N;
+    
+    EIGEN_DEVICE_FUNC inline PacketMask() { }
+    
+    EIGEN_DEVICE_FUNC inline explicit PacketMask(bool b)
+    {
+        for(int i = 0 ; i < N ; ++i) { m[i] = b ? Lane(-1) : Lane(0); }
+    }
+    
+    EIGEN_DEVICE_FUNC inline bool operator[](int i) const { return m[i] != Lane(0); }
+    
+    EIGEN_DEVICE_FUNC inline bool all() const
+    {
+        Lane r = Lane(-1);
+        for(int i = 0 ; i < N ; ++i) { r &= m[i]; }
+        return r != Lane(0);
+    }
+    
+    EIGEN_DEVICE_FUNC inline bool any() const
+    {
+        Lane r = Lane(0);
+        for(int i = 0 ; i < N ; ++i) { r |= m[i]; }
+        return r != Lane(0);
+    }
+    
+    EIGEN_DEVICE_FUNC friend inline PacketMask operator&&(const PacketMask& a, const PacketMask& b)
+    {
+        PacketMask r;
+        for(int i = 0 ; i < N ; ++i) { r.m[i] = a.m[i] & b.m[i]; }
+        return r;
+    }
+    
+    EIGEN_DEVICE_FUNC friend inline PacketMask operator||(const PacketMask& a, const PacketMask& b)
+    {
+        PacketMask r;
+        for(int i = 0 ; i < N ; ++i) { r.m[i] = a.m[i] | b.m[i]; }
+        return r;
+    }
+    
+    EIGEN_DEVICE_FUNC friend inline PacketMask operator!(const PacketMask& a)
+    {
+        PacketMask r;
+        for(int i = 0 ; i < N ; ++i) { r.m[i] = ~a.m[i]; }
+        return r;
+    }
+    
+    Lane m[N];
+};
+
+#define CAMERA_PACKET_BINARY_OPERATOR(OP) \
+    EIGEN_DEVICE_FUNC friend inline Packet operator OP(const Packet& a, const Packet& b) \
+    { \
+        Packet r; \
+        for(int i = 0 ; i < N ; ++i) { r.v[i] = a.v[i] OP b.v[i]; } \
+        return r; \
+    } \
+    EIGEN_DEVICE_FUNC inline Packet& operator OP##=(const Packet& b) \
+    { \
+        for(int i = 0 ; i < N ; ++i) { v[i] = v[i] OP b.v[i]; } \
+        return *this; \
+    }
+
+#define CAMERA_PACKET_COMPARISON_OPERATOR(OP) \
+    EIGEN_DEVICE_FUNC friend inline PacketMask<T,N> operator OP(const Packet& a, const Packet& b) \
+    { \
+        PacketMask<T,N> r; \
+        typedef typename PacketMask<T,N>::Lane Lane; \
+        for(int i = 0 ; i < N ; ++i) { r.m[i] = a.v[i] OP b.v[i] ? Lane(-1) : Lane(0); } \
+        return r; \
+    }
+
+/**
+ * N lanes of T behaving like a scalar. Model functions instantiated with it process N points
+ * per call, the lane loops are written for the auto-vectorizer. Scalars convert implicitly,
+ * so mixed expressions with model parameters (x - ccd.u0()) work as they are.
+ */
+template<typename T, int N>
+struct Packet
+{
+    typedef T Scalar;
+    typedef PacketMask<T,N> Mask;
+    static constexpr int Size = N;
+    
+    // uninitialized, like built-in scalars
+    EIGEN_DEVICE_FUNC inline Packet() { }
+    
+    EIGEN_DEVICE_FUNC inline Packet(T s)
+    {
+        for(int i = 0 ; i < N ; ++i) { v[i] = s; }
+    }
+    
+    EIGEN_DEVICE_FUNC static inline Packet load(const T* src)
+    {
+        Packet r;
+        for(int i = 0 ; i < N ; ++i) { r.v[i] = src[i]; }
+        return r;
+    }
+    
+    EIGEN_DEVICE_FUNC inline void store(T* dst) const
+    {
+        for(int i = 0 ; i < N ; ++i) { dst[i] = v[i]; }
+    }
+    
+    EIGEN_DEVICE_FUNC inline T& operator[](int i) { return v[i]; }
+    EIGEN_DEVICE_FUNC inline const T& operator[](int i) const { return v[i]; }
+    
+    EIGEN_DEVICE_FUNC inline Packet operator-() const
+    {
+        Packet r;
+        for(int i = 0 ; i < N ; ++i) { r.v[i] = -v[i]; }
+        return r;
+    }
+    
+    EIGEN_DEVICE_FUNC inline Packet operator+() const { return *this; }
+    
+    CAMERA_PACKET_BINARY_OPERATOR(+)
+    CAMERA_PACKET_BINARY_OPERATOR(-)
+    CAMERA_PACKET_BINARY_OPERATOR(*)
+    CAMERA_PACKET_BINARY_OPERATOR(/)
+    
+    CAMERA_PACKET_COMPARISON_OPERATOR(<)
+    CAMERA_PACKET_COMPARISON_OPERATOR(<=)
+    CAMERA_PACKET_COMPARISON_OPERATOR(>)
+    CAMERA_PACKET_COMPARISON_OPERATOR(>=)
+    CAMERA_PACKET_COMPARISON_OPERATOR(==)
+    CAMERA_PACKET_COMPARISON_OPERATOR(!=)
+    
+    T v[N];
+};
+
+#undef CAMERA_PACKET_BINARY_OPERATOR
+#undef CAMERA_PACKET_COMPARISON_OPERATOR
+
+template<typename T, int N>
+struct ScalarMask<Packet<T,N>>
+{
+    typedef PacketMask<T,N> Type;
+};
+
+template<typename T, int N>
+EIGEN_DEVICE_FUNC static inline Packet<T,N> select(const PacketMask<T,N>& mask, const Packet<T,N>& a, const Packet<T,N>& b)
+{
+    Packet<T,N> r;
+    for(int i = 0 ; i < N ; ++i) { r.v[i] = mask.m[i] ? a.v[i] : b.v[i]; }
+    return r;
+}
+
+// lane-wise math, found by ADL from the model functions
+#define CAMERA_PACKET_UNARY_FUNCTION(FUNC) \
+    template<typename T, int N> \
+    EIGEN_DEVICE_FUNC inline Packet<T,N> FUNC(const Packet<T,N>& a) \
+    { \
+        using std::FUNC; \
+        Packet<T,N> r; \
+        for(int i = 0 ; i < N ; ++i) { r.v[i] = FUNC(a.v[i]); } \
+        return r; \
+    }
+
+#define CAMERA_PACKET_BINARY_FUNCTION(FUNC) \
+    template<typename T, int N> \
+    EIGEN_DEVICE_FUNC inline Packet<T,N> FUNC(const Packet<T,N>& a, const Packet<T,N>& b) \
+    { \
+        using std::FUNC; \
+        Packet<T,N> r; \
+        for(int i = 0 ; i < N ; ++i) { r.v[i] = FUNC(a.v[i], b.v[i]); } \
+        return r; \
+    }
+
+CAMERA_PACKET_UNARY_FUNCTION(sqrt)
+CAMERA_PACKET_UNARY_FUNCTION(abs)
+CAMERA_PACKET_UNARY_FUNCTION(floor)
+CAMERA_PACKET_UNARY_FUNCTION(ceil)
+CAMERA_PACKET_UNARY_FUNCTION(exp)
+CAMERA_PACKET_UNARY_FUNCTION(log)
+CAMERA_PACKET_UNARY_FUNCTION(sin)
+CAMERA_PACKET_UNARY_FUNCTION(cos)
+CAMERA_PACKET_UNARY_FUNCTION(tan)
+CAMERA_PACKET_UNARY_FUNCTION(asin)
+CAMERA_PACKET_UNARY_FUNCTION(acos)
+CAMERA_PACKET_UNARY_FUNCTION(atan)
+CAMERA_PACKET_BINARY_FUNCTION(atan2)
+CAMERA_PACKET_BINARY_FUNCTION(pow)
+CAMERA_PACKET_BINARY_FUNCTION(min)
+CAMERA_PACKET_BINARY_FUNCTION(max)
+
+#undef CAMERA_PACKET_UNARY_FUNCTION
+#undef CAMERA_PACKET_BINARY_FUNCTION
+
+template<typename T, int N>
+inline std::ostream& operator<<(std::ostream& os, const Packet<T,N>& p)
+{
+    os << "[";
+    for(int i = 0 ; i < N ; ++i) { os << (i > 0 ? ", " : "") << p.v[i]; }
+    os << "]";
+    return os;
+}
+
+/**
+ * 8 floats, an AVX register.
+ */
+typedef Packet<float,8> Packet8f;
+
+/**
+ * 4 doubles, an AVX register.
+ */
+typedef Packet<double,4> Packet4d;
+
+}
+
+namespace Eigen
+{
+/**
+ * Lets Eigen matrices (PointT, PixelT) hold packets.
+ */
+template<typename T, int N>
+struct NumTraits<camera::Packet<T,N>> : GenericNumTraits<T>
+{
+    typedef camera::Packet<T,N> Real;
+    typedef camera::Packet<T,N> NonInteger;
+    typedef camera::Packet<T,N> Nested;
+    typedef camera::Packet<T,N> Literal;
+    
+    enum
+    {
+        IsComplex = 0,
+        IsInteger = 0,
+        IsSigned = 1,
+        RequireInitialization = 1,
+        ReadCost = N * NumTraits<T>::ReadCost,
+        AddCost = N * NumTraits<T>::AddCost,
+        MulCost = N * NumTraits<T>::MulCost
+    };
+    
+    static inline Real epsilon() { return Real(NumTraits<T>::epsilon()); }
+    static inline Real dummy_precision() { return Real(NumTraits<T>::dummy_precision()); }
+    static inline Real highest() { return Real(NumTraits<T>::highest()); }
+    static inline Real lowest() { return Real(NumTraits<T>::lowest()); }
+};
+}
+
+#endif // CAMERA_PACKET_HPP
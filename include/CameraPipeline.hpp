@@ -0,0 +1,354 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Frame processing pipeline of stages connected by bounded SPSC queues.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_PIPELINE_HPP
+#define CAMERA_PIPELINE_HPP
+
+#include <cstddef>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <CameraThreads.hpp>
+
+namespace camera
+{
+
+/**
+ * Pins a thread to a CPU, false if not supported or failed.
+ */
+inline bool setThreadAffinity(std::thread& th, int cpu)
+{
+    return internal::setCpuAffinity(th.native_handle(), std::vector<int>(1, cpu));
+}
+
+namespace internal
+{
+
+// spins briefly, then yields, then sleeps
+class Backoff
+{
+public:
+    Backoff() : count(0) { }
+    
+    inline void wait()
+    {
+        if(count < 64) { }
+        else if(count < 128) { std::this_thread::yield(); }
+        else { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+        ++count;
+    }
+    
+    inline std::size_t getCount() const { return count; }
+    
+private:
+    std::size_t count;
+};
+
+}
+
+/**
+ * Bounded single-producer single-consumer ring. push blocks while full (backpressure),
+ * pop blocks while empty. After close() push fails and pop drains what is left.
+ */
+template<typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(std::size_t min_capacity) : head(0), tail(0), closed(false)
+    {
+        std::size_t cap = 1;
+        while(cap < min_capacity) { cap <<= 1; }
+        items.resize(cap);
+        mask = cap - 1;
+    }
+    
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+    
+    inline std::size_t capacity() const { return mask + 1; }
+    
+    // producer
+    inline bool tryPush(T& v)
+    {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) > mask)
+        {
+            return false;
+        }
+        items[t & mask] = std::move(v);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // producer, true if it had to wait
+    inline bool push(T&& v, bool* stalled = nullptr)
+    {
+        internal::Backoff backoff;
+        while(true)
+        {
+            if(closed.load(std::memory_order_acquire)) { return false; }
+            if(tryPush(v)) { break; }
+            backoff.wait();
+        }
+        if(stalled != nullptr) { *stalled = backoff.getCount() > 0; }
+        return true;
+    }
+    
+    // consumer
+    inline bool tryPop(T& v)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        v = std::move(items[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // consumer, false once closed and drained
+    inline bool pop(T& v)
+    {
+        internal::Backoff backoff;
+        while(!tryPop(v))
+        {
+            if(closed.load(std::memory_order_acquire)) 
+            {
+                // a push may have landed before the close
+                return tryPop(v);
+            }
+            backoff.wait();
+        }
+        return true;
+    }
+    
+    inline void close() { closed.store(true, std::memory_order_release); }
+    inline bool isClosed() const { return closed.load(std::memory_order_acquire); }
+    
+private:
+    // padded, producer and consumer do not share cache lines (alignas is not honoured by new in C++11)
+    std::atomic<std::size_t> head;
+    char head_padding[64 - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> tail;
+    char tail_padding[64 - sizeof(std::atomic<std::size_t>)];
+    std::atomic<bool> closed;
+    std::size_t mask;
+    std::vector<T> items;
+};
+
+/**
+ * Counters of a pipeline stage.
+ */
+struct PipelineStageStatistics
+{
+    PipelineStageStatistics() : frames(0), stalls(0), busy_seconds(0.0) { }
+    
+    std::string name;
+    std::size_t frames;
+    std::size_t stalls;     // frames that waited for the next stage (backpressure)
+    double busy_seconds;
+};
+
+/**
+ * Chain of stages, each on its own (optionally pinned) thread, connected by bounded
+ * SPSC rings, so consecutive frames are processed by different stages at the same time.
+ * Stages are functors on FrameT&, typically running the batch functions on buffers in the
+ * frame. One thread pushes frames in, one thread pops them out. FrameT must be movable,
+ * preallocated frames can be recycled by the caller to keep the loop allocation free.
+ */
+template<typename FrameT>
+class FramePipeline
+{
+public:
+    typedef std::function<void(FrameT&)> StageFunction;
+    
+    explicit FramePipeline(std::size_t queue_capacity = 4) : capacity(queue_capacity), started(false) { }
+    
+    ~FramePipeline()
+    {
+        stop();
+    }
+    
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+    
+    /**
+     * Appends a stage, before start(). cpu < 0 leaves the thread unpinned.
+     */
+    void addStage(const std::string& name, const StageFunction& fn, int cpu = -1)
+    {
+        assert(!started);
+        stages.push_back(std::unique_ptr<Stage>(new Stage(name, fn, cpu)));
+    }
+    
+    void start()
+    {
+        assert(!started && !stages.empty());
+        
+        for(std::size_t i = 0 ; i <= stages.size() ; ++i)
+        {
+            queues.push_back(std::unique_ptr<SpscRing<FrameT>>(new SpscRing<FrameT>(capacity)));
+        }
+        
+        for(std::size_t i = 0 ; i < stages.size() ; ++i)
+        {
+            Stage& s = *stages[i];
+            s.thread = std::thread(&FramePipeline::run, &s, queues[i].get(), queues[i + 1].get());
+            if(s.cpu >= 0)
+            {
+                setThreadAffinity(s.thread, s.cpu);
+            }
+        }
+        
+        started = true;
+    }
+    
+    /**
+     * Feeds a frame, blocks while the first stage is behind. False after stop().
+     */
+    inline bool push(FrameT&& frame)
+    {
+        assert(started);
+        return queues.front()->push(std::move(frame));
+    }
+    
+    /**
+     * Next processed frame, in order. False once stopped and drained.
+     */
+    inline bool pop(FrameT& frame)
+    {
+        assert(started);
+        return queues.back()->pop(frame);
+    }
+    
+    inline bool tryPop(FrameT& frame)
+    {
+        assert(started);
+        return queues.back()->tryPop(frame);
+    }
+    
+    /**
+     * No more input, frames in flight still come out through pop().
+     */
+    inline void finish()
+    {
+        if(started) { queues.front()->close(); }
+    }
+    
+    /**
+     * Stops the stages and waits for them, frames still in flight are dropped.
+     * For a clean end call finish() and pop() until it fails.
+     */
+    void stop()
+    {
+        if(!started) { return; }
+        
+        // a closed ring refuses pushes, so no stage stays blocked on a full output
+        for(std::size_t i = 0 ; i < queues.size() ; ++i)
+        {
+            queues[i]->close();
+        }
+        for(std::size_t i = 0 ; i < stages.size() ; ++i)
+        {
+            stages[i]->thread.join();
+        }
+        started = false;
+    }
+    
+    inline std::size_t getStageCount() const { return stages.size(); }
+    
+    PipelineStageStatistics getStatistics(std::size_t stage) const
+    {
+        const Stage& s = *stages[stage];
+        PipelineStageStatistics ret;
+        ret.name = s.name;
+        ret.frames = s.frames.load(std::memory_order_relaxed);
+        ret.stalls = s.stalls.load(std::memory_order_relaxed);
+        ret.busy_seconds = double(s.busy_ns.load(std::memory_order_relaxed)) * 1e-9;
+        return ret;
+    }
+    
+private:
+    struct Stage
+    {
+        Stage(const std::string& n, const StageFunction& f, int c) : name(n), fn(f), cpu(c), frames(0), stalls(0), busy_ns(0) { }
+        
+        std::string name;
+        StageFunction fn;
+        int cpu;
+        std::thread thread;
+        std::atomic<std::size_t> frames;
+        std::atomic<std::size_t> stalls;
+        std::atomic<long long> busy_ns;
+    };
+    
+    static void run(Stage* s, SpscRing<FrameT>* in, SpscRing<FrameT>* out)
+    {
+        FrameT frame;
+        while(in->pop(frame))
+        {
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            s->fn(frame);
+            s->busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+            s->frames.fetch_add(1, std::memory_order_relaxed);
+            
+            bool stalled = false;
+            if(!out->push(std::move(frame), &stalled))
+            {
+                break;
+            }
+            if(stalled) { s->stalls.fetch_add(1, std::memory_order_relaxed); }
+        }
+        
+        out->close();
+    }
+    
+    std::size_t capacity;
+    bool started;
+    std::vector<std::unique_ptr<Stage>> stages;
+    std::vector<std::unique_ptr<SpscRing<FrameT>>> queues;
+};
+
+}
+
+#endif // CAMERA_PIPELINE_HPP
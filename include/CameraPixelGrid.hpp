@@ -0,0 +1,235 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Image space grid of projected points for neighbourhood queries.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_PIXEL_GRID_HPP
+#define CAMERA_PIXEL_GRID_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+/**
+ * Projected points binned into square cells of an image, for radius queries around pixels
+ * (e.g. guided matching of map points to keypoints). Binning is a two-pass counting sort:
+ * cell counts, prefix sums, scatter of the point indices and pixels into one array ordered
+ * by cell, so there are no per-cell containers and a query reads a few contiguous ranges.
+ * Points binned keep their input index. Buffers are reused between builds.
+ */
+template<typename T>
+class PixelGrid
+{
+public:
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    static constexpr std::uint32_t InvalidIndex = 0xFFFFFFFFu;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit PixelGrid(std::size_t cell_size = 16) : cell(std::max<std::size_t>(1, cell_size)), w(0), h(0), cells_x(0), cells_y(0) { }
+    
+    inline std::size_t getCellSize() const { return cell; }
+    inline std::size_t width() const { return w; }
+    inline std::size_t height() const { return h; }
+    inline std::size_t getCellsX() const { return cells_x; }
+    inline std::size_t getCellsY() const { return cells_y; }
+    inline std::size_t size() const { return indices.size(); }
+    
+    /**
+     * Binned points of a cell are [getCellBegin, getCellEnd) in getIndex / getPixel.
+     */
+    inline std::size_t getCellBegin(std::size_t cx, std::size_t cy) const { return starts[cy * cells_x + cx]; }
+    inline std::size_t getCellEnd(std::size_t cx, std::size_t cy) const { return starts[cy * cells_x + cx + 1]; }
+    inline std::uint32_t getIndex(std::size_t i) const { return indices[i]; }
+    inline const PixelT& getPixel(std::size_t i) const { return binned[i]; }
+    
+    /**
+     * Bins pixels of an image of the size, points with a status other than Ok (status can be null)
+     * or outside the image are left out. Returns the number binned.
+     */
+    template<typename InT>
+    std::size_t build(const StridedView<InT,2>& pixels, const ProjectionStatus* status, std::size_t image_width, std::size_t image_height)
+    {
+        w = image_width;
+        h = image_height;
+        cells_x = (w + cell - 1) / cell;
+        cells_y = (h + cell - 1) / cell;
+        
+        const std::size_t count = pixels.size();
+        const std::size_t cell_count = cells_x * cells_y;
+        point_cells.resize(count);
+        starts.assign(cell_count + 1, 0);
+        
+        // first pass, counts
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            point_cells[i] = InvalidIndex;
+            if(status != nullptr && status[i] != ProjectionStatus::Ok) { continue; }
+            
+            const T x = T(pixels(i, 0)), y = T(pixels(i, 1));
+            if(!(x >= T(0.0) && y >= T(0.0) && x < T(w) && y < T(h))) { continue; } // NaN too
+            
+            const std::uint32_t c = (std::uint32_t)(((std::size_t)y / cell) * cells_x + (std::size_t)x / cell);
+            point_cells[i] = c;
+            starts[c + 1]++;
+        }
+        
+        for(std::size_t c = 0 ; c < cell_count ; ++c) { starts[c + 1] += starts[c]; }
+        
+        // second pass, scatter (stable, in input order within a cell)
+        indices.resize(starts[cell_count]);
+        binned.resize(starts[cell_count]);
+        cursor.assign(starts.begin(), starts.end() - 1);
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            if(point_cells[i] == InvalidIndex) { continue; }
+            
+            const std::uint32_t slot = cursor[point_cells[i]]++;
+            indices[slot] = (std::uint32_t)i;
+            binned[slot] = PixelT(T(pixels(i, 0)), T(pixels(i, 1)));
+        }
+        
+        return indices.size();
+    }
+    
+    /**
+     * Projects world points seen from pose (camera to world) with forwardBatch and bins them.
+     */
+    template<typename ModelT, typename InT>
+    std::size_t project(const ModelT& model, const TransformT& pose, const StridedView<InT,3>& points)
+    {
+        projected.resize(points.size());
+        status.resize(points.size());
+        forwardBatch(model, pose, points, makePixelView(projected.data(), projected.size()), status.data());
+        return build(makePixelView(static_cast<const PixelT*>(projected.data()), projected.size()), status.data(), (std::size_t)model.width(), (std::size_t)model.height());
+    }
+    
+    /**
+     * Calls fn(index, pixel, squared distance) for every binned point within radius of (x,y),
+     * cell by cell, row major.
+     */
+    template<typename FunctionT>
+    inline void forEachInRadius(T x, T y, T radius, FunctionT fn) const
+    {
+        std::size_t cx0, cy0, cx1, cy1;
+        if(!getCellRange(x, y, radius, cx0, cy0, cx1, cy1)) { return; }
+        
+        const T r2 = radius * radius;
+        for(std::size_t cy = cy0 ; cy <= cy1 ; ++cy)
+        {
+            const std::size_t end = getCellEnd(cx1, cy);
+            for(std::size_t i = getCellBegin(cx0, cy) ; i < end ; ++i) // cells of a row are contiguous
+            {
+                const T dx = binned[i](0) - x, dy = binned[i](1) - y;
+                const T d2 = dx * dx + dy * dy;
+                if(d2 <= r2) { fn(indices[i], binned[i], d2); }
+            }
+        }
+    }
+    
+    /**
+     * Indices of the points within radius, up to max_count written. Returns the number found.
+     */
+    inline std::size_t query(T x, T y, T radius, std::uint32_t* out, std::size_t max_count) const
+    {
+        std::size_t found = 0;
+        forEachInRadius(x, y, radius, [&](std::uint32_t index, const PixelT&, T)
+        {
+            if(found < max_count) { out[found] = index; }
+            found++;
+        });
+        return found;
+    }
+    
+    /**
+     * Closest point within radius, InvalidIndex if none (ties: the first binned).
+     */
+    inline std::uint32_t nearest(T x, T y, T radius) const
+    {
+        std::uint32_t ret = InvalidIndex;
+        T best = std::numeric_limits<T>::infinity();
+        forEachInRadius(x, y, radius, [&](std::uint32_t index, const PixelT&, T d2)
+        {
+            if(d2 < best) { best = d2; ret = index; }
+        });
+        return ret;
+    }
+    
+private:
+    inline bool getCellRange(T x, T y, T radius, std::size_t& cx0, std::size_t& cy0, std::size_t& cx1, std::size_t& cy1) const
+    {
+        using std::floor;
+        
+        if(cells_x == 0 || cells_y == 0) { return false; }
+        
+        // binned points have 0 <= x < w, so the range is clamped in cell space, not to the last pixel
+        if(!(x + radius >= T(0.0) && x - radius < T(w) && y + radius >= T(0.0) && y - radius < T(h))) { return false; }
+        
+        cx0 = (std::size_t)floor(std::max(x - radius, T(0.0))) / cell;
+        cy0 = (std::size_t)floor(std::max(y - radius, T(0.0))) / cell;
+        cx1 = std::min((std::size_t)floor(std::min(x + radius, T(w))) / cell, cells_x - 1);
+        cy1 = std::min((std::size_t)floor(std::min(y + radius, T(h))) / cell, cells_y - 1);
+        return true;
+    }
+    
+    std::size_t cell;
+    std::size_t w, h, cells_x, cells_y;
+    std::vector<std::uint32_t> starts;
+    std::vector<std::uint32_t> indices;
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> binned;
+    
+    // scratch
+    std::vector<std::uint32_t> point_cells;
+    std::vector<std::uint32_t> cursor;
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> projected;
+    std::vector<ProjectionStatus> status;
+};
+
+template<typename T>
+constexpr std::uint32_t PixelGrid<T>::InvalidIndex;
+
+}
+
+#endif // CAMERA_PIXEL_GRID_HPP
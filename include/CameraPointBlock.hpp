@@ -0,0 +1,285 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * AoSoA point and pixel containers for the batch functions.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_POINT_BLOCK_HPP
+#define CAMERA_POINT_BLOCK_HPP
+
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <CameraModelHelpers.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+// lanes of the batch packet of the scalar type, see BatchPacket
+template<typename T> struct BlockWidth;
+template<> struct BlockWidth<float> { static constexpr int Value = 8; };
+template<> struct BlockWidth<double> { static constexpr int Value = 4; };
+}
+
+/**
+ * W points stored component-wise, a block loads straight into Packet<T,W>.
+ */
+template<typename T, int W = internal::BlockWidth<T>::Value>
+struct PointBlock
+{
+    typedef T Scalar;
+    static constexpr int Width = W;
+    
+    T x[W];
+    T y[W];
+    T z[W];
+};
+
+/**
+ * W pixels stored component-wise.
+ */
+template<typename T, int W = internal::BlockWidth<T>::Value>
+struct PixelBlock
+{
+    typedef T Scalar;
+    static constexpr int Width = W;
+    
+    T x[W];
+    T y[W];
+};
+
+/**
+ * Points as an array of blocks (AoSoA). Keeps the streaming locality of an array of points
+ * while every block is SIMD friendly, so large clouds need no full SoA transpose.
+ * Lanes past size() in the last block hold (0,0,1).
+ */
+template<typename T, int W = internal::BlockWidth<T>::Value>
+class PointBlockArray
+{
+public:
+    typedef T Scalar;
+    typedef PointBlock<T,W> BlockT;
+    typedef typename ComplexTypes<T>::PointT PointT;
+    static constexpr int Width = W;
+    
+    PointBlockArray() : count(0) { }
+    explicit PointBlockArray(std::size_t n) : count(0) { resize(n); }
+    
+    /**
+     * From any container of 3-vectors, e.g. std::vector<Eigen::Vector3d>.
+     */
+    template<typename VectorT, typename AllocT>
+    explicit PointBlockArray(const std::vector<VectorT,AllocT>& pts) : count(0)
+    {
+        resize(pts.size());
+        for(std::size_t i = 0 ; i < pts.size() ; ++i)
+        {
+            set(i, pts[i].template cast<T>());
+        }
+    }
+    
+    /**
+     * From a 3xN matrix, one point per column.
+     */
+    template<typename Derived>
+    explicit PointBlockArray(const Eigen::MatrixBase<Derived>& pts) : count(0)
+    {
+        EIGEN_STATIC_ASSERT(Derived::RowsAtCompileTime == 3 || Derived::RowsAtCompileTime == Eigen::Dynamic, YOU_MIXED_MATRICES_OF_DIFFERENT_SIZES);
+        assert(pts.rows() == 3);
+        resize((std::size_t)pts.cols());
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            set(i, pts.col(i).template cast<T>());
+        }
+    }
+    
+    inline void resize(std::size_t n)
+    {
+        const std::size_t old_count = std::min(count, n);
+        blocks.resize((n + W - 1) / W);
+        count = n;
+        
+        // reset the lanes that became padding or are new
+        for(std::size_t i = old_count ; i < blocks.size() * W ; ++i)
+        {
+            BlockT& blk = blocks[i / W];
+            blk.x[i % W] = T(0.0);
+            blk.y[i % W] = T(0.0);
+            blk.z[i % W] = T(1.0);
+        }
+    }
+    
+    inline void clear() { blocks.clear(); count = 0; }
+    
+    inline std::size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline std::size_t getBlockCount() const { return blocks.size(); }
+    
+    /**
+     * Valid lanes of a block, W except possibly for the last one.
+     */
+    inline std::size_t getLanes(std::size_t b) const { return b + 1 < blocks.size() ? std::size_t(W) : count - b * W; }
+    
+    inline BlockT& block(std::size_t b) { return blocks[b]; }
+    inline const BlockT& block(std::size_t b) const { return blocks[b]; }
+    
+    inline PointT get(std::size_t i) const
+    {
+        const BlockT& blk = blocks[i / W];
+        return PointT(blk.x[i % W], blk.y[i % W], blk.z[i % W]);
+    }
+    
+    inline void set(std::size_t i, const PointT& pt)
+    {
+        BlockT& blk = blocks[i / W];
+        blk.x[i % W] = pt(0);
+        blk.y[i % W] = pt(1);
+        blk.z[i % W] = pt(2);
+    }
+    
+    inline Eigen::Matrix<T,3,Eigen::Dynamic> toMatrix() const
+    {
+        Eigen::Matrix<T,3,Eigen::Dynamic> ret(3, (int)count);
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            ret.col(i) = get(i);
+        }
+        return ret;
+    }
+    
+private:
+    std::vector<BlockT, Eigen::aligned_allocator<BlockT>> blocks;
+    std::size_t count;
+};
+
+/**
+ * Pixels as an array of blocks, see PointBlockArray. Padding lanes hold (0,0).
+ */
+template<typename T, int W = internal::BlockWidth<T>::Value>
+class PixelBlockArray
+{
+public:
+    typedef T Scalar;
+    typedef PixelBlock<T,W> BlockT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    static constexpr int Width = W;
+    
+    PixelBlockArray() : count(0) { }
+    explicit PixelBlockArray(std::size_t n) : count(0) { resize(n); }
+    
+    template<typename VectorT, typename AllocT>
+    explicit PixelBlockArray(const std::vector<VectorT,AllocT>& pix) : count(0)
+    {
+        resize(pix.size());
+        for(std::size_t i = 0 ; i < pix.size() ; ++i)
+        {
+            set(i, pix[i].template cast<T>());
+        }
+    }
+    
+    /**
+     * From a 2xN matrix, one pixel per column.
+     */
+    template<typename Derived>
+    explicit PixelBlockArray(const Eigen::MatrixBase<Derived>& pix) : count(0)
+    {
+        EIGEN_STATIC_ASSERT(Derived::RowsAtCompileTime == 2 || Derived::RowsAtCompileTime == Eigen::Dynamic, YOU_MIXED_MATRICES_OF_DIFFERENT_SIZES);
+        assert(pix.rows() == 2);
+        resize((std::size_t)pix.cols());
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            set(i, pix.col(i).template cast<T>());
+        }
+    }
+    
+    inline void resize(std::size_t n)
+    {
+        const std::size_t old_count = std::min(count, n);
+        blocks.resize((n + W - 1) / W);
+        count = n;
+        
+        for(std::size_t i = old_count ; i < blocks.size() * W ; ++i)
+        {
+            BlockT& blk = blocks[i / W];
+            blk.x[i % W] = T(0.0);
+            blk.y[i % W] = T(0.0);
+        }
+    }
+    
+    inline void clear() { blocks.clear(); count = 0; }
+    
+    inline std::size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline std::size_t getBlockCount() const { return blocks.size(); }
+    inline std::size_t getLanes(std::size_t b) const { return b + 1 < blocks.size() ? std::size_t(W) : count - b * W; }
+    
+    inline BlockT& block(std::size_t b) { return blocks[b]; }
+    inline const BlockT& block(std::size_t b) const { return blocks[b]; }
+    
+    inline PixelT get(std::size_t i) const
+    {
+        const BlockT& blk = blocks[i / W];
+        return PixelT(blk.x[i % W], blk.y[i % W]);
+    }
+    
+    inline void set(std::size_t i, const PixelT& pix)
+    {
+        BlockT& blk = blocks[i / W];
+        blk.x[i % W] = pix(0);
+        blk.y[i % W] = pix(1);
+    }
+    
+    inline Eigen::Matrix<T,2,Eigen::Dynamic> toMatrix() const
+    {
+        Eigen::Matrix<T,2,Eigen::Dynamic> ret(2, (int)count);
+        for(std::size_t i = 0 ; i < count ; ++i)
+        {
+            ret.col(i) = get(i);
+        }
+        return ret;
+    }
+    
+private:
+    std::vector<BlockT, Eigen::aligned_allocator<BlockT>> blocks;
+    std::size_t count;
+};
+
+}
+
+#endif // CAMERA_POINT_BLOCK_HPP
@@ -0,0 +1,170 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Views of a camera for projecting world points in batches, with a range buffer to test occlusion.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_PROJECTED_VIEW_HPP
+#define CAMERA_PROJECTED_VIEW_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+// positive floats order as their bits
+inline void atomicMinFloat(std::atomic<std::uint32_t>& slot, float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t current = slot.load(std::memory_order_relaxed);
+    while(bits < current && !slot.compare_exchange_weak(current, bits, std::memory_order_relaxed)) { }
+}
+
+/**
+ * Ranges (distance from the camera centre) per pixel, rendered concurrently keeping the nearest.
+ * The storage is kept between views and only grows.
+ */
+class RangeBuffer
+{
+public:
+    RangeBuffer() : width(0), capacity(0) { }
+    
+    void reset(std::size_t buffer_width, std::size_t buffer_height)
+    {
+        const std::size_t size = buffer_width * buffer_height;
+        if(capacity < size)
+        {
+            cells.reset(new std::atomic<std::uint32_t>[size]);
+            capacity = size;
+        }
+        width = buffer_width;
+        
+        const float infinity = std::numeric_limits<float>::infinity();
+        std::uint32_t empty;
+        std::memcpy(&empty, &infinity, sizeof(empty));
+        for(std::size_t i = 0 ; i < size ; ++i) { cells[i].store(empty, std::memory_order_relaxed); }
+    }
+    
+    inline void write(std::size_t x, std::size_t y, float range) { atomicMinFloat(cells[y * width + x], range); }
+    
+    inline float get(std::size_t x, std::size_t y) const
+    {
+        float d;
+        const std::uint32_t bits = cells[y * width + x].load(std::memory_order_relaxed);
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    
+private:
+    std::unique_ptr<std::atomic<std::uint32_t>[]> cells;
+    std::size_t width;
+    std::size_t capacity;
+};
+
+/**
+ * A camera (any model) at a pose (camera to world) projecting world points in batches,
+ * with an optional depth image (range, row stride in pixels, 0: width).
+ */
+template<typename T>
+struct ProjectedView
+{
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    typedef std::function<void(const PointView<const T>&, const PixelView<T>&, ProjectionStatus*)> ProjectionFunction;
+    
+    template<typename ModelT>
+    ProjectedView(const ModelT& model, const TransformT& pose, const float* depth_image, std::size_t row_stride)
+        : centre(pose.translation()), width((std::size_t)model.width()), height((std::size_t)model.height()),
+          stride(row_stride > 0 ? row_stride : width), depth(depth_image)
+    {
+        typedef decltype(model.template cast<T>()) CastModelT;
+        
+        const RigidPointTransform<T> xform(pose.inverse());
+        
+        // aligned, the model may hold vectorizable parameters
+        const std::shared_ptr<const CastModelT> cast_model = std::allocate_shared<CastModelT>(Eigen::aligned_allocator<CastModelT>(), model.template cast<T>());
+        
+        project = [cast_model, xform](const PointView<const T>& points, const PixelView<T>& pixels, ProjectionStatus* status)
+        {
+            forwardBatchImpl(*cast_model, xform, points, pixels, status);
+        };
+    }
+    
+    // nearest pixel of a projection that is Ok
+    inline bool getPixel(const PixelT& pixel, ProjectionStatus status, std::size_t& u, std::size_t& v) const
+    {
+        using std::floor;
+        
+        if(status != ProjectionStatus::Ok) { return false; }
+        u = (std::size_t)floor(pixel(0) + T(0.5));
+        v = (std::size_t)floor(pixel(1) + T(0.5));
+        return u < width && v < height;
+    }
+    
+    // the depth image where given (0: nothing seen), else the rendered buffer
+    inline float getRange(const RangeBuffer& rendered, std::size_t u, std::size_t v) const
+    {
+        if(depth != nullptr)
+        {
+            const float d = depth[v * stride + u];
+            return d > 0.0f ? d : std::numeric_limits<float>::infinity();
+        }
+        return rendered.get(u, v);
+    }
+    
+    ProjectionFunction project;
+    PointT centre;
+    std::size_t width, height, stride;
+    const float* depth;
+};
+
+}
+
+}
+
+#endif // CAMERA_PROJECTED_VIEW_HPP
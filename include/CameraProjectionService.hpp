@@ -0,0 +1,478 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Micro-batching projection service coalescing small requests across threads.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_PROJECTION_SERVICE_HPP
+#define CAMERA_PROJECTION_SERVICE_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraBatch.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+struct MpscNode
+{
+    std::atomic<MpscNode*> next;
+};
+
+/**
+ * Intrusive multi-producer single-consumer queue (D. Vyukov). push is wait-free,
+ * pop may spuriously return null while a producer is half way through a push.
+ */
+class MpscQueue
+{
+public:
+    MpscQueue() : head(&stub), tail(&stub)
+    {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+    
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+    
+    // any thread
+    inline void push(MpscNode* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+    
+    // consumer only
+    inline MpscNode* pop()
+    {
+        MpscNode* t = tail;
+        MpscNode* next = t->next.load(std::memory_order_acquire);
+        
+        if(t == &stub)
+        {
+            if(next == nullptr)
+            {
+                return nullptr;
+            }
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        
+        if(next != nullptr)
+        {
+            tail = next;
+            return t;
+        }
+        
+        if(t != head.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        
+        push(&stub);
+        
+        next = t->next.load(std::memory_order_acquire);
+        if(next != nullptr)
+        {
+            tail = next;
+            return t;
+        }
+        
+        return nullptr;
+    }
+    
+private:
+    std::atomic<MpscNode*> head;
+    MpscNode* tail;
+    MpscNode stub;
+};
+
+}
+
+/**
+ * Counters of a ProjectionService.
+ */
+struct ProjectionServiceStatistics
+{
+    ProjectionServiceStatistics() : requests(0), batches(0), points(0), direct(0) { }
+    
+    std::size_t requests;
+    std::size_t batches;
+    std::size_t points;
+    std::size_t direct;
+    
+    inline double getAverageBatchPoints() const { return batches > 0 ? double(points) / double(batches) : 0.0; }
+};
+
+/**
+ * Coalesces small concurrent requests for one camera into larger batches run on a
+ * worker thread. Requests are queued lock-free (MPSC), the worker waits for more until
+ * batch_points are pending or the oldest request waited max_latency, then runs one
+ * batch. Callers spin briefly (SpinCount yields), then sleep until the worker signals
+ * their request is done, the worker sleeps while waiting for more requests too.
+ * Requests of batch_points or more bypass the queue and run on the calling thread.
+ */
+template<typename T>
+class ProjectionService
+{
+public:
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef std::function<void(const PointT*, std::size_t, PixelT*, ProjectionStatus*)> ForwardKernel;
+    typedef std::function<void(const PixelT*, std::size_t, PointT*)> InverseKernel;
+    static constexpr unsigned int SpinCount = 64;
+    
+    ProjectionService(const ForwardKernel& fwd, const InverseKernel& inv, 
+                      std::chrono::microseconds max_latency = std::chrono::microseconds(50), std::size_t batch_points = 256)
+        : forward_kernel(fwd), inverse_kernel(inv), latency(max_latency), target(batch_points), 
+          pending(0), sleeping(false), running(true), parked(0), direct(0)
+    {
+        worker = std::thread(&ProjectionService::run, this);
+    }
+    
+    ~ProjectionService()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeup_mutex);
+            running.store(false);
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+    
+    ProjectionService(const ProjectionService&) = delete;
+    ProjectionService& operator=(const ProjectionService&) = delete;
+    
+    void forward(const PointT* points, std::size_t count, PixelT* pixels, ProjectionStatus* status)
+    {
+        if(count >= target)
+        {
+            direct.fetch_add(1, std::memory_order_relaxed);
+            forward_kernel(points, count, pixels, status);
+            return;
+        }
+        
+        Request r(Request::Forward, points, count, pixels, status);
+        submit(r);
+    }
+    
+    void inverse(const PixelT* pixels, std::size_t count, PointT* rays)
+    {
+        if(count >= target)
+        {
+            direct.fetch_add(1, std::memory_order_relaxed);
+            inverse_kernel(pixels, count, rays);
+            return;
+        }
+        
+        Request r(Request::Inverse, pixels, count, rays, nullptr);
+        submit(r);
+    }
+    
+    inline PixelT forward(const PointT& pt, ProjectionStatus* status = nullptr)
+    {
+        PixelT ret;
+        ProjectionStatus s;
+        forward(&pt, 1, &ret, status != nullptr ? status : &s);
+        return ret;
+    }
+    
+    inline PointT inverse(const PixelT& pix)
+    {
+        PointT ret;
+        inverse(&pix, 1, &ret);
+        return ret;
+    }
+    
+    ProjectionServiceStatistics getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        ProjectionServiceStatistics ret = stats;
+        ret.direct = direct.load(std::memory_order_relaxed);
+        return ret;
+    }
+    
+private:
+    struct Request : public internal::MpscNode
+    {
+        enum Kind { Forward, Inverse };
+        
+        Request(Kind k, const void* i, std::size_t n, void* o, ProjectionStatus* s) 
+            : kind(k), in(i), count(n), out(o), status(s), enqueued(std::chrono::steady_clock::now()), done(false) { }
+        
+        Kind kind;
+        const void* in;
+        std::size_t count;
+        void* out;
+        ProjectionStatus* status;
+        std::chrono::steady_clock::time_point enqueued;
+        std::atomic<bool> done;
+    };
+    
+    void submit(Request& r)
+    {
+        pending.fetch_add(1);
+        queue.push(&r);
+        
+        if(sleeping.load())
+        {
+            std::lock_guard<std::mutex> lock(wakeup_mutex);
+            wakeup.notify_one();
+        }
+        
+        // requests are tiny, the worker often answers within a few yields
+        for(unsigned int i = 0 ; i < SpinCount ; ++i)
+        {
+            if(r.done.load(std::memory_order_acquire)) { return; }
+            std::this_thread::yield();
+        }
+        
+        // park, the worker notifies once it sees a parked caller (the request may be gone by then,
+        // so the wait is on the service, each caller checking its own request)
+        std::unique_lock<std::mutex> lock(done_mutex);
+        parked.fetch_add(1);
+        done_cv.wait(lock, [&]() { return r.done.load(); });
+        parked.fetch_sub(1);
+    }
+    
+    // worker, until a request arrives, the deadline passes or the service stops
+    inline void waitForRequests(std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock(wakeup_mutex);
+        sleeping.store(true);
+        wakeup.wait_until(lock, deadline, [&]() { return pending.load() > 0 || !running.load(); });
+        sleeping.store(false);
+    }
+    
+    inline Request* pop()
+    {
+        Request* r = static_cast<Request*>(queue.pop());
+        if(r != nullptr)
+        {
+            pending.fetch_sub(1);
+        }
+        return r;
+    }
+    
+    void run()
+    {
+        std::vector<Request*> batch;
+        
+        while(true)
+        {
+            Request* first = pop();
+            if(first == nullptr)
+            {
+                if(!running.load() && pending.load() == 0)
+                {
+                    break;
+                }
+                
+                if(pending.load() == 0)
+                {
+                    waitForRequests(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+                }
+                continue;
+            }
+            
+            // collect until the batch is full or the oldest request is due
+            batch.clear();
+            batch.push_back(first);
+            std::size_t points = first->count;
+            while(points < target && std::chrono::steady_clock::now() - first->enqueued < latency)
+            {
+                Request* r = pop();
+                if(r != nullptr)
+                {
+                    batch.push_back(r);
+                    points += r->count;
+                }
+                else if(pending.load() == 0)
+                {
+                    waitForRequests(first->enqueued + latency);
+                }
+                else
+                {
+                    std::this_thread::yield(); // a push is half way through
+                }
+            }
+            
+            process(batch);
+        }
+    }
+    
+    void process(const std::vector<Request*>& batch)
+    {
+        fwd_in.clear();
+        inv_in.clear();
+        for(std::size_t i = 0 ; i < batch.size() ; ++i)
+        {
+            const Request& r = *batch[i];
+            if(r.kind == Request::Forward)
+            {
+                const PointT* in = static_cast<const PointT*>(r.in);
+                fwd_in.insert(fwd_in.end(), in, in + r.count);
+            }
+            else
+            {
+                const PixelT* in = static_cast<const PixelT*>(r.in);
+                inv_in.insert(inv_in.end(), in, in + r.count);
+            }
+        }
+        
+        fwd_out.resize(fwd_in.size());
+        fwd_status.resize(fwd_in.size());
+        inv_out.resize(inv_in.size());
+        if(!fwd_in.empty()) { forward_kernel(fwd_in.data(), fwd_in.size(), fwd_out.data(), fwd_status.data()); }
+        if(!inv_in.empty()) { inverse_kernel(inv_in.data(), inv_in.size(), inv_out.data()); }
+        
+        // before any caller returns, so the counters cover all finished requests
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.requests += batch.size();
+            stats.batches++;
+            stats.points += fwd_in.size() + inv_in.size();
+        }
+        
+        std::size_t fwd_at = 0, inv_at = 0;
+        for(std::size_t i = 0 ; i < batch.size() ; ++i)
+        {
+            Request& r = *batch[i];
+            if(r.kind == Request::Forward)
+            {
+                std::copy(fwd_out.begin() + fwd_at, fwd_out.begin() + fwd_at + r.count, static_cast<PixelT*>(r.out));
+                std::copy(fwd_status.begin() + fwd_at, fwd_status.begin() + fwd_at + r.count, r.status);
+                fwd_at += r.count;
+            }
+            else
+            {
+                std::copy(inv_out.begin() + inv_at, inv_out.begin() + inv_at + r.count, static_cast<PointT*>(r.out));
+                inv_at += r.count;
+            }
+            
+            // the request lives on the caller's stack, not to be touched after this
+            r.done.store(true);
+        }
+        
+        // done is stored before parked is read, a caller parking in between sees done
+        if(parked.load() > 0)
+        {
+            { std::lock_guard<std::mutex> lock(done_mutex); }
+            done_cv.notify_all();
+        }
+    }
+    
+    ForwardKernel forward_kernel;
+    InverseKernel inverse_kernel;
+    std::chrono::microseconds latency;
+    std::size_t target;
+    
+    internal::MpscQueue queue;
+    std::atomic<std::size_t> pending;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> running;
+    std::mutex wakeup_mutex;
+    std::condition_variable wakeup;
+    std::atomic<std::size_t> parked;
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    std::thread worker;
+    
+    // worker only
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> fwd_in, inv_out;
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> fwd_out, inv_in;
+    std::vector<ProjectionStatus> fwd_status;
+    
+    mutable std::mutex stats_mutex;
+    ProjectionServiceStatistics stats;
+    std::atomic<std::size_t> direct;
+};
+
+template<typename T>
+constexpr unsigned int ProjectionService<T>::SpinCount;
+
+/**
+ * Service running the packet batch functions of a concrete model.
+ */
+template<typename ModelT>
+inline std::unique_ptr<ProjectionService<typename ModelT::Scalar>> makeProjectionService(const ModelT& model,
+                                                                                        std::chrono::microseconds max_latency = std::chrono::microseconds(50),
+                                                                                        std::size_t batch_points = 256)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::PointT PointT;
+    typedef typename ComplexTypes<Scalar>::PixelT PixelT;
+    
+    return std::unique_ptr<ProjectionService<Scalar>>(new ProjectionService<Scalar>(
+        [model](const PointT* pts, std::size_t n, PixelT* pix, ProjectionStatus* status) { forwardBatch(model, pts, n, pix, status); },
+        [model](const PixelT* pix, std::size_t n, PointT* rays) { inverseBatch(model, pix, n, rays); },
+        max_latency, batch_points));
+}
+
+/**
+ * Service over the polymorphic interface, one virtual call per batch into the packet batch
+ * functions of the model. The camera must outlive the service.
+ */
+template<typename T>
+inline std::unique_ptr<ProjectionService<T>> makeProjectionService(const CameraInterface<T>& cam,
+                                                                   std::chrono::microseconds max_latency = std::chrono::microseconds(50),
+                                                                   std::size_t batch_points = 256)
+{
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    const CameraInterface<T>* camera = &cam;
+    
+    return std::unique_ptr<ProjectionService<T>>(new ProjectionService<T>(
+        [camera](const PointT* pts, std::size_t n, PixelT* pix, ProjectionStatus* status) { camera->forwardBatch(pts, n, pix, status); },
+        [camera](const PixelT* pix, std::size_t n, PointT* rays) { camera->inverseBatch(pix, n, rays); },
+        max_latency, batch_points));
+}
+
+}
+
+#endif // CAMERA_PROJECTION_SERVICE_HPP
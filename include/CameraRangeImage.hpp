@@ -0,0 +1,349 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Range images of point clouds with the spherical model.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_RANGE_IMAGE_HPP
+#define CAMERA_RANGE_IMAGE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+#include <CameraThreads.hpp>
+#include <SphericalCameraModel.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+/**
+ * Branch-free atan2, polynomial on [0,1] and octant folding, works on scalars and packets.
+ * Max error about 1e-5 rad.
+ */
+template<typename T>
+EIGEN_DEVICE_FUNC inline T fastAtan2(const T& y, const T& x)
+{
+    using std::abs;
+    using std::min;
+    using std::max;
+    
+    const T ax = abs(x), ay = abs(y);
+    const T lo = min(ax, ay), hi = max(ax, ay);
+    const T a = select(hi > T(0.0f), lo / hi, T(0.0f));
+    const T s = a * a;
+    
+    T r = T(-0.01172120f);
+    r = r * s + T(0.05265332f);
+    r = r * s + T(-0.11643287f);
+    r = r * s + T(0.19354346f);
+    r = r * s + T(-0.33262347f);
+    r = r * s + T(0.99997726f);
+    r = r * a;
+    
+    r = select(ay > ax, T(M_PI / 2.0) - r, r);
+    r = select(x < T(0.0f), T(M_PI) - r, r);
+    return select(y < T(0.0f), -r, r);
+}
+
+}
+
+/**
+ * Range image, planar channels. Empty pixels have range and intensity 0 and InvalidIndex.
+ */
+template<typename T>
+struct RangeImage
+{
+    static constexpr std::uint32_t InvalidIndex = 0xFFFFFFFFu;
+    
+    RangeImage() : w(0), h(0) { }
+    
+    inline void resize(std::size_t width, std::size_t height)
+    {
+        w = width;
+        h = height;
+        range.resize(w * h);
+        intensity.resize(w * h);
+        index.resize(w * h);
+    }
+    
+    inline std::size_t width() const { return w; }
+    inline std::size_t height() const { return h; }
+    
+    inline T getRange(std::size_t x, std::size_t y) const { return range[y * w + x]; }
+    inline T getIntensity(std::size_t x, std::size_t y) const { return intensity[y * w + x]; }
+    inline std::uint32_t getIndex(std::size_t x, std::size_t y) const { return index[y * w + x]; }
+    inline bool isEmpty(std::size_t x, std::size_t y) const { return index[y * w + x] == InvalidIndex; }
+    
+    std::size_t w, h;
+    std::vector<T> range;
+    std::vector<T> intensity;
+    std::vector<std::uint32_t> index;
+};
+
+template<typename T>
+constexpr std::uint32_t RangeImage<T>::InvalidIndex;
+
+/**
+ * Builds range images with a SphericalCameraModel, the nearest point wins a pixel
+ * (ties go to the lower point index, so the result does not depend on the thread count).
+ * Points are binned in packets with a polynomial atan2 instead of acos / atan2 (pixel
+ * equal to floor(forward(pt)) except within ~1e-5 rad of a pixel border), then sorted
+ * into bands of tile_rows rows, each band resolved by one thread without atomics.
+ * Keeps its scratch buffers between scans, use one per thread.
+ */
+template<typename T>
+class RangeImageBuilder
+{
+public:
+    typedef SphericalCameraModel<T> ModelT;
+    typedef typename internal::BatchPacket<T>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    static constexpr std::uint32_t InvalidCell = 0xFFFFFFFFu;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit RangeImageBuilder(const ModelT& m, unsigned int thread_count = 0, std::size_t tile_rows = 16)
+        : model(m), threads(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency())),
+          band_rows(std::max<std::size_t>(tile_rows, 1))
+    {
+        w = (std::size_t)model.width();
+        h = (std::size_t)model.height();
+        bands = (h + band_rows - 1) / band_rows;
+    }
+    
+    inline const ModelT& getModel() const { return model; }
+    inline unsigned int getThreadCount() const { return threads; }
+    
+    template<typename InT>
+    inline void build(const StridedView<InT,3>& points, RangeImage<T>& out)
+    {
+        build(points, static_cast<const float*>(nullptr), out);
+    }
+    
+    /**
+     * Range image of the points (in the sensor frame), intensities (one per point) can be null.
+     */
+    template<typename InT, typename IntensityT>
+    void build(const StridedView<InT,3>& points, const IntensityT* intensities, RangeImage<T>& out)
+    {
+        const std::size_t count = points.size();
+        assert(count < (std::size_t)InvalidCell);
+        
+        out.resize(w, h);
+        cells.resize(count);
+        ranges.resize(count);
+        sorted.resize(count);
+        best.resize(w * h);
+        histogram.assign(threads * bands, 0);
+        
+        const std::size_t per_thread = (((count + threads - 1) / threads + Lanes - 1) / Lanes) * Lanes;
+        
+        // bin points, count per thread and band
+        internal::runOnThreads(threads, [&](unsigned int t)
+        {
+            const std::size_t begin = std::min(count, t * per_thread), end = std::min(count, begin + per_thread);
+            binPoints(points, begin, end);
+            
+            std::size_t* hist = &histogram[t * bands];
+            for(std::size_t i = begin ; i < end ; ++i)
+            {
+                if(cells[i] != InvalidCell) { hist[cells[i] / w / band_rows]++; }
+            }
+        });
+        
+        // band major offsets, threads in order within a band
+        band_begin.resize(bands + 1);
+        std::size_t total = 0;
+        for(std::size_t b = 0 ; b < bands ; ++b)
+        {
+            band_begin[b] = total;
+            for(unsigned int t = 0 ; t < threads ; ++t)
+            {
+                const std::size_t n = histogram[t * bands + b];
+                histogram[t * bands + b] = total;
+                total += n;
+            }
+        }
+        band_begin[bands] = total;
+        
+        std::atomic<std::size_t> next_band(0);
+        internal::runOnThreads(threads, [&](unsigned int t)
+        {
+            const std::size_t begin = std::min(count, t * per_thread), end = std::min(count, begin + per_thread);
+            std::size_t* offset = &histogram[t * bands];
+            for(std::size_t i = begin ; i < end ; ++i)
+            {
+                if(cells[i] != InvalidCell) { sorted[offset[cells[i] / w / band_rows]++] = (std::uint32_t)i; }
+            }
+        });
+        
+        // resolve collisions and fill the channels, band by band
+        internal::runOnThreads(threads, [&](unsigned int)
+        {
+            for(std::size_t b = next_band.fetch_add(1) ; b < bands ; b = next_band.fetch_add(1))
+            {
+                resolveBand(b, intensities, out);
+            }
+        });
+    }
+    
+private:
+    template<typename InT>
+    inline void binPoints(const StridedView<InT,3>& points, std::size_t begin, std::size_t end)
+    {
+        std::size_t i = begin;
+        for( ; i + Lanes <= end ; i += Lanes)
+        {
+            typename ComplexTypes<PacketT>::PointT pt;
+            for(std::size_t l = 0 ; l < Lanes ; ++l)
+            {
+                pt(0)[l] = T(points(i + l, 0));
+                pt(1)[l] = T(points(i + l, 1));
+                pt(2)[l] = T(points(i + l, 2));
+            }
+            
+            PacketT r, px, py;
+            project(pt, r, px, py);
+            
+            for(std::size_t l = 0 ; l < Lanes ; ++l)
+            {
+                store(i + l, r[l], px[l], py[l]);
+            }
+        }
+        
+        for( ; i < end ; ++i)
+        {
+            const typename ComplexTypes<T>::PointT pt(T(points(i, 0)), T(points(i, 1)), T(points(i, 2)));
+            T r, px, py;
+            project(pt, r, px, py);
+            store(i, r, px, py);
+        }
+    }
+    
+    // forward of the spherical model, with fastAtan2(rho, z) for acos(z / r)
+    template<typename PT>
+    inline void project(const typename ComplexTypes<PT>::PointT& pt, PT& r, PT& px, PT& py) const
+    {
+        using std::sqrt;
+        
+        const PT rho2 = pt(0) * pt(0) + pt(1) * pt(1);
+        r = sqrt(rho2 + pt(2) * pt(2));
+        
+        const PT azimuth = internal::fastAtan2(pt(1), pt(0)) + PT(T(M_PI));
+        const PT polar = internal::fastAtan2(sqrt(rho2), pt(2));
+        
+        px = PT(model.width()) - (azimuth / PT(T(2.0 * M_PI))) * PT(model.width());
+        py = ((polar - PT(model.min_angle())) / PT(model.max_angle() - model.min_angle())) * PT(model.height());
+    }
+    
+    inline void store(std::size_t i, T r, T px, T py)
+    {
+        using std::floor;
+        
+        ranges[i] = r;
+        cells[i] = InvalidCell;
+        
+        // also rejects nan
+        if(!(r > T(0.0) && r <= T(std::numeric_limits<float>::max()) && py >= T(0.0) && py < T(h) && px >= T(0.0) && px <= T(w)))
+        {
+            return;
+        }
+        
+        std::size_t x = (std::size_t)floor(px), y = (std::size_t)floor(py);
+        if(x >= w) { x -= w; } // azimuth wraps around
+        if(y >= h) { return; }
+        cells[i] = (std::uint32_t)(y * w + x);
+    }
+    
+    template<typename IntensityT>
+    inline void resolveBand(std::size_t b, const IntensityT* intensities, RangeImage<T>& out)
+    {
+        const std::size_t first = b * band_rows * w, last = std::min(h, (b + 1) * band_rows) * w;
+        std::fill(best.begin() + first, best.begin() + last, std::numeric_limits<std::uint64_t>::max());
+        
+        // positive floats order as their bits, the index breaks ties
+        for(std::size_t k = band_begin[b] ; k < band_begin[b + 1] ; ++k)
+        {
+            const std::uint32_t i = sorted[k];
+            const float range = float(ranges[i]);
+            std::uint32_t bits;
+            std::memcpy(&bits, &range, sizeof(bits));
+            const std::uint64_t key = (std::uint64_t(bits) << 32) | i;
+            best[cells[i]] = std::min(best[cells[i]], key);
+        }
+        
+        for(std::size_t c = first ; c < last ; ++c)
+        {
+            if(best[c] == std::numeric_limits<std::uint64_t>::max())
+            {
+                out.range[c] = T(0.0);
+                out.intensity[c] = T(0.0);
+                out.index[c] = RangeImage<T>::InvalidIndex;
+                continue;
+            }
+            
+            const std::uint32_t i = (std::uint32_t)(best[c] & 0xFFFFFFFFu);
+            out.range[c] = ranges[i];
+            out.intensity[c] = intensities != nullptr ? T(intensities[i]) : T(0.0);
+            out.index[c] = i;
+        }
+    }
+    
+    ModelT model;
+    unsigned int threads;
+    std::size_t band_rows;
+    std::size_t w, h, bands;
+    std::vector<std::uint32_t> cells;
+    std::vector<T> ranges;
+    std::vector<std::uint32_t> sorted;
+    std::vector<std::uint64_t> best;
+    std::vector<std::size_t> histogram;
+    std::vector<std::size_t> band_begin;
+};
+
+}
+
+#endif // CAMERA_RANGE_IMAGE_HPP
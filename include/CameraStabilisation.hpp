@@ -0,0 +1,165 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Warp maps for electronic image stabilisation.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_STABILISATION_HPP
+#define CAMERA_STABILISATION_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <limits>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraBatch.hpp>
+#include <CameraTables.hpp>
+#include <PinholeCameraModel.hpp>
+
+namespace camera
+{
+
+/**
+ * Generates remap tables (see buildRemapTable) from a stabilised PinholeCameraModel view
+ * to a source model, under a rotation of the whole frame or one rotation per output row
+ * (rolling shutter). Rays of an output row are affine in x, so each row costs one 3x3
+ * product and every pixel a multiply-add and the source forward, over packets.
+ * Rotations are the source camera in the output frame, as in forward(pose, pt).
+ * Rays behind the source camera map to NaN, coordinates outside the source image are kept as is.
+ */
+template<typename SrcModelT>
+class StabilisationWarp
+{
+public:
+    typedef typename SrcModelT::Scalar Scalar;
+    typedef PinholeCameraModel<Scalar> DstModelT;
+    typedef typename ComplexTypes<Scalar>::RotationT RotationT;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    StabilisationWarp(const DstModelT& d, const SrcModelT& s) : dst(d), src(s)
+    {
+        inv_intrinsics = dst.getIntrinsicMatrix().inverse();
+    }
+    
+    inline const DstModelT& getTarget() const { return dst; }
+    inline const SrcModelT& getSource() const { return src; }
+    
+    /**
+     * Map for a rotation of the whole frame. map is reallocated only if its size differs.
+     */
+    inline void generate(const RotationT& rotation, RemapTable<Scalar>& map) const
+    {
+        prepare(map);
+        const Eigen::Matrix<Scalar,3,3> m = rotation.inverse().matrix() * inv_intrinsics;
+        for(std::size_t y = 0 ; y < map.height() ; ++y)
+        {
+            generateRow(m, y, map);
+        }
+    }
+    
+    /**
+     * Map with a rotation for every output row (dst.height() of them).
+     */
+    inline void generate(const RotationT* row_rotations, RemapTable<Scalar>& map) const
+    {
+        prepare(map);
+        for(std::size_t y = 0 ; y < map.height() ; ++y)
+        {
+            generateRow(row_rotations[y].inverse().matrix() * inv_intrinsics, y, map);
+        }
+    }
+    
+private:
+    inline void prepare(RemapTable<Scalar>& map) const
+    {
+        const std::size_t w = (std::size_t)dst.width(), h = (std::size_t)dst.height();
+        if(map.width() != w || map.height() != h || map.empty() || map.isReadOnly())
+        {
+            map = RemapTable<Scalar>(w, h);
+        }
+    }
+    
+    // ray(x) = m * (x, y, 1) = base + x * step, scale does not matter to forward
+    inline void generateRow(const Eigen::Matrix<Scalar,3,3>& m, std::size_t y, RemapTable<Scalar>& map) const
+    {
+        const typename ComplexTypes<Scalar>::PointT step = m.col(0);
+        const typename ComplexTypes<Scalar>::PointT base = m.col(1) * Scalar(y) + m.col(2);
+        const std::size_t w = map.width();
+        Scalar* out = map.mutablePixel(0, y);
+        
+        PacketT lane;
+        for(std::size_t l = 0 ; l < Lanes ; ++l) { lane[l] = Scalar(l); }
+        
+        std::size_t x = 0;
+        for( ; x + Lanes <= w ; x += Lanes)
+        {
+            const PacketT xs = lane + PacketT(Scalar(x));
+            typename ComplexTypes<PacketT>::PointT ray;
+            ray(0) = PacketT(base(0)) + xs * PacketT(step(0));
+            ray(1) = PacketT(base(1)) + xs * PacketT(step(1));
+            ray(2) = PacketT(base(2)) + xs * PacketT(step(2));
+            
+            const typename ComplexTypes<PacketT>::PixelT pix = src.template forward<PacketT>(ray);
+            const typename ScalarMask<PacketT>::Type valid = src.template pointValid<PacketT>(ray);
+            const PacketT nan(std::numeric_limits<Scalar>::quiet_NaN());
+            const PacketT px = select(valid, pix(0), nan), py = select(valid, pix(1), nan);
+            
+            for(std::size_t l = 0 ; l < Lanes ; ++l)
+            {
+                out[(x + l) * 2 + 0] = px[l];
+                out[(x + l) * 2 + 1] = py[l];
+            }
+        }
+        
+        for( ; x < w ; ++x)
+        {
+            const typename ComplexTypes<Scalar>::PointT ray = base + Scalar(x) * step;
+            const typename ComplexTypes<Scalar>::PixelT pix = src.forward(ray);
+            const bool valid = src.pointValid(ray);
+            out[x * 2 + 0] = valid ? pix(0) : std::numeric_limits<Scalar>::quiet_NaN();
+            out[x * 2 + 1] = valid ? pix(1) : std::numeric_limits<Scalar>::quiet_NaN();
+        }
+    }
+    
+    DstModelT dst;
+    SrcModelT src;
+    Eigen::Matrix<Scalar,3,3> inv_intrinsics;
+};
+
+}
+
+#endif // CAMERA_STABILISATION_HPP
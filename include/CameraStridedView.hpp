@@ -0,0 +1,164 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Strided views over foreign point / pixel buffers.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_STRIDED_VIEW_HPP
+#define CAMERA_STRIDED_VIEW_HPP
+
+#include <cstddef>
+#include <cassert>
+#include <type_traits>
+
+#include <CameraModelHelpers.hpp>
+
+namespace camera
+{
+
+/**
+ * Non-owning view of count elements of Dims components of type T (const T for read-only),
+ * element i component c is at byte data + i * stride + offset[c]. Describes e.g. an array of
+ * cv::Point2f (stride 8, offsets 0, 4) or a PCL PointXYZ cloud (stride 16, offsets 0, 4, 8)
+ * without depending on either library.
+ */
+template<typename T, int Dims>
+class StridedView
+{
+public:
+    typedef typename std::remove_const<T>::type Scalar;
+    typedef typename std::conditional<std::is_const<T>::value, const unsigned char, unsigned char>::type Byte;
+    typedef typename std::conditional<std::is_const<T>::value, const void, void>::type Void;
+    static constexpr int Dimensions = Dims;
+    
+    StridedView() : base(nullptr), count(0), stride(0)
+    {
+        for(int c = 0 ; c < Dims ; ++c) { offsets[c] = 0; }
+    }
+    
+    /**
+     * Components interleaved at the start of each element, stride defaults to packed.
+     */
+    StridedView(Void* data, std::size_t n, std::size_t stride_bytes = Dims * sizeof(T)) 
+        : base(static_cast<Byte*>(data)), count(n), stride(stride_bytes)
+    {
+        for(int c = 0 ; c < Dims ; ++c) { offsets[c] = c * sizeof(T); }
+    }
+    
+    StridedView(Void* data, std::size_t n, std::size_t stride_bytes, const std::size_t (&offset_bytes)[Dims]) 
+        : base(static_cast<Byte*>(data)), count(n), stride(stride_bytes)
+    {
+        for(int c = 0 ; c < Dims ; ++c) { offsets[c] = offset_bytes[c]; }
+    }
+    
+    // mutable to read-only
+    template<typename OtherT, typename = typename std::enable_if<std::is_same<const OtherT, T>::value>::type>
+    StridedView(const StridedView<OtherT,Dims>& other) : base(other.data()), count(other.size()), stride(other.getStride())
+    {
+        for(int c = 0 ; c < Dims ; ++c) { offsets[c] = other.getOffset(c); }
+    }
+    
+    inline std::size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline Byte* data() const { return base; }
+    inline std::size_t getStride() const { return stride; }
+    inline std::size_t getOffset(int c) const { return offsets[c]; }
+    
+    inline T& operator()(std::size_t i, int c) const
+    {
+        assert(i < count && c < Dims);
+        return *reinterpret_cast<T*>(base + i * stride + offsets[c]);
+    }
+    
+    /**
+     * Elements [first, first + n).
+     */
+    inline StridedView segment(std::size_t first, std::size_t n) const
+    {
+        assert(first + n <= count);
+        return StridedView(base + first * stride, n, stride, offsets);
+    }
+    
+private:
+    Byte* base;
+    std::size_t count;
+    std::size_t stride;
+    std::size_t offsets[Dims];
+};
+
+template<typename T> using PointView = StridedView<T,3>;
+template<typename T> using PixelView = StridedView<T,2>;
+
+template<typename T>
+inline PointView<T> makePointView(T* data, std::size_t count, std::size_t stride_bytes, std::size_t ox, std::size_t oy, std::size_t oz)
+{
+    const std::size_t offsets[3] = { ox, oy, oz };
+    return PointView<T>(data, count, stride_bytes, offsets);
+}
+
+template<typename T>
+inline PixelView<T> makePixelView(T* data, std::size_t count, std::size_t stride_bytes, std::size_t ox, std::size_t oy)
+{
+    const std::size_t offsets[2] = { ox, oy };
+    return PixelView<T>(data, count, stride_bytes, offsets);
+}
+
+/**
+ * Views over arrays of Eigen vectors, e.g. std::vector<Eigen::Vector3d>::data().
+ */
+template<typename T>
+inline PointView<T> makePointView(Eigen::Matrix<T,3,1>* pts, std::size_t count)
+{
+    return PointView<T>(pts, count, sizeof(Eigen::Matrix<T,3,1>));
+}
+
+template<typename T>
+inline PointView<const T> makePointView(const Eigen::Matrix<T,3,1>* pts, std::size_t count)
+{
+    return PointView<const T>(pts, count, sizeof(Eigen::Matrix<T,3,1>));
+}
+
+template<typename T>
+inline PixelView<T> makePixelView(Eigen::Matrix<T,2,1>* pix, std::size_t count)
+{
+    return PixelView<T>(pix, count, sizeof(Eigen::Matrix<T,2,1>));
+}
+
+template<typename T>
+inline PixelView<const T> makePixelView(const Eigen::Matrix<T,2,1>* pix, std::size_t count)
+{
+    return PixelView<const T>(pix, count, sizeof(Eigen::Matrix<T,2,1>));
+}
+
+}
+
+#endif // CAMERA_STRIDED_VIEW_HPP
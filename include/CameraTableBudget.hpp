@@ -0,0 +1,354 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Memory budgeted LRU cache of derived tables.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TABLE_BUDGET_HPP
+#define CAMERA_TABLE_BUDGET_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <CameraTables.hpp>
+
+namespace camera
+{
+
+/**
+ * Counters of a TableBudgetCache.
+ */
+struct TableCacheStatistics
+{
+    TableCacheStatistics() : hits(0), misses(0), evictions(0), rebuilds(0), rebuild_seconds(0.0), resident_bytes(0), budget_bytes(0) { }
+
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+    std::size_t rebuilds;
+    double rebuild_seconds;
+    std::size_t resident_bytes;
+    std::size_t budget_bytes;
+
+    inline double getHitRate() const
+    {
+        const std::size_t total = hits + misses;
+        return total > 0 ? double(hits) / double(total) : 0.0;
+    }
+
+    inline double getAverageRebuildSeconds() const
+    {
+        return rebuilds > 0 ? rebuild_seconds / double(rebuilds) : 0.0;
+    }
+};
+
+/**
+ * Keeps derived tables resident up to a byte budget, evicting the least recently used.
+ * Evicted tables are rebuilt on the next acquire. Handles given out stay valid after
+ * eviction, but the memory is then accounted to the holder, not to the cache.
+ * The most recently inserted table is never evicted, even if alone it exceeds the budget.
+ */
+class TableBudgetCache
+{
+public:
+    explicit TableBudgetCache(std::size_t budget_bytes) : budget(budget_bytes), resident(0) { stats.budget_bytes = budget_bytes; }
+    TableBudgetCache(const TableBudgetCache&) = delete;
+    TableBudgetCache& operator=(const TableBudgetCache&) = delete;
+
+    template<typename TableT, typename BuilderT>
+    std::shared_ptr<const TableT> acquire(std::uint64_t key, BuilderT builder)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::shared_ptr<const void> hit = touch(key);
+            if(hit)
+            {
+                stats.hits++;
+                return std::static_pointer_cast<const TableT>(hit);
+            }
+            stats.misses++;
+        }
+
+        // build without the lock, a concurrent build of the same key is resolved on insert
+        const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        std::shared_ptr<const TableT> built = std::make_shared<const TableT>(builder());
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.rebuilds++;
+        stats.rebuild_seconds += elapsed.count();
+
+        std::shared_ptr<const void> existing = touch(key);
+        if(existing)
+        {
+            return std::static_pointer_cast<const TableT>(existing);
+        }
+
+        lru.push_front(Entry(key, built, built->bytes()));
+        index[key] = lru.begin();
+        resident += built->bytes();
+        evict();
+
+        return built;
+    }
+
+    /**
+     * Resident table or null, never rebuilds. Counts as a use.
+     */
+    template<typename TableT>
+    std::shared_ptr<const TableT> peek(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::static_pointer_cast<const TableT>(touch(key));
+    }
+
+    template<typename ModelT>
+    std::shared_ptr<const RayTable<typename ModelT::Scalar>> getRayTable(const ModelT& model)
+    {
+        return acquire<RayTable<typename ModelT::Scalar>>(getTableKey(TableKind::Ray, model), [&]() { return buildRayTable(model); });
+    }
+
+    template<typename ModelT>
+    std::shared_ptr<const ValidMaskTable> getValidMask(const ModelT& model)
+    {
+        return acquire<ValidMaskTable>(getTableKey(TableKind::ValidMask, model), [&]() { return buildValidMask(model); });
+    }
+
+    template<typename DstModelT, typename SrcModelT>
+    std::shared_ptr<const RemapTable<typename SrcModelT::Scalar>> getRemapTable(const DstModelT& dst, const SrcModelT& src,
+                                                                                const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose = typename ComplexTypes<typename SrcModelT::Scalar>::RotationT())
+    {
+        return acquire<RemapTable<typename SrcModelT::Scalar>>(getRemapTableKey(dst, src, pose), [&]() { return buildRemapTable(dst, src, pose); });
+    }
+
+    void setBudget(std::size_t budget_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = budget_bytes;
+        stats.budget_bytes = budget_bytes;
+        evict();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.evictions += lru.size();
+        lru.clear();
+        index.clear();
+        resident = 0;
+    }
+
+    TableCacheStatistics getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        TableCacheStatistics ret = stats;
+        ret.resident_bytes = resident;
+        return ret;
+    }
+
+    void resetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = TableCacheStatistics();
+        stats.budget_bytes = budget;
+    }
+
+private:
+    struct Entry
+    {
+        Entry(std::uint64_t k, const std::shared_ptr<const void>& t, std::size_t b) : key(k), table(t), bytes(b) { }
+
+        std::uint64_t key;
+        std::shared_ptr<const void> table;
+        std::size_t bytes;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    // lock held, moves the entry to the front
+    std::shared_ptr<const void> touch(std::uint64_t key)
+    {
+        std::unordered_map<std::uint64_t, EntryList::iterator>::iterator it = index.find(key);
+        if(it == index.end())
+        {
+            return std::shared_ptr<const void>();
+        }
+
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->table;
+    }
+
+    // lock held
+    void evict()
+    {
+        while(resident > budget && lru.size() > 1)
+        {
+            const Entry& victim = lru.back();
+            resident -= victim.bytes;
+            index.erase(victim.key);
+            lru.pop_back();
+            stats.evictions++;
+        }
+    }
+
+    mutable std::mutex mutex;
+    std::size_t budget;
+    std::size_t resident;
+    EntryList lru;
+    std::unordered_map<std::uint64_t, EntryList::iterator> index;
+    TableCacheStatistics stats;
+};
+
+/**
+ * Inverse through a budgeted ray table, falling back to the analytic inverse
+ * for non-integer pixels or while the table is evicted.
+ */
+template<typename ModelT>
+class TableBackedInverse
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef RayTable<Scalar> TableT;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TableBackedInverse(TableBudgetCache& c, const ModelT& m) : cache(c), model(m), key(getTableKey(TableKind::Ray, m)) { }
+
+    /**
+     * Pins the table if resident (or rebuilds it if asked to), call once per batch / frame.
+     */
+    inline bool lock(bool rebuild = false)
+    {
+        if(rebuild)
+        {
+            table = cache.getRayTable(model);
+        }
+        else
+        {
+            table = cache.peek<TableT>(key);
+        }
+
+        return static_cast<bool>(table);
+    }
+
+    inline void unlock() { table.reset(); }
+
+    inline bool isTableBacked() const { return static_cast<bool>(table); }
+
+    inline typename ComplexTypes<Scalar>::PointT inverse(Scalar x, Scalar y) const
+    {
+        using std::floor;
+
+        if(table && x >= Scalar(0.0) && y >= Scalar(0.0) && x < Scalar(table->width()) && y < Scalar(table->height()) &&
+           floor(x) == x && floor(y) == y)
+        {
+            const Scalar* ray = (*table)((std::size_t)x, (std::size_t)y);
+            return typename ComplexTypes<Scalar>::PointT(ray[0], ray[1], ray[2]);
+        }
+
+        return model.inverse(x, y);
+    }
+
+    inline const ModelT& getModel() const { return model; }
+
+private:
+    TableBudgetCache& cache;
+    ModelT model;
+    std::uint64_t key;
+    std::shared_ptr<const TableT> table;
+};
+
+/**
+ * Remap lookup through a budgeted remap table, falling back to the analytic
+ * src.forward(pose, dst.inverse(x,y)) while the table is evicted.
+ */
+template<typename DstModelT, typename SrcModelT>
+class TableBackedRemap
+{
+public:
+    typedef typename SrcModelT::Scalar Scalar;
+    typedef RemapTable<Scalar> TableT;
+    typedef typename ComplexTypes<Scalar>::RotationT RotationT;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TableBackedRemap(TableBudgetCache& c, const DstModelT& d, const SrcModelT& s, const RotationT& p = RotationT())
+        : cache(c), dst(d), src(s), pose(p), key(getRemapTableKey(d, s, p)) { }
+
+    inline bool lock(bool rebuild = false)
+    {
+        if(rebuild)
+        {
+            table = cache.getRemapTable(dst, src, pose);
+        }
+        else
+        {
+            table = cache.peek<TableT>(key);
+        }
+
+        return static_cast<bool>(table);
+    }
+
+    inline void unlock() { table.reset(); }
+
+    inline bool isTableBacked() const { return static_cast<bool>(table); }
+
+    inline typename ComplexTypes<Scalar>::PixelT map(std::size_t x, std::size_t y) const
+    {
+        if(table)
+        {
+            const Scalar* pix = (*table)(x, y);
+            return typename ComplexTypes<Scalar>::PixelT(pix[0], pix[1]);
+        }
+
+        const typename ComplexTypes<Scalar>::PointT ray = dst.inverse((Scalar)x, (Scalar)y).template cast<Scalar>();
+        return src.forward(pose, ray);
+    }
+
+private:
+    TableBudgetCache& cache;
+    DstModelT dst;
+    SrcModelT src;
+    RotationT pose;
+    std::uint64_t key;
+    std::shared_ptr<const TableT> table;
+};
+
+}
+
+#endif // CAMERA_TABLE_BUDGET_HPP
@@ -0,0 +1,163 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Build-time embedding of derived camera tables.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TABLE_CODEGEN_HPP
+#define CAMERA_TABLE_CODEGEN_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <ostream>
+#include <sstream>
+
+#include <CameraTables.hpp>
+
+namespace camera
+{
+
+/**
+ * Table compiled into the binary, as emitted by writeEmbeddedTableSource. Constant
+ * initialized, so the data lands in read-only pages shared between processes.
+ */
+template<typename T>
+struct EmbeddedTable
+{
+    std::uint64_t key;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t channels;
+    const T* data;
+};
+
+namespace internal
+{
+
+template<typename T> struct EmbeddedScalarName;
+template<> struct EmbeddedScalarName<std::uint8_t> { static constexpr const char* Name = "std::uint8_t"; static constexpr const char* Suffix = "u"; };
+template<> struct EmbeddedScalarName<float> { static constexpr const char* Name = "float"; static constexpr const char* Suffix = "f"; };
+template<> struct EmbeddedScalarName<double> { static constexpr const char* Name = "double"; static constexpr const char* Suffix = ""; };
+
+template<typename T>
+inline void writeEmbeddedScalar(std::ostream& os, T v)
+{
+    if(std::isnan(v))
+    {
+        os << "std::numeric_limits<" << EmbeddedScalarName<T>::Name << ">::quiet_NaN()";
+    }
+    else if(std::isinf(v))
+    {
+        os << (v < T(0.0) ? "-" : "") << "std::numeric_limits<" << EmbeddedScalarName<T>::Name << ">::infinity()";
+    }
+    else
+    {
+        // integral values need a decimal point to take the suffix
+        std::ostringstream ss;
+        ss.precision(os.precision());
+        ss << v;
+        std::string str = ss.str();
+        if(str.find_first_of(".e") == std::string::npos) { str += ".0"; }
+        os << str << EmbeddedScalarName<T>::Suffix;
+    }
+}
+
+inline void writeEmbeddedScalar(std::ostream& os, std::uint8_t v)
+{
+    os << (unsigned int)v << EmbeddedScalarName<std::uint8_t>::Suffix;
+}
+
+}
+
+/**
+ * Wraps an embedded table without copying. Fails if it was generated for a different
+ * calibration (key) or table type, so stale generated sources are never used silently.
+ */
+template<typename TableT>
+inline bool getEmbeddedTable(const EmbeddedTable<typename TableT::Scalar>& embedded, std::uint64_t key, TableT& table)
+{
+    typedef typename TableT::Scalar Scalar;
+
+    if(embedded.key != key || embedded.channels != TableT::ChannelCount || embedded.data == nullptr)
+    {
+        return false;
+    }
+
+    // the data is in .rodata, the table is read-only
+    std::shared_ptr<const Scalar> mem(embedded.data, [](const Scalar*) { });
+    table = TableT((std::size_t)embedded.width, (std::size_t)embedded.height, mem);
+    return true;
+}
+
+/**
+ * Emits the declaration of an embedded table, for the generated header.
+ */
+template<typename TableT>
+inline void writeEmbeddedTableDeclaration(std::ostream& os, const std::string& name)
+{
+    os << "extern const camera::EmbeddedTable<" << internal::EmbeddedScalarName<typename TableT::Scalar>::Name << "> " << name << ";\n";
+}
+
+/**
+ * Emits the data and the definition of an embedded table, for the generated source.
+ * The source has to include <limits>, <CameraTableCodegen.hpp> and the generated header.
+ */
+template<typename TableT>
+inline void writeEmbeddedTableSource(std::ostream& os, const std::string& name, std::uint64_t key, const TableT& table)
+{
+    typedef typename TableT::Scalar Scalar;
+    static constexpr std::size_t ValuesPerLine = 8;
+
+    const std::streamsize old_precision = os.precision(std::numeric_limits<Scalar>::max_digits10);
+
+    os << "alignas(64) static const " << internal::EmbeddedScalarName<Scalar>::Name << " " << name << "_data[" << table.scalars() << "] =\n{";
+    for(std::size_t i = 0 ; i < table.scalars() ; ++i)
+    {
+        os << (i % ValuesPerLine == 0 ? "\n    " : " ");
+        internal::writeEmbeddedScalar(os, table.data()[i]);
+        if(i + 1 < table.scalars()) { os << ","; }
+    }
+    os << "\n};\n\n";
+
+    os << "const camera::EmbeddedTable<" << internal::EmbeddedScalarName<Scalar>::Name << "> " << name << " = { 0x"
+       << std::hex << key << std::dec << "ull, " << table.width() << "u, " << table.height() << "u, "
+       << TableT::ChannelCount << "u, " << name << "_data };\n\n";
+
+    os.precision(old_precision);
+}
+
+}
+
+#endif // CAMERA_TABLE_CODEGEN_HPP
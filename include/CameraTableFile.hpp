@@ -0,0 +1,297 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Persistent, content addressed storage of derived camera tables.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TABLE_FILE_HPP
+#define CAMERA_TABLE_FILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CAMERA_MODELS_HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // __unix__ || __APPLE__
+
+#include <CameraTables.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+
+template<typename T> struct TableScalarTag;
+template<> struct TableScalarTag<std::uint8_t> { static constexpr std::uint32_t Tag = 0x101; };
+template<> struct TableScalarTag<float> { static constexpr std::uint32_t Tag = 0x204; };
+template<> struct TableScalarTag<double> { static constexpr std::uint32_t Tag = 0x208; };
+
+// unique per writer, so that concurrent saves of one table never share a temporary file
+inline std::string getTemporaryPath(const std::string& path)
+{
+    static std::atomic<std::uint64_t> counter(0);
+    std::string ret = path + ".tmp";
+#ifdef CAMERA_MODELS_HAVE_MMAP
+    ret += std::to_string((long long)::getpid()) + ".";
+#endif // CAMERA_MODELS_HAVE_MMAP
+    return ret + std::to_string((unsigned long long)counter.fetch_add(1));
+}
+
+/**
+ * On disk header, followed by the raw table at DataOffset (page and SIMD friendly).
+ * Files are in host byte order, a foreign byte order is detected and treated as a miss.
+ */
+struct TableFileHeader
+{
+    static constexpr std::uint32_t Magic = 0x4C42544Du; // "MTBL"
+    static constexpr std::uint32_t ByteOrder = 0x01020304u;
+    static constexpr std::uint32_t Version = 1;
+    static constexpr std::uint64_t DataOffset = 4096;
+
+    std::uint32_t magic;
+    std::uint32_t byte_order;
+    std::uint32_t version;
+    std::uint32_t scalar_tag;
+    std::uint32_t channels;
+    std::uint32_t reserved;
+    std::uint64_t width;
+    std::uint64_t height;
+    std::uint64_t key;
+    std::uint64_t data_offset;
+    std::uint64_t data_bytes;
+};
+
+template<typename TableT>
+inline bool headerMatches(const TableFileHeader& hdr, std::uint64_t key)
+{
+    return hdr.magic == TableFileHeader::Magic &&
+           hdr.byte_order == TableFileHeader::ByteOrder &&
+           hdr.version == TableFileHeader::Version &&
+           hdr.scalar_tag == TableScalarTag<typename TableT::Scalar>::Tag &&
+           hdr.channels == TableT::ChannelCount &&
+           hdr.key == key &&
+           hdr.data_offset == TableFileHeader::DataOffset &&
+           hdr.data_bytes == hdr.width * hdr.height * TableT::ChannelCount * sizeof(typename TableT::Scalar);
+}
+
+}
+
+/**
+ * Writes a table to a file, atomically (temporary file + rename).
+ */
+template<typename TableT>
+inline bool saveTable(const std::string& path, std::uint64_t key, const TableT& table)
+{
+    internal::TableFileHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = internal::TableFileHeader::Magic;
+    hdr.byte_order = internal::TableFileHeader::ByteOrder;
+    hdr.version = internal::TableFileHeader::Version;
+    hdr.scalar_tag = internal::TableScalarTag<typename TableT::Scalar>::Tag;
+    hdr.channels = TableT::ChannelCount;
+    hdr.width = table.width();
+    hdr.height = table.height();
+    hdr.key = key;
+    hdr.data_offset = internal::TableFileHeader::DataOffset;
+    hdr.data_bytes = table.bytes();
+
+    const std::string tmp_path = internal::getTemporaryPath(path);
+
+    {
+        std::ofstream ofs(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+        if(!ofs.good())
+        {
+            return false;
+        }
+
+        static const char padding[internal::TableFileHeader::DataOffset] = { 0 };
+        ofs.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        ofs.write(padding, internal::TableFileHeader::DataOffset - sizeof(hdr));
+        ofs.write(reinterpret_cast<const char*>(table.data()), table.bytes());
+
+        if(!ofs.good())
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * Loads a table saved with saveTable. Where available the file is memory mapped read-only,
+ * so loading is constant time and pages are shared between processes, the table is then read-only.
+ */
+template<typename TableT>
+inline bool loadTable(const std::string& path, std::uint64_t key, TableT& table)
+{
+    typedef typename TableT::Scalar Scalar;
+    internal::TableFileHeader hdr;
+
+#ifdef CAMERA_MODELS_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || (std::uint64_t)st.st_size < internal::TableFileHeader::DataOffset ||
+       ::pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+       !internal::headerMatches<TableT>(hdr, key) ||
+       (std::uint64_t)st.st_size != hdr.data_offset + hdr.data_bytes)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    const std::size_t map_size = (std::size_t)st.st_size;
+    void* mapping = ::mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // the pages are read-only, so is the table
+    const Scalar* first = reinterpret_cast<const Scalar*>(static_cast<const char*>(mapping) + hdr.data_offset);
+    std::shared_ptr<const Scalar> mem(first, [mapping, map_size](const Scalar*) { ::munmap(mapping, map_size); });
+    table = TableT((std::size_t)hdr.width, (std::size_t)hdr.height, mem);
+#else // CAMERA_MODELS_HAVE_MMAP
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    if(!ifs.good())
+    {
+        return false;
+    }
+
+    ifs.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if(!ifs.good() || !internal::headerMatches<TableT>(hdr, key))
+    {
+        return false;
+    }
+
+    TableT loaded((std::size_t)hdr.width, (std::size_t)hdr.height);
+    ifs.seekg(hdr.data_offset);
+    ifs.read(reinterpret_cast<char*>(loaded.mutableData()), loaded.bytes());
+    if(!ifs.good())
+    {
+        return false;
+    }
+    table = loaded;
+#endif // CAMERA_MODELS_HAVE_MMAP
+
+    return true;
+}
+
+/**
+ * Directory of tables named after their key. A changed calibration changes the key,
+ * so stale tables are never picked up.
+ */
+class TableFileCache
+{
+public:
+    explicit TableFileCache(const std::string& dir) : directory(dir) { }
+
+    inline const std::string& getDirectory() const { return directory; }
+
+    inline std::string getPath(std::uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.camtbl", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    template<typename TableT>
+    inline bool load(std::uint64_t key, TableT& table) const
+    {
+        return loadTable(getPath(key), key, table);
+    }
+
+    template<typename TableT>
+    inline bool store(std::uint64_t key, const TableT& table) const
+    {
+        return saveTable(getPath(key), key, table);
+    }
+
+    /**
+     * Loads the table, or builds and persists it. Failing to persist is not an error.
+     */
+    template<typename TableT, typename BuilderT>
+    inline TableT getOrBuild(std::uint64_t key, BuilderT builder) const
+    {
+        TableT ret;
+        if(!load(key, ret))
+        {
+            ret = builder();
+            store(key, ret);
+        }
+        return ret;
+    }
+
+    template<typename ModelT>
+    inline RayTable<typename ModelT::Scalar> getRayTable(const ModelT& model) const
+    {
+        return getOrBuild<RayTable<typename ModelT::Scalar>>(getTableKey(TableKind::Ray, model), [&]() { return buildRayTable(model); });
+    }
+
+    template<typename ModelT>
+    inline ValidMaskTable getValidMask(const ModelT& model) const
+    {
+        return getOrBuild<ValidMaskTable>(getTableKey(TableKind::ValidMask, model), [&]() { return buildValidMask(model); });
+    }
+
+    template<typename DstModelT, typename SrcModelT>
+    inline RemapTable<typename SrcModelT::Scalar> getRemapTable(const DstModelT& dst, const SrcModelT& src,
+                                                                const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose = typename ComplexTypes<typename SrcModelT::Scalar>::RotationT()) const
+    {
+        return getOrBuild<RemapTable<typename SrcModelT::Scalar>>(getRemapTableKey(dst, src, pose), [&]() { return buildRemapTable(dst, src, pose); });
+    }
+
+private:
+    std::string directory;
+};
+
+}
+
+#endif // CAMERA_TABLE_FILE_HPP
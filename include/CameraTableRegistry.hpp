@@ -0,0 +1,265 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Process-wide registry sharing identical derived tables.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TABLE_REGISTRY_HPP
+#define CAMERA_TABLE_REGISTRY_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+
+#include <CameraTables.hpp>
+
+namespace camera
+{
+
+namespace internal
+{
+// address of the member identifies the table type without RTTI
+template<typename TableT>
+struct TableTypeTag
+{
+    static const char id;
+};
+
+template<typename TableT>
+const char TableTypeTag<TableT>::id = 0;
+}
+
+/**
+ * Deduplicates tables by key. Handles are shared and read-only, the table is freed
+ * when the last handle goes away. Concurrent requests for a table being built wait
+ * for the single builder instead of building their own copy.
+ */
+class TableRegistry
+{
+public:
+    static TableRegistry& instance()
+    {
+        static TableRegistry registry;
+        return registry;
+    }
+
+    TableRegistry() : inserts_since_purge(0) { }
+    TableRegistry(const TableRegistry&) = delete;
+    TableRegistry& operator=(const TableRegistry&) = delete;
+
+    template<typename TableT, typename BuilderT>
+    std::shared_ptr<const TableT> acquire(std::uint64_t key, BuilderT builder)
+    {
+        const void* type = &internal::TableTypeTag<TableT>::id;
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while(true)
+        {
+            EntryMap::iterator it = entries.find(key);
+            if(it == entries.end())
+            {
+                break;
+            }
+
+            assert(it->second.type == type);
+
+            std::shared_ptr<const void> live = it->second.table.lock();
+            if(live)
+            {
+                return std::static_pointer_cast<const TableT>(live);
+            }
+
+            if(!it->second.building)
+            {
+                break;
+            }
+
+            // someone else is building it
+            std::shared_future<std::shared_ptr<const void>> pending = it->second.pending;
+            lock.unlock();
+            live = pending.get();
+            if(live)
+            {
+                return std::static_pointer_cast<const TableT>(live);
+            }
+            lock.lock();
+        }
+
+        std::promise<std::shared_ptr<const void>> promise;
+        {
+            Entry& entry = entries[key];
+            entry.type = type;
+            entry.bytes = 0;
+            entry.building = true;
+            entry.pending = promise.get_future().share();
+            entry.table.reset();
+        }
+        lock.unlock();
+
+        std::shared_ptr<const TableT> built;
+        try
+        {
+            built = std::make_shared<const TableT>(builder());
+        }
+        catch(...)
+        {
+            lock.lock();
+            entries.erase(key);
+            lock.unlock();
+            promise.set_value(std::shared_ptr<const void>());
+            throw;
+        }
+
+        lock.lock();
+        {
+            Entry& entry = entries[key];
+            entry.table = built;
+            entry.bytes = built->bytes();
+            entry.building = false;
+            entry.pending = std::shared_future<std::shared_ptr<const void>>();
+        }
+
+        if(++inserts_since_purge > entries.size())
+        {
+            purgeExpired();
+        }
+        lock.unlock();
+
+        promise.set_value(built);
+        return built;
+    }
+
+    /**
+     * Live table or null, never builds.
+     */
+    template<typename TableT>
+    std::shared_ptr<const TableT> find(std::uint64_t key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EntryMap::const_iterator it = entries.find(key);
+        if(it == entries.end() || it->second.type != &internal::TableTypeTag<TableT>::id)
+        {
+            return std::shared_ptr<const TableT>();
+        }
+        return std::static_pointer_cast<const TableT>(it->second.table.lock());
+    }
+
+    template<typename ModelT>
+    std::shared_ptr<const RayTable<typename ModelT::Scalar>> getRayTable(const ModelT& model)
+    {
+        return acquire<RayTable<typename ModelT::Scalar>>(getTableKey(TableKind::Ray, model), [&]() { return buildRayTable(model); });
+    }
+
+    template<typename ModelT>
+    std::shared_ptr<const ValidMaskTable> getValidMask(const ModelT& model)
+    {
+        return acquire<ValidMaskTable>(getTableKey(TableKind::ValidMask, model), [&]() { return buildValidMask(model); });
+    }
+
+    template<typename DstModelT, typename SrcModelT>
+    std::shared_ptr<const RemapTable<typename SrcModelT::Scalar>> getRemapTable(const DstModelT& dst, const SrcModelT& src,
+                                                                                const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose = typename ComplexTypes<typename SrcModelT::Scalar>::RotationT())
+    {
+        return acquire<RemapTable<typename SrcModelT::Scalar>>(getRemapTableKey(dst, src, pose), [&]() { return buildRemapTable(dst, src, pose); });
+    }
+
+    /**
+     * Number of tables currently alive.
+     */
+    std::size_t getLiveCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t ret = 0;
+        for(EntryMap::const_iterator it = entries.begin() ; it != entries.end() ; ++it)
+        {
+            if(!it->second.table.expired()) { ++ret; }
+        }
+        return ret;
+    }
+
+    /**
+     * Memory held by the tables currently alive.
+     */
+    std::size_t getResidentBytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t ret = 0;
+        for(EntryMap::const_iterator it = entries.begin() ; it != entries.end() ; ++it)
+        {
+            if(!it->second.table.expired()) { ret += it->second.bytes; }
+        }
+        return ret;
+    }
+
+private:
+    struct Entry
+    {
+        Entry() : type(nullptr), bytes(0), building(false) { }
+
+        const void* type;
+        std::size_t bytes;
+        bool building;
+        std::weak_ptr<const void> table;
+        std::shared_future<std::shared_ptr<const void>> pending;
+    };
+
+    typedef std::unordered_map<std::uint64_t, Entry> EntryMap;
+
+    // lock held
+    void purgeExpired()
+    {
+        for(EntryMap::iterator it = entries.begin() ; it != entries.end() ; )
+        {
+            if(!it->second.building && it->second.table.expired())
+            {
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        inserts_since_purge = 0;
+    }
+
+    mutable std::mutex mutex;
+    EntryMap entries;
+    std::size_t inserts_since_purge;
+};
+
+}
+
+#endif // CAMERA_TABLE_REGISTRY_HPP
@@ -0,0 +1,374 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Per-pixel tables derived from camera models (rays, remaps, masks).
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TABLES_HPP
+#define CAMERA_TABLES_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraModelHash.hpp>
+
+namespace camera
+{
+
+/**
+ * Kind of derived table, part of the table key.
+ */
+enum class TableKind : std::uint32_t
+{
+    Ray = 1,
+    Remap,
+    ValidMask,
+    Radial
+};
+
+/**
+ * Dense row-major width x height table with Channels scalars per pixel.
+ * Storage is reference counted, so copies are shallow and the memory may
+ * come from the heap, a file mapping or a static array alike.
+ * Access is read-only, builders write through mutableData / mutablePixel,
+ * which tables wrapping read-only memory (mappings, .rodata) do not allow.
+ */
+template<typename T, unsigned int Channels>
+class CameraTable
+{
+public:
+    typedef T Scalar;
+    static constexpr unsigned int ChannelCount = Channels;
+
+    CameraTable() : w(0), h(0), read_only(false) { }
+
+    CameraTable(std::size_t width, std::size_t height) : w(width), h(height), storage(allocate(width * height * Channels)), read_only(false) { }
+
+    // wraps externally owned memory, deleter of the shared pointer releases it
+    CameraTable(std::size_t width, std::size_t height, const std::shared_ptr<T>& mem) : w(width), h(height), storage(mem), read_only(false) { }
+
+    // as above, the memory is never written to
+    CameraTable(std::size_t width, std::size_t height, const std::shared_ptr<const T>& mem)
+        : w(width), h(height), storage(std::const_pointer_cast<T>(mem)), read_only(true) { }
+
+    inline std::size_t width() const { return w; }
+    inline std::size_t height() const { return h; }
+    inline std::size_t pixels() const { return w * h; }
+    inline std::size_t scalars() const { return w * h * Channels; }
+    inline std::size_t bytes() const { return scalars() * sizeof(T); }
+    inline bool empty() const { return !storage || pixels() == 0; }
+    inline bool isReadOnly() const { return read_only; }
+
+    inline const T* data() const { return storage.get(); }
+
+    inline const T* operator()(std::size_t x, std::size_t y) const
+    {
+        assert(x < w && y < h);
+        return storage.get() + (y * w + x) * Channels;
+    }
+
+    inline T* mutableData()
+    {
+        assert(!read_only);
+        return read_only ? nullptr : storage.get();
+    }
+
+    inline T* mutablePixel(std::size_t x, std::size_t y)
+    {
+        assert(x < w && y < h);
+        return mutableData() + (y * w + x) * Channels;
+    }
+
+    inline std::shared_ptr<const T> memory() const { return storage; }
+
+private:
+    static inline std::shared_ptr<T> allocate(std::size_t count)
+    {
+        T* ptr = static_cast<T*>(Eigen::internal::aligned_malloc(count * sizeof(T)));
+        return std::shared_ptr<T>(ptr, [](T* p) { Eigen::internal::aligned_free(p); });
+    }
+
+    std::size_t w, h;
+    std::shared_ptr<T> storage;
+    bool read_only;
+};
+
+/**
+ * Unit (or model specific) ray per pixel, as returned by inverse.
+ */
+template<typename T> using RayTable = CameraTable<T,3>;
+
+/**
+ * Source pixel coordinates per destination pixel.
+ */
+template<typename T> using RemapTable = CameraTable<T,2>;
+
+/**
+ * Non-zero where the pixel is valid (square and circular).
+ */
+typedef CameraTable<std::uint8_t,1> ValidMaskTable;
+
+/**
+ * Samples x 1 table of (lateral, z) per normalized distorted radius, see buildRadialTable.
+ */
+template<typename T> using RadialTable = CameraTable<T,2>;
+
+/**
+ * Models whose inverse depends only on the radius of ((x - u0) / fx, (y - v0) / fy).
+ */
+template<CameraModelType cmt> struct RadialSymmetry { static constexpr bool Value = false; };
+template<> struct RadialSymmetry<CameraModelType::Pinhole> { static constexpr bool Value = true; };
+template<> struct RadialSymmetry<CameraModelType::IdealGeneric> { static constexpr bool Value = true; };
+template<> struct RadialSymmetry<CameraModelType::Fisheye> { static constexpr bool Value = true; };
+template<> struct RadialSymmetry<CameraModelType::IdealFisheye> { static constexpr bool Value = true; };
+template<> struct RadialSymmetry<CameraModelType::PinholeDisparity> { static constexpr bool Value = true; };
+
+/**
+ * Key of a table derived from a single model.
+ */
+template<typename ModelT>
+inline std::uint64_t getTableKey(TableKind kind, const ModelT& model)
+{
+    return combineHash(getParameterHash(model), static_cast<std::uint64_t>(kind));
+}
+
+/**
+ * Key of a remap table between two models related by a rotation.
+ */
+template<typename DstModelT, typename SrcModelT>
+inline std::uint64_t getRemapTableKey(const DstModelT& dst, const SrcModelT& src,
+                                      const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose)
+{
+    const typename ComplexTypes<typename SrcModelT::Scalar>::QuaternionT q = pose.unit_quaternion();
+    const std::uint64_t hr = hashScalars(q.coeffs().data(), 4);
+    return combineHash(combineHash(getTableKey(TableKind::Remap, dst), getParameterHash(src)), hr);
+}
+
+/**
+ * Key of a radial table, the sample count is part of it.
+ */
+template<typename ModelT>
+inline std::uint64_t getRadialTableKey(const ModelT& model, std::size_t samples)
+{
+    return combineHash(getTableKey(TableKind::Radial, model), static_cast<std::uint64_t>(samples));
+}
+
+/**
+ * Ray table, inverse evaluated at integer pixel coordinates.
+ */
+template<typename ModelT>
+inline RayTable<typename ModelT::Scalar> buildRayTable(const ModelT& model)
+{
+    typedef typename ModelT::Scalar Scalar;
+
+    RayTable<Scalar> ret((std::size_t)model.width(), (std::size_t)model.height());
+
+    for(std::size_t y = 0 ; y < ret.height() ; ++y)
+    {
+        for(std::size_t x = 0 ; x < ret.width() ; ++x)
+        {
+            const typename ComplexTypes<Scalar>::PointT ray = model.inverse((Scalar)x, (Scalar)y);
+            Scalar* out = ret.mutablePixel(x,y);
+            out[0] = ray(0);
+            out[1] = ray(1);
+            out[2] = ray(2);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Ray at a sub-pixel position, bilinear between the table samples. Coordinates are
+ * clamped to the table, between samples the ray is not exactly unit length.
+ */
+template<typename T>
+inline typename ComplexTypes<T>::PointT sampleRayTable(const RayTable<T>& table, T x, T y)
+{
+    using std::floor;
+
+    const T xc = x < T(0.0) ? T(0.0) : (x > T(table.width() - 1) ? T(table.width() - 1) : x);
+    const T yc = y < T(0.0) ? T(0.0) : (y > T(table.height() - 1) ? T(table.height() - 1) : y);
+    const std::size_t x0 = (std::size_t)floor(xc), y0 = (std::size_t)floor(yc);
+    const std::size_t x1 = x0 + 1 < table.width() ? x0 + 1 : x0, y1 = y0 + 1 < table.height() ? y0 + 1 : y0;
+    const T ax = xc - T(x0), ay = yc - T(y0);
+
+    const T* r00 = table(x0,y0);
+    const T* r10 = table(x1,y0);
+    const T* r01 = table(x0,y1);
+    const T* r11 = table(x1,y1);
+
+    typename ComplexTypes<T>::PointT ret;
+    for(int c = 0 ; c < 3 ; ++c)
+    {
+        const T top = r00[c] + ax * (r10[c] - r00[c]);
+        const T bottom = r01[c] + ax * (r11[c] - r01[c]);
+        ret(c) = top + ay * (bottom - top);
+    }
+    return ret;
+}
+
+/**
+ * Remap table from dst viewport to src pixels, pose is the src camera in the dst frame
+ * (same convention as forward(pose, pt)). Coordinates outside the source image are kept as is.
+ */
+template<typename DstModelT, typename SrcModelT>
+inline RemapTable<typename SrcModelT::Scalar> buildRemapTable(const DstModelT& dst, const SrcModelT& src,
+                                                              const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose)
+{
+    typedef typename SrcModelT::Scalar Scalar;
+
+    RemapTable<Scalar> ret((std::size_t)dst.width(), (std::size_t)dst.height());
+
+    for(std::size_t y = 0 ; y < ret.height() ; ++y)
+    {
+        for(std::size_t x = 0 ; x < ret.width() ; ++x)
+        {
+            const typename ComplexTypes<Scalar>::PointT ray = dst.inverse((Scalar)x, (Scalar)y).template cast<Scalar>();
+            const typename ComplexTypes<Scalar>::PixelT pix = src.forward(pose, ray);
+            Scalar* out = ret.mutablePixel(x,y);
+            out[0] = pix(0);
+            out[1] = pix(1);
+        }
+    }
+
+    return ret;
+}
+
+template<typename DstModelT, typename SrcModelT>
+inline RemapTable<typename SrcModelT::Scalar> buildRemapTable(const DstModelT& dst, const SrcModelT& src)
+{
+    return buildRemapTable(dst, src, typename ComplexTypes<typename SrcModelT::Scalar>::RotationT());
+}
+
+/**
+ * Valid pixel mask.
+ */
+template<typename ModelT>
+inline ValidMaskTable buildValidMask(const ModelT& model)
+{
+    typedef typename ModelT::Scalar Scalar;
+
+    ValidMaskTable ret((std::size_t)model.width(), (std::size_t)model.height());
+
+    for(std::size_t y = 0 ; y < ret.height() ; ++y)
+    {
+        for(std::size_t x = 0 ; x < ret.width() ; ++x)
+        {
+            const bool valid = model.pixelValidSquare((Scalar)x, (Scalar)y) && model.pixelValidCircular((Scalar)x, (Scalar)y);
+            *ret.mutablePixel(x,y) = valid ? 1 : 0;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Spacing of the radial table samples, the last sample reaches the farthest image corner.
+ */
+template<typename ModelT>
+inline typename ModelT::Scalar getRadialTableStep(const ModelT& model, std::size_t samples)
+{
+    typedef typename ModelT::Scalar Scalar;
+    using std::sqrt;
+    using std::max;
+
+    const Scalar dx = max(model.u0(), model.width() - model.u0()) / model.fx();
+    const Scalar dy = max(model.v0(), model.height() - model.v0()) / model.fy();
+    return sqrt(dx * dx + dy * dy) / Scalar(samples - 1);
+}
+
+/**
+ * 1D inverse of a radially symmetric model. Sample i holds (lateral, z) for the normalized
+ * distorted radius i * step, the ray of (mx, my) is then (mx * lateral, my * lateral, z).
+ * Being evaluated through inverse, it matches whatever the model returns (unit vector or z = 1).
+ */
+template<typename ModelT>
+inline RadialTable<typename ModelT::Scalar> buildRadialTable(const ModelT& model, std::size_t samples = 1024)
+{
+    typedef typename ModelT::Scalar Scalar;
+    static_assert(RadialSymmetry<ModelT::ModelType>::Value, "Model is not radially symmetric");
+    assert(samples > 1);
+
+    RadialTable<Scalar> ret(samples, 1);
+    const Scalar step = getRadialTableStep(model, samples);
+
+    for(std::size_t i = 0 ; i < samples ; ++i)
+    {
+        // lateral is a ratio, take the limit at the centre from a nearby radius
+        const Scalar rd = i > 0 ? Scalar(i) * step : step * Scalar(1e-3);
+        const typename ComplexTypes<Scalar>::PointT ray = model.inverse(model.u0() + rd * model.fx(), model.v0());
+        Scalar* out = ret.mutablePixel(i,0);
+        out[0] = ray(0) / rd;
+        out[1] = ray(2);
+    }
+
+    return ret;
+}
+
+/**
+ * Inverse through a radial table, linear interpolation between samples. Radii past the
+ * last sample are clamped.
+ */
+template<typename ModelT>
+inline typename ComplexTypes<typename ModelT::Scalar>::PointT inverseRadial(const RadialTable<typename ModelT::Scalar>& table, const ModelT& model,
+                                                                             typename ModelT::Scalar x, typename ModelT::Scalar y)
+{
+    typedef typename ModelT::Scalar Scalar;
+    using std::sqrt;
+    using std::floor;
+
+    const Scalar mx = (x - model.u0()) / model.fx();
+    const Scalar my = (y - model.v0()) / model.fy();
+    const Scalar last = Scalar(table.width() - 1);
+    Scalar pos = sqrt(mx * mx + my * my) / getRadialTableStep(model, table.width());
+    if(pos > last) { pos = last; }
+
+    const std::size_t i0 = (std::size_t)floor(pos);
+    const std::size_t i1 = i0 + 1 < table.width() ? i0 + 1 : i0;
+    const Scalar a = pos - Scalar(i0);
+    const Scalar* s0 = table(i0,0);
+    const Scalar* s1 = table(i1,0);
+    const Scalar lateral = s0[0] + a * (s1[0] - s0[0]);
+    const Scalar z = s0[1] + a * (s1[1] - s0[1]);
+
+    return typename ComplexTypes<Scalar>::PointT(mx * lateral, my * lateral, z);
+}
+
+}
+
+#endif // CAMERA_TABLES_HPP
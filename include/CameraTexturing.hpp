@@ -0,0 +1,469 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Multi-camera mesh texturing with best view selection.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TEXTURING_HPP
+#define CAMERA_TEXTURING_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraBatch.hpp>
+#include <CameraThreads.hpp>
+#include <CameraProjectedView.hpp>
+
+namespace camera
+{
+
+/**
+ * Result of MeshTexturer::texture. The atlas holds the view images unchanged in a grid
+ * of cells (max view width x max view height), view v at getViewOffset(v). UVs are
+ * normalised atlas coordinates, 3 per triangle, pixel (x,y) of a view maps to its centre.
+ */
+struct MeshTexture
+{
+    enum : std::int32_t { NoView = -1 };
+    
+    MeshTexture() : atlas_width(0), atlas_height(0), atlas_columns(0), cell_width(0), cell_height(0), textured(0), iterations(0) { }
+    
+    inline std::size_t getViewOffsetX(std::size_t view) const { return (view % atlas_columns) * cell_width; }
+    inline std::size_t getViewOffsetY(std::size_t view) const { return (view / atlas_columns) * cell_height; }
+    
+    std::vector<std::int32_t> labels;
+    std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f>> uvs;
+    std::size_t atlas_width, atlas_height, atlas_columns;
+    std::size_t cell_width, cell_height;
+    std::size_t textured;   // triangles with a view
+    std::size_t iterations; // of the smoothing
+};
+
+/**
+ * Picks for every triangle of a mesh the camera (any models, mixed) that sees it best.
+ * A view scores a triangle with its projected area in pixels, through the model so distortion
+ * counts, when all three vertices project Ok, the triangle is not more grazing than min_cosine
+ * and its vertices and centroid are not behind the view's depth by more than depth_tolerance
+ * (relative). Depth (range per pixel) is either given or rendered from the mesh itself,
+ * interpolating range linearly over the projected triangles (an approximation, fine for small triangles).
+ * Views are then selected minimising sum of (1 - score / best score) per triangle plus
+ * smoothness for every pair of edge-adjacent triangles with different views, with iterated
+ * conditional modes, so seams gather along few edges. A triangle keeps at most 3 neighbours
+ * (on non-manifold edges pairs are dropped when either triangle is full), so a greedy colouring
+ * gives adjacent triangles different colours out of 4, and a sweep updates one colour at a time, in parallel. No update increases the energy, so the labels
+ * settle (unless max_iterations sweeps run out first) and do not depend on the thread count.
+ */
+template<typename T>
+class MeshTexturer
+{
+public:
+    typedef typename ComplexTypes<T>::PointT PointT;
+    typedef typename ComplexTypes<T>::PixelT PixelT;
+    typedef typename ComplexTypes<T>::TransformT TransformT;
+    static constexpr std::uint32_t NoNeighbour = 0xFFFFFFFFu;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    explicit MeshTexturer(unsigned int thread_count = 0, T smoothness = T(0.5), T depth_tolerance = T(0.02),
+                          T min_cosine = T(0.1), std::size_t max_iterations = 10)
+        : threads(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency())),
+          smooth(smoothness), tolerance(depth_tolerance), min_cos(min_cosine), iterations(max_iterations)
+    {
+    }
+    
+    inline std::size_t getViewCount() const { return views.size(); }
+    inline void clearViews() { views.clear(); }
+    
+    /**
+     * Adds a view, pose is camera to world, depth (range, row stride in pixels, 0: width) can be null.
+     */
+    template<typename ModelT>
+    std::size_t addView(const ModelT& model, const TransformT& pose, const float* depth = nullptr, std::size_t stride = 0)
+    {
+        views.push_back(View(model, pose, depth, stride));
+        return views.size() - 1;
+    }
+    
+    /**
+     * Textures the mesh, indices are 3 per triangle.
+     */
+    template<typename InT>
+    void texture(const StridedView<InT,3>& vertices, const std::uint32_t* indices, std::size_t triangle_count, MeshTexture& out)
+    {
+        const std::size_t vertex_count = vertices.size(), view_count = views.size();
+        
+        // vertices followed by the triangle centroids, projected together
+        world.resize(vertex_count + triangle_count);
+        pixels.resize(world.size());
+        status.resize(world.size());
+        scores.assign(triangle_count * view_count, 0.0f);
+        
+        forChunks(vertex_count, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin ; i < end ; ++i) { world[i] = PointT(T(vertices(i, 0)), T(vertices(i, 1)), T(vertices(i, 2))); }
+        });
+        forChunks(triangle_count, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t t = begin ; t < end ; ++t)
+            {
+                world[vertex_count + t] = (world[indices[3 * t]] + world[indices[3 * t + 1]] + world[indices[3 * t + 2]]) / T(3.0);
+            }
+        });
+        
+        for(std::size_t v = 0 ; v < view_count ; ++v)
+        {
+            const View& view = views[v];
+            forChunks(world.size(), [&](std::size_t begin, std::size_t end)
+            {
+                view.project(makePointView(world.data() + begin, end - begin), makePixelView(pixels.data() + begin, end - begin), status.data() + begin);
+            });
+            
+            if(view.depth == nullptr)
+            {
+                renderDepth(view, indices, triangle_count);
+            }
+            
+            forChunks(triangle_count, [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t t = begin ; t < end ; ++t)
+                {
+                    scores[t * view_count + v] = score(view, indices + 3 * t, vertex_count + t);
+                }
+            });
+        }
+        
+        buildAdjacency(indices, triangle_count);
+        selectViews(triangle_count, out);
+        generateUVs(indices, triangle_count, out);
+    }
+    
+private:
+    typedef internal::ProjectedView<T> View;
+    
+    template<typename FunctionT>
+    inline void forChunks(std::size_t count, FunctionT fn) const
+    {
+        const std::size_t chunk = (count + threads - 1) / threads;
+        internal::runOnThreads(threads, [&](unsigned int t)
+        {
+            const std::size_t begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+            fn(begin, end);
+        });
+    }
+    
+    // occluders partly outside the image still count, the raster is clamped to it
+    inline bool isRasterisable(std::size_t i) const
+    {
+        return status[i] == ProjectionStatus::Ok || status[i] == ProjectionStatus::OutsideImage;
+    }
+    
+    void renderDepth(const View& view, const std::uint32_t* indices, std::size_t triangle_count)
+    {
+        using std::floor;
+        using std::ceil;
+        
+        zbuffer.reset(view.width, view.height);
+        
+        forChunks(triangle_count, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t t = begin ; t < end ; ++t)
+            {
+                const std::uint32_t* tri = indices + 3 * t;
+                if(!isRasterisable(tri[0]) || !isRasterisable(tri[1]) || !isRasterisable(tri[2])) { continue; }
+                
+                const PixelT& p0 = pixels[tri[0]];
+                const PixelT& p1 = pixels[tri[1]];
+                const PixelT& p2 = pixels[tri[2]];
+                const T area = (p1(0) - p0(0)) * (p2(1) - p0(1)) - (p2(0) - p0(0)) * (p1(1) - p0(1));
+                if(area == T(0.0)) { continue; }
+                
+                const T r0 = (world[tri[0]] - view.centre).norm(), r1 = (world[tri[1]] - view.centre).norm(), r2 = (world[tri[2]] - view.centre).norm();
+                const T x0 = std::max(ceil(std::min(std::min(p0(0), p1(0)), p2(0))), T(0.0));
+                const T x1 = std::min(floor(std::max(std::max(p0(0), p1(0)), p2(0))), T(view.width) - T(1.0));
+                const T y0 = std::max(ceil(std::min(std::min(p0(1), p1(1)), p2(1))), T(0.0));
+                const T y1 = std::min(floor(std::max(std::max(p0(1), p1(1)), p2(1))), T(view.height) - T(1.0));
+                
+                for(T y = y0 ; y <= y1 ; y += T(1.0))
+                {
+                    for(T x = x0 ; x <= x1 ; x += T(1.0))
+                    {
+                        const T b1 = ((x - p0(0)) * (p2(1) - p0(1)) - (p2(0) - p0(0)) * (y - p0(1))) / area;
+                        const T b2 = ((p1(0) - p0(0)) * (y - p0(1)) - (x - p0(0)) * (p1(1) - p0(1))) / area;
+                        const T b0 = T(1.0) - b1 - b2;
+                        if(b0 < T(0.0) || b1 < T(0.0) || b2 < T(0.0)) { continue; }
+                        
+                        zbuffer.write((std::size_t)x, (std::size_t)y, float(b0 * r0 + b1 * r1 + b2 * r2));
+                    }
+                }
+            }
+        });
+    }
+    
+    inline bool isVisible(const View& view, std::size_t i) const
+    {
+        std::size_t u, v;
+        if(!view.getPixel(pixels[i], status[i], u, v)) { return false; }
+        return (world[i] - view.centre).norm() <= T(view.getRange(zbuffer, u, v)) * (T(1.0) + tolerance);
+    }
+    
+    inline float score(const View& view, const std::uint32_t* tri, std::size_t centroid) const
+    {
+        using std::abs;
+        
+        if(!isVisible(view, tri[0]) || !isVisible(view, tri[1]) || !isVisible(view, tri[2]) || !isVisible(view, centroid)) { return 0.0f; }
+        
+        const PointT normal = (world[tri[1]] - world[tri[0]]).cross(world[tri[2]] - world[tri[0]]);
+        const PointT to_camera = view.centre - world[centroid];
+        const T cosine = abs(normal.dot(to_camera)) / (normal.norm() * to_camera.norm());
+        if(!(cosine >= min_cos)) { return 0.0f; }
+        
+        const PixelT e1 = pixels[tri[1]] - pixels[tri[0]], e2 = pixels[tri[2]] - pixels[tri[0]];
+        return float(abs(e1(0) * e2(1) - e2(0) * e1(1)) * T(0.5));
+    }
+    
+    // triangles sharing an edge, up to 3 per triangle
+    void buildAdjacency(const std::uint32_t* indices, std::size_t triangle_count)
+    {
+        edges.resize(triangle_count * 3);
+        for(std::size_t t = 0 ; t < triangle_count ; ++t)
+        {
+            for(std::size_t e = 0 ; e < 3 ; ++e)
+            {
+                const std::uint64_t a = indices[3 * t + e], b = indices[3 * t + (e + 1) % 3];
+                edges[3 * t + e] = Edge((std::min(a, b) << 32) | std::max(a, b), (std::uint32_t)t);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        
+        neighbours.assign(triangle_count * 3, NoNeighbour);
+        for(std::size_t i = 0 ; i + 1 < edges.size() ; ++i)
+        {
+            if(edges[i].key != edges[i + 1].key) { continue; }
+            addNeighbours(edges[i].triangle, edges[i + 1].triangle);
+        }
+    }
+    
+    // both or neither, the colouring relies on the adjacency being symmetric
+    inline void addNeighbours(std::uint32_t a, std::uint32_t b)
+    {
+        std::size_t ka = 0, kb = 0;
+        while(ka < 3 && neighbours[3 * a + ka] != NoNeighbour) { ka++; }
+        while(kb < 3 && neighbours[3 * b + kb] != NoNeighbour) { kb++; }
+        if(ka == 3 || kb == 3) { return; }
+        
+        neighbours[3 * a + ka] = b;
+        neighbours[3 * b + kb] = a;
+    }
+    
+    void selectViews(std::size_t triangle_count, MeshTexture& out)
+    {
+        const std::size_t view_count = views.size();
+        
+        best.resize(triangle_count);
+        out.labels.resize(triangle_count);
+        forChunks(triangle_count, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t t = begin ; t < end ; ++t)
+            {
+                std::int32_t label = MeshTexture::NoView;
+                float top = 0.0f;
+                for(std::size_t v = 0 ; v < view_count ; ++v)
+                {
+                    if(scores[t * view_count + v] > top) { top = scores[t * view_count + v]; label = (std::int32_t)v; }
+                }
+                best[t] = top;
+                out.labels[t] = label;
+            }
+        });
+        
+        out.iterations = 0;
+        if(!(smooth > T(0.0))) { return; }
+        
+        colourTriangles(triangle_count);
+        for(std::size_t it = 0 ; it < iterations ; ++it)
+        {
+            // neighbours are in other classes, so a class reads labels no one writes meanwhile
+            std::atomic<std::size_t> changed(0);
+            for(std::size_t cls = 0 ; cls + 1 < class_begin.size() ; ++cls)
+            {
+                const std::size_t first = class_begin[cls];
+                forChunks(class_begin[cls + 1] - first, [&](std::size_t begin, std::size_t end)
+                {
+                    std::size_t local_changed = 0;
+                    for(std::size_t k = first + begin ; k < first + end ; ++k)
+                    {
+                        const std::uint32_t t = order[k];
+                        if(out.labels[t] == MeshTexture::NoView) { continue; }
+                        
+                        std::int32_t label = out.labels[t];
+                        T lowest = cost(t, label, out.labels);
+                        for(std::size_t v = 0 ; v < view_count ; ++v)
+                        {
+                            if(!(scores[t * view_count + v] > 0.0f)) { continue; }
+                            const T c = cost(t, (std::int32_t)v, out.labels);
+                            if(c < lowest) { lowest = c; label = (std::int32_t)v; }
+                        }
+                        if(label != out.labels[t]) { out.labels[t] = label; local_changed++; }
+                    }
+                    changed.fetch_add(local_changed);
+                });
+            }
+            
+            out.iterations++;
+            if(changed.load() == 0) { break; }
+        }
+    }
+    
+    // greedy colouring of the adjacency, then the triangles ordered by colour
+    void colourTriangles(std::size_t triangle_count)
+    {
+        colours.assign(triangle_count, 0);
+        std::size_t counts[4] = { 0, 0, 0, 0 };
+        for(std::size_t t = 0 ; t < triangle_count ; ++t)
+        {
+            bool used[4] = { false, false, false, false };
+            for(std::size_t k = 0 ; k < 3 ; ++k)
+            {
+                const std::uint32_t n = neighbours[3 * t + k];
+                if(n != NoNeighbour && n < t) { used[colours[n]] = true; }
+            }
+            std::uint8_t c = 0;
+            while(used[c]) { ++c; }
+            colours[t] = c;
+            counts[c]++;
+        }
+        
+        class_begin.assign(5, 0);
+        for(std::size_t c = 0 ; c < 4 ; ++c) { class_begin[c + 1] = class_begin[c] + counts[c]; }
+        std::size_t fill[4] = { class_begin[0], class_begin[1], class_begin[2], class_begin[3] };
+        order.resize(triangle_count);
+        for(std::size_t t = 0 ; t < triangle_count ; ++t) { order[fill[colours[t]]++] = (std::uint32_t)t; }
+    }
+    
+    inline T cost(std::size_t t, std::int32_t label, const std::vector<std::int32_t>& labels) const
+    {
+        T ret = T(1.0) - T(scores[t * views.size() + label] / best[t]);
+        for(std::size_t k = 0 ; k < 3 ; ++k)
+        {
+            const std::uint32_t n = neighbours[3 * t + k];
+            if(n != NoNeighbour && labels[n] != MeshTexture::NoView && labels[n] != label) { ret += smooth; }
+        }
+        return ret;
+    }
+    
+    void generateUVs(const std::uint32_t* indices, std::size_t triangle_count, MeshTexture& out)
+    {
+        out.cell_width = 0;
+        out.cell_height = 0;
+        for(std::size_t v = 0 ; v < views.size() ; ++v)
+        {
+            out.cell_width = std::max(out.cell_width, views[v].width);
+            out.cell_height = std::max(out.cell_height, views[v].height);
+        }
+        out.atlas_columns = std::max<std::size_t>(1, (std::size_t)std::ceil(std::sqrt(double(views.size()))));
+        out.atlas_width = out.atlas_columns * out.cell_width;
+        out.atlas_height = ((views.size() + out.atlas_columns - 1) / out.atlas_columns) * out.cell_height;
+        
+        // the per view pixels are gone, project the selected vertices again
+        out.uvs.assign(triangle_count * 3, Eigen::Vector2f::Zero());
+        std::atomic<std::size_t> textured(0);
+        forChunks(triangle_count, [&](std::size_t begin, std::size_t end)
+        {
+            std::size_t local_textured = 0;
+            PointT corners[3];
+            PixelT projected[3];
+            ProjectionStatus corner_status[3];
+            for(std::size_t t = begin ; t < end ; ++t)
+            {
+                if(out.labels[t] == MeshTexture::NoView) { continue; }
+                
+                const std::size_t v = (std::size_t)out.labels[t];
+                for(std::size_t k = 0 ; k < 3 ; ++k) { corners[k] = world[indices[3 * t + k]]; }
+                views[v].project(makePointView(static_cast<const PointT*>(corners), 3), makePixelView(projected, 3), corner_status);
+                
+                const float ox = float(out.getViewOffsetX(v)), oy = float(out.getViewOffsetY(v));
+                for(std::size_t k = 0 ; k < 3 ; ++k)
+                {
+                    out.uvs[3 * t + k] = Eigen::Vector2f((ox + float(projected[k](0)) + 0.5f) / float(out.atlas_width),
+                                                         (oy + float(projected[k](1)) + 0.5f) / float(out.atlas_height));
+                }
+                local_textured++;
+            }
+            textured.fetch_add(local_textured);
+        });
+        out.textured = textured.load();
+    }
+    
+    struct Edge
+    {
+        Edge(std::uint64_t k = 0, std::uint32_t t = 0) : key(k), triangle(t) { }
+        inline bool operator<(const Edge& other) const { return key < other.key || (key == other.key && triangle < other.triangle); }
+        
+        std::uint64_t key;
+        std::uint32_t triangle;
+    };
+    
+    unsigned int threads;
+    T smooth;
+    T tolerance;
+    T min_cos;
+    std::size_t iterations;
+    std::vector<View, Eigen::aligned_allocator<View>> views;
+    
+    // scratch, kept between calls
+    std::vector<PointT, Eigen::aligned_allocator<PointT>> world;
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> pixels;
+    std::vector<ProjectionStatus> status;
+    std::vector<float> scores;
+    std::vector<float> best;
+    std::vector<Edge> edges;
+    std::vector<std::uint32_t> neighbours;
+    std::vector<std::uint8_t> colours;
+    std::vector<std::uint32_t> order;
+    std::vector<std::size_t> class_begin;
+    internal::RangeBuffer zbuffer;
+};
+
+template<typename T>
+constexpr std::uint32_t MeshTexturer<T>::NoNeighbour;
+
+}
+
+#endif // CAMERA_TEXTURING_HPP
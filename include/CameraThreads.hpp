@@ -0,0 +1,86 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Fork-join helper shared by the multi-threaded batch modules.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_THREADS_HPP
+#define CAMERA_THREADS_HPP
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+namespace camera
+{
+
+namespace internal
+{
+
+// restricts a thread to a set of CPUs, false if not supported or failed
+inline bool setCpuAffinity(std::thread::native_handle_type th, const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    if(cpus.empty()) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(std::size_t i = 0 ; i < cpus.size() ; ++i) { CPU_SET(cpus[i], &set); }
+    return pthread_setaffinity_np(th, sizeof(set), &set) == 0;
+#else // __linux__
+    (void)th; (void)cpus;
+    return false;
+#endif // __linux__
+}
+
+// spawns threads - 1 helpers, the caller is thread 0
+template<typename FunctionT>
+inline void runOnThreads(unsigned int threads, FunctionT fn)
+{
+    std::vector<std::thread> helpers;
+    for(unsigned int t = 1 ; t < threads ; ++t)
+    {
+        helpers.push_back(std::thread(fn, t));
+    }
+    fn(0u);
+    for(std::size_t t = 0 ; t < helpers.size() ; ++t) { helpers[t].join(); }
+}
+
+}
+
+}
+
+#endif // CAMERA_THREADS_HPP
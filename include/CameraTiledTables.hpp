@@ -0,0 +1,279 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Lazily materialised tiled tables derived from camera models.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TILED_TABLES_HPP
+#define CAMERA_TILED_TABLES_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <CameraTables.hpp>
+
+namespace camera
+{
+
+/**
+ * Table split into TileSize x TileSize tiles, each generated on first access.
+ * Tiles are published lock-free: a thread missing a tile generates it into its own
+ * buffer and installs it with a compare-exchange, the loser of a race frees its copy.
+ * Generator is a functor (x, y, T* out) filling Channels scalars of one pixel.
+ */
+template<typename T, unsigned int Channels, typename GeneratorT>
+class TiledCameraTable
+{
+public:
+    typedef T Scalar;
+    static constexpr unsigned int ChannelCount = Channels;
+    static constexpr std::size_t TileSize = 64;
+    static constexpr std::size_t TileScalars = TileSize * TileSize * Channels;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TiledCameraTable(std::size_t width, std::size_t height, const GeneratorT& g)
+        : w(width), h(height), tiles_x((width + TileSize - 1) / TileSize), tiles_y((height + TileSize - 1) / TileSize),
+          generator(g), tiles(new std::atomic<T*>[tiles_x * tiles_y]), materialised(0)
+    {
+        for(std::size_t i = 0 ; i < tiles_x * tiles_y ; ++i)
+        {
+            tiles[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~TiledCameraTable()
+    {
+        for(std::size_t i = 0 ; i < tiles_x * tiles_y ; ++i)
+        {
+            Eigen::internal::aligned_free(tiles[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    TiledCameraTable(const TiledCameraTable&) = delete;
+    TiledCameraTable& operator=(const TiledCameraTable&) = delete;
+
+    inline std::size_t width() const { return w; }
+    inline std::size_t height() const { return h; }
+    inline std::size_t getTilesX() const { return tiles_x; }
+    inline std::size_t getTilesY() const { return tiles_y; }
+    inline std::size_t getMaterialisedTiles() const { return materialised.load(std::memory_order_relaxed); }
+    inline std::size_t bytes() const { return getMaterialisedTiles() * TileScalars * sizeof(T); }
+
+    /**
+     * Channels of the pixel, materialising its tile if needed.
+     */
+    inline const T* operator()(std::size_t x, std::size_t y) const
+    {
+        assert(x < w && y < h);
+        const T* tile = getTile(x / TileSize, y / TileSize);
+        return tile + ((y % TileSize) * TileSize + (x % TileSize)) * Channels;
+    }
+
+    /**
+     * Tile data, row stride is TileSize pixels.
+     */
+    inline const T* getTile(std::size_t tx, std::size_t ty) const
+    {
+        assert(tx < tiles_x && ty < tiles_y);
+        std::atomic<T*>& slot = tiles[ty * tiles_x + tx];
+
+        T* tile = slot.load(std::memory_order_acquire);
+        if(tile != nullptr)
+        {
+            return tile;
+        }
+
+        T* fresh = static_cast<T*>(Eigen::internal::aligned_malloc(TileScalars * sizeof(T)));
+        generateTile(tx, ty, fresh);
+
+        T* expected = nullptr;
+        if(slot.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            materialised.fetch_add(1, std::memory_order_relaxed);
+            return fresh;
+        }
+
+        // lost the race, use the published one
+        Eigen::internal::aligned_free(fresh);
+        return expected;
+    }
+
+    inline bool isTileMaterialised(std::size_t tx, std::size_t ty) const
+    {
+        return tiles[ty * tiles_x + tx].load(std::memory_order_acquire) != nullptr;
+    }
+
+    /**
+     * Materialises all tiles overlapping the region, e.g. ahead of processing an ROI.
+     */
+    inline void materialise(std::size_t x0, std::size_t y0, std::size_t rw, std::size_t rh) const
+    {
+        if(rw == 0 || rh == 0 || x0 >= w || y0 >= h) { return; }
+
+        const std::size_t x1 = std::min(x0 + rw, w) - 1, y1 = std::min(y0 + rh, h) - 1;
+        for(std::size_t ty = y0 / TileSize ; ty <= y1 / TileSize ; ++ty)
+        {
+            for(std::size_t tx = x0 / TileSize ; tx <= x1 / TileSize ; ++tx)
+            {
+                getTile(tx, ty);
+            }
+        }
+    }
+
+    inline const GeneratorT& getGenerator() const { return generator; }
+
+private:
+    inline void generateTile(std::size_t tx, std::size_t ty, T* out) const
+    {
+        const std::size_t x0 = tx * TileSize, y0 = ty * TileSize;
+        const std::size_t x1 = std::min(x0 + TileSize, w), y1 = std::min(y0 + TileSize, h);
+
+        for(std::size_t y = y0 ; y < y1 ; ++y)
+        {
+            T* row = out + (y - y0) * TileSize * Channels;
+            for(std::size_t x = x0 ; x < x1 ; ++x)
+            {
+                generator(x, y, row + (x - x0) * Channels);
+            }
+        }
+    }
+
+    std::size_t w, h, tiles_x, tiles_y;
+    GeneratorT generator;
+    std::unique_ptr<std::atomic<T*>[]> tiles;
+    mutable std::atomic<std::size_t> materialised;
+};
+
+/**
+ * Generates rays, see buildRayTable.
+ */
+template<typename ModelT>
+struct RayTileGenerator
+{
+    typedef typename ModelT::Scalar Scalar;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit RayTileGenerator(const ModelT& m) : model(m) { }
+
+    inline void operator()(std::size_t x, std::size_t y, Scalar* out) const
+    {
+        const typename ComplexTypes<Scalar>::PointT ray = model.inverse((Scalar)x, (Scalar)y);
+        out[0] = ray(0);
+        out[1] = ray(1);
+        out[2] = ray(2);
+    }
+
+    ModelT model;
+};
+
+/**
+ * Generates remap coordinates, see buildRemapTable.
+ */
+template<typename DstModelT, typename SrcModelT>
+struct RemapTileGenerator
+{
+    typedef typename SrcModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::RotationT RotationT;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    RemapTileGenerator(const DstModelT& d, const SrcModelT& s, const RotationT& p) : dst(d), src(s), pose(p) { }
+
+    inline void operator()(std::size_t x, std::size_t y, Scalar* out) const
+    {
+        const typename ComplexTypes<Scalar>::PointT ray = dst.inverse((Scalar)x, (Scalar)y).template cast<Scalar>();
+        const typename ComplexTypes<Scalar>::PixelT pix = src.forward(pose, ray);
+        out[0] = pix(0);
+        out[1] = pix(1);
+    }
+
+    DstModelT dst;
+    SrcModelT src;
+    RotationT pose;
+};
+
+/**
+ * Generates the valid pixel mask, see buildValidMask.
+ */
+template<typename ModelT>
+struct ValidMaskTileGenerator
+{
+    typedef typename ModelT::Scalar Scalar;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit ValidMaskTileGenerator(const ModelT& m) : model(m) { }
+
+    inline void operator()(std::size_t x, std::size_t y, std::uint8_t* out) const
+    {
+        out[0] = (model.pixelValidSquare((Scalar)x, (Scalar)y) && model.pixelValidCircular((Scalar)x, (Scalar)y)) ? 1 : 0;
+    }
+
+    ModelT model;
+};
+
+template<typename ModelT>
+using TiledRayTable = TiledCameraTable<typename ModelT::Scalar, 3, RayTileGenerator<ModelT>>;
+
+template<typename DstModelT, typename SrcModelT>
+using TiledRemapTable = TiledCameraTable<typename SrcModelT::Scalar, 2, RemapTileGenerator<DstModelT,SrcModelT>>;
+
+template<typename ModelT>
+using TiledValidMask = TiledCameraTable<std::uint8_t, 1, ValidMaskTileGenerator<ModelT>>;
+
+template<typename ModelT>
+inline std::unique_ptr<TiledRayTable<ModelT>> makeTiledRayTable(const ModelT& model)
+{
+    return std::unique_ptr<TiledRayTable<ModelT>>(new TiledRayTable<ModelT>((std::size_t)model.width(), (std::size_t)model.height(), RayTileGenerator<ModelT>(model)));
+}
+
+template<typename DstModelT, typename SrcModelT>
+inline std::unique_ptr<TiledRemapTable<DstModelT,SrcModelT>> makeTiledRemapTable(const DstModelT& dst, const SrcModelT& src,
+                                                                                 const typename ComplexTypes<typename SrcModelT::Scalar>::RotationT& pose = typename ComplexTypes<typename SrcModelT::Scalar>::RotationT())
+{
+    return std::unique_ptr<TiledRemapTable<DstModelT,SrcModelT>>(new TiledRemapTable<DstModelT,SrcModelT>((std::size_t)dst.width(), (std::size_t)dst.height(), RemapTileGenerator<DstModelT,SrcModelT>(dst, src, pose)));
+}
+
+template<typename ModelT>
+inline std::unique_ptr<TiledValidMask<ModelT>> makeTiledValidMask(const ModelT& model)
+{
+    return std::unique_ptr<TiledValidMask<ModelT>>(new TiledValidMask<ModelT>((std::size_t)model.width(), (std::size_t)model.height(), ValidMaskTileGenerator<ModelT>(model)));
+}
+
+}
+
+#endif // CAMERA_TILED_TABLES_HPP
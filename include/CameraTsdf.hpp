@@ -0,0 +1,317 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * TSDF volume integration of depth images through camera models.
+ * ****************************************************************************
+ */
+
+#ifndef CAMERA_TSDF_HPP
+#define CAMERA_TSDF_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <CameraModelHelpers.hpp>
+#include <CameraPacket.hpp>
+#include <CameraBatch.hpp>
+#include <CameraThreads.hpp>
+
+namespace camera
+{
+
+struct TsdfVoxel
+{
+    float tsdf;
+    float weight;
+};
+
+/**
+ * Dense TSDF volume of BlockSize^3 voxel blocks, voxels of a block are contiguous (x fastest).
+ * Voxel (0,0,0) has its corner at origin. Unobserved voxels have tsdf 1 and weight 0.
+ */
+template<typename T>
+class TsdfVolume
+{
+public:
+    typedef typename ComplexTypes<T>::PointT PointT;
+    static constexpr std::size_t BlockSize = 8;
+    static constexpr std::size_t BlockVoxels = BlockSize * BlockSize * BlockSize;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    TsdfVolume(std::size_t blocks_x, std::size_t blocks_y, std::size_t blocks_z, T voxel, const PointT& o = PointT::Zero())
+        : bx(blocks_x), by(blocks_y), bz(blocks_z), voxel_size(voxel), origin(o), voxels(blocks_x * blocks_y * blocks_z * BlockVoxels)
+    {
+        reset();
+    }
+    
+    inline void reset()
+    {
+        const TsdfVoxel empty = { 1.0f, 0.0f };
+        std::fill(voxels.begin(), voxels.end(), empty);
+    }
+    
+    inline std::size_t getBlocksX() const { return bx; }
+    inline std::size_t getBlocksY() const { return by; }
+    inline std::size_t getBlocksZ() const { return bz; }
+    inline std::size_t getBlockCount() const { return bx * by * bz; }
+    inline T getVoxelSize() const { return voxel_size; }
+    inline const PointT& getOrigin() const { return origin; }
+    
+    inline TsdfVoxel* getBlock(std::size_t i) { return &voxels[i * BlockVoxels]; }
+    inline const TsdfVoxel* getBlock(std::size_t i) const { return &voxels[i * BlockVoxels]; }
+    
+    inline void getBlockCoordinates(std::size_t i, std::size_t& x, std::size_t& y, std::size_t& z) const
+    {
+        x = i % bx;
+        y = (i / bx) % by;
+        z = i / (bx * by);
+    }
+    
+    inline const TsdfVoxel& getVoxel(std::size_t x, std::size_t y, std::size_t z) const
+    {
+        assert(x < bx * BlockSize && y < by * BlockSize && z < bz * BlockSize);
+        const std::size_t block = ((z / BlockSize) * by + (y / BlockSize)) * bx + (x / BlockSize);
+        return getBlock(block)[((z % BlockSize) * BlockSize + (y % BlockSize)) * BlockSize + (x % BlockSize)];
+    }
+    
+    inline PointT getVoxelCentre(std::size_t x, std::size_t y, std::size_t z) const
+    {
+        return origin + voxel_size * PointT(T(x) + T(0.5), T(y) + T(0.5), T(z) + T(0.5));
+    }
+    
+private:
+    std::size_t bx, by, bz;
+    T voxel_size;
+    PointT origin;
+    std::vector<TsdfVoxel> voxels;
+};
+
+struct TsdfIntegrationStatistics
+{
+    TsdfIntegrationStatistics() : blocks(0), culled_blocks(0), updated_voxels(0) { }
+    
+    std::size_t blocks;
+    std::size_t culled_blocks;
+    std::size_t updated_voxels;
+};
+
+/**
+ * Integrates depth images into a TsdfVolume through any camera model. Blocks are culled
+ * by projecting their corners (all behind the camera, all beyond one image border or all
+ * beyond the farthest depth), which is conservative for blocks small against the field of view.
+ * Rows of voxels of a kept block go through forward in packets, with nearest pixel depth lookup.
+ * Threads take blocks from a shared counter, blocks are disjoint so no locking is needed.
+ */
+template<typename ModelT>
+class TsdfIntegrator
+{
+public:
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ComplexTypes<Scalar>::PointT PointT;
+    typedef typename ComplexTypes<Scalar>::TransformT TransformT;
+    typedef typename internal::BatchPacket<Scalar>::Type PacketT;
+    static constexpr std::size_t Lanes = PacketT::Size;
+    static constexpr std::size_t BlockSize = TsdfVolume<Scalar>::BlockSize;
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    TsdfIntegrator(const ModelT& m, Scalar truncation_distance, DepthType type = DepthType::ZDepth, float max_weight = 64.0f, unsigned int thread_count = 0)
+        : model(m), truncation(truncation_distance), depth_type(type), weight_cap(max_weight),
+          threads(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency()))
+    {
+        static_assert(BlockSize % Lanes == 0, "a row of voxels is a whole number of packets");
+    }
+    
+    inline const ModelT& getModel() const { return model; }
+    inline unsigned int getThreadCount() const { return threads; }
+    
+    /**
+     * Fuses a model.width() x model.height() depth image (row stride in pixels, 0: width,
+     * non-positive or NaN depth is missing) taken from pose (camera to world).
+     */
+    TsdfIntegrationStatistics integrate(TsdfVolume<Scalar>& volume, const float* depth, std::size_t stride, const TransformT& pose) const
+    {
+        const std::size_t w = (std::size_t)model.width(), h = (std::size_t)model.height();
+        if(stride == 0) { stride = w; }
+        
+        float max_depth = 0.0f;
+        for(std::size_t y = 0 ; y < h ; ++y)
+        {
+            for(std::size_t x = 0 ; x < w ; ++x)
+            {
+                const float d = depth[y * stride + x];
+                if(d > max_depth && d < std::numeric_limits<float>::infinity()) { max_depth = d; }
+            }
+        }
+        
+        const TransformT world_to_camera = pose.inverse();
+        const Eigen::Matrix<Scalar,3,3> rot = world_to_camera.rotationMatrix();
+        const Frame frame = { depth, w, h, stride, Scalar(max_depth) + truncation, rot * volume.getVoxelSize(), rot * volume.getOrigin() + world_to_camera.translation() };
+        
+        std::atomic<std::size_t> next_block(0), culled(0), updated(0);
+        internal::runOnThreads(threads, [&](unsigned int)
+        {
+            std::size_t local_culled = 0, local_updated = 0;
+            for(std::size_t b = next_block.fetch_add(1) ; b < volume.getBlockCount() ; b = next_block.fetch_add(1))
+            {
+                std::size_t x, y, z;
+                volume.getBlockCoordinates(b, x, y, z);
+                const PointT corner = frame.origin + frame.axes * PointT(Scalar(x * BlockSize), Scalar(y * BlockSize), Scalar(z * BlockSize));
+                
+                if(isCulled(frame, corner))
+                {
+                    local_culled++;
+                    continue;
+                }
+                
+                local_updated += integrateBlock(frame, corner, volume.getBlock(b));
+            }
+            culled.fetch_add(local_culled);
+            updated.fetch_add(local_updated);
+        });
+        
+        TsdfIntegrationStatistics ret;
+        ret.blocks = volume.getBlockCount();
+        ret.culled_blocks = culled.load();
+        ret.updated_voxels = updated.load();
+        return ret;
+    }
+    
+private:
+    struct Frame
+    {
+        const float* depth;
+        std::size_t width, height, stride;
+        Scalar max_range;
+        Eigen::Matrix<Scalar,3,3> axes; // voxel steps in the camera frame
+        PointT origin; // volume corner in the camera frame
+    };
+    
+    inline bool isCulled(const Frame& frame, const PointT& corner) const
+    {
+        using std::min;
+        
+        int valid = 0, left = 0, right = 0, top = 0, bottom = 0;
+        Scalar nearest = std::numeric_limits<Scalar>::max();
+        for(int c = 0 ; c < 8 ; ++c)
+        {
+            const PointT pt = corner + frame.axes * PointT(Scalar((c & 1) ? BlockSize : 0), Scalar((c & 2) ? BlockSize : 0), Scalar((c & 4) ? BlockSize : 0));
+            nearest = min(nearest, depth_type == DepthType::ZDepth ? pt(2) : pt.norm());
+            if(!model.pointValid(pt)) { continue; }
+            
+            valid++;
+            const typename ComplexTypes<Scalar>::PixelT pix = model.forward(pt);
+            if(pix(0) < Scalar(0.0)) { left++; }
+            if(pix(0) >= model.width()) { right++; }
+            if(pix(1) < Scalar(0.0)) { top++; }
+            if(pix(1) >= model.height()) { bottom++; }
+        }
+        
+        // no point of the block is closer than the nearest corner less the block extent, measured the way the depth image is
+        const Scalar extent = depth_type == DepthType::ZDepth ?
+            frame.axes.row(2).cwiseAbs().sum() * Scalar(BlockSize) :
+            frame.axes.col(0).norm() * Scalar(BlockSize) * Scalar(std::sqrt(3.0));
+        return nearest - extent > frame.max_range || valid == 0 || (valid == 8 && (left == 8 || right == 8 || top == 8 || bottom == 8));
+    }
+    
+    inline std::size_t integrateBlock(const Frame& frame, const PointT& corner, TsdfVoxel* block) const
+    {
+        using std::floor;
+        
+        PacketT lane;
+        for(std::size_t l = 0 ; l < Lanes ; ++l) { lane[l] = Scalar(l) + Scalar(0.5); }
+        
+        std::size_t updated = 0;
+        for(std::size_t z = 0 ; z < BlockSize ; ++z)
+        {
+            for(std::size_t y = 0 ; y < BlockSize ; ++y)
+            {
+                const PointT row = corner + frame.axes.col(1) * (Scalar(y) + Scalar(0.5)) + frame.axes.col(2) * (Scalar(z) + Scalar(0.5));
+                TsdfVoxel* voxels = block + (z * BlockSize + y) * BlockSize;
+                
+                for(std::size_t x = 0 ; x < BlockSize ; x += Lanes)
+                {
+                    const PacketT xs = lane + PacketT(Scalar(x));
+                    typename ComplexTypes<PacketT>::PointT pt;
+                    for(int c = 0 ; c < 3 ; ++c)
+                    {
+                        pt(c) = PacketT(row(c)) + xs * PacketT(frame.axes(c,0));
+                    }
+                    
+                    ProjectionStatus status[Lanes];
+                    const typename ComplexTypes<PacketT>::PixelT pix = forwardWithStatus<PacketT>(model, pt, status);
+                    
+                    for(std::size_t l = 0 ; l < Lanes ; ++l)
+                    {
+                        if(status[l] != ProjectionStatus::Ok) { continue; }
+                        
+                        const std::size_t u = (std::size_t)floor(pix(0)[l] + Scalar(0.5)), v = (std::size_t)floor(pix(1)[l] + Scalar(0.5));
+                        if(u >= frame.width || v >= frame.height) { continue; }
+                        
+                        const float d = frame.depth[v * frame.stride + u];
+                        if(!(d > 0.0f)) { continue; }
+                        
+                        const Scalar px = pt(0)[l], py = pt(1)[l], pz = pt(2)[l];
+                        const Scalar measured = depth_type == DepthType::ZDepth ? pz : std::sqrt(px * px + py * py + pz * pz);
+                        const Scalar sdf = Scalar(d) - measured;
+                        if(sdf < -truncation) { continue; }
+                        
+                        TsdfVoxel& voxel = voxels[x + l];
+                        const float tsdf = float(std::min(Scalar(1.0), sdf / truncation));
+                        voxel.tsdf = (voxel.tsdf * voxel.weight + tsdf) / (voxel.weight + 1.0f);
+                        voxel.weight = std::min(voxel.weight + 1.0f, weight_cap);
+                        updated++;
+                    }
+                }
+            }
+        }
+        
+        return updated;
+    }
+    
+    ModelT model;
+    Scalar truncation;
+    DepthType depth_type;
+    float weight_cap;
+    unsigned int threads;
+};
+
+}
+
+#endif // CAMERA_TSDF_HPP
@@ -103,6 +103,7 @@ public:
     using FunctionsBase::pixelValid;
     using FunctionsBase::pixelValidSquare;
     using FunctionsBase::pixelValidCircular;
+    using FunctionsBase::pointValid;
     using FunctionsBase::resizeViewport;
     
     template<typename NewScalarType>
@@ -127,24 +128,23 @@ public:
         
         typename ComplexTypes<T>::PixelT invKpt( (x - ccd.u0()) / ccd.fx() , (y - ccd.v0()) / ccd.fy() );
         
-        T scale = T(1.0);
+        // near the centre the scale is 1, computed on a safe radius to stay branch-free
+        const T theta_d_raw = invKpt.norm();
+        const typename ScalarMask<T>::Type off_centre = theta_d_raw > T(1e-8);
+        const T theta_d = select(off_centre, theta_d_raw, T(1.0));
         
-        T theta_d = invKpt.norm();
-        if(theta_d > T(1e-8))
+        T theta = theta_d;
+        for(unsigned int j = 0; j < 10; ++j)
         {
-            T theta = theta_d;
-            for(unsigned int j = 0; j < 10; ++j)
-            {
-                T theta2 = theta*theta, 
-                  theta4 = theta2*theta2, 
-                  theta6 = theta4*theta2, 
-                  theta8 = theta6*theta2;
-                theta = theta_d / (T(1.0) + ccd.k1() * theta2 + ccd.k2() * theta4 + ccd.k3() * theta6 + ccd.k4() * theta8);
-            }
-            
-            scale = tan(theta) / theta_d;
+            T theta2 = theta*theta, 
+              theta4 = theta2*theta2, 
+              theta6 = theta4*theta2, 
+              theta8 = theta6*theta2;
+            theta = theta_d / (T(1.0) + ccd.k1() * theta2 + ccd.k2() * theta4 + ccd.k3() * theta6 + ccd.k4() * theta8);
         }
         
+        const T scale = select(off_centre, T(tan(theta) / theta_d), T(1.0));
+        
         ret(0) = invKpt(0) * scale;
         ret(1) = invKpt(1) * scale;
         ret(2) = T(1.0);
@@ -174,10 +174,9 @@ public:
         
         const T theta_d = theta + ccd.k1() * theta3 + ccd.k2() * theta5 + ccd.k3()*theta7 + ccd.k4() * theta9;
         
-        T inv_r(1.0);
-        if( r > T(1e-8) ) { inv_r = T(1.0)/r; } 
-        T cdist(1.0);
-        if( r > T(1e-8) ) { cdist = theta_d * inv_r; } 
+        const typename ScalarMask<T>::Type off_centre = r > T(1e-8);
+        const T inv_r = T(1.0) / select(off_centre, r, T(1.0));
+        const T cdist = select(off_centre, theta_d * inv_r, T(1.0));
         
         const typename ComplexTypes<T>::PixelT xd1(a * cdist, b * cdist);
         const typename ComplexTypes<T>::PixelT xd3(xd1(0) + ccd.skew() * xd1(1), xd1(1));
@@ -187,31 +186,23 @@ public:
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(const Derived& ccd, T x, T y) 
     {
-        if((x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height()))
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return (x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height());
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(const Derived& ccd, T x, T y) 
     {
         const T x2 = (x - ccd.u0()) * (x - ccd.u0());
         const T y2 = (y - ccd.v0()) * (y - ccd.v0());
-        if(x2 + y2 < ccd.radius() * ccd.radius())
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return x2 + y2 < ccd.radius() * ccd.radius();
+    }
+    
+    template<typename T = Scalar>
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pointValid(const Derived& ccd, const typename ComplexTypes<T>::PointT& tmp_pt) 
+    {
+        return tmp_pt(2) > T(0.0);
     }
     
     template<typename T = Scalar>
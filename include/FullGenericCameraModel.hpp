@@ -104,6 +104,7 @@ public:
     using FunctionsBase::pixelValid;
     using FunctionsBase::pixelValidSquare;
     using FunctionsBase::pixelValidCircular;
+    using FunctionsBase::pointValid;
     using FunctionsBase::resizeViewport;
     
     template<typename NewScalarType>
@@ -151,7 +152,8 @@ public:
         typename ComplexTypes<T>::PixelT ret, p;
         
         // unit vector
-        const typename ComplexTypes<T>::PointT unit_pt = tmp_pt.normalized(); 
+        const T norm = sqrt(tmp_pt.squaredNorm());
+        const typename ComplexTypes<T>::PointT unit_pt = tmp_pt / select(norm > T(0.0), norm, T(1.0)); 
         
         // perspective
         p = unit_pt.template topRows<2>() / (unit_pt(2) + ccd.epsilon());
@@ -168,50 +170,29 @@ public:
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(const Derived& ccd, T x, T y) 
     {
-        if((x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height()))
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return (x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height());
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(const Derived& ccd, T x, T y) 
     {
-        if(ccd.r1() <= 0.0) // no r1
-        {
-            const T x2 = (x - ccd.u0()) * (x - ccd.u0());
-            const T y2 = (y - ccd.v0()) * (y - ccd.v0());
-            if(x2 + y2 < ccd.r2() * ccd.r2())
-            {
-                return true;
-            }
-            else
-            {
-                return false;
-            }
-        }
-        else
-        {
-            const T x2 = (x - ccd.u0()) * (x - ccd.u0());
-            const T y2 = (y - ccd.v0()) * (y - ccd.v0());
-            const T r12 = ccd.r1() * ccd.r1();
-            const T r22 = ccd.r2() * ccd.r2();
-            
-            if(((x2 + y2) > r12) && ((x2 + y2) < r22))
-            {
-                return true;
-            }
-            else
-            {
-                return false;
-            }
-        }
+        const T x2 = (x - ccd.u0()) * (x - ccd.u0());
+        const T y2 = (y - ccd.v0()) * (y - ccd.v0());
+        // no r1 - inner bound that always passes
+        const T r12 = ccd.r1() <= 0.0 ? T(-1.0) : T(ccd.r1() * ccd.r1());
+        const T r22 = ccd.r2() * ccd.r2();
+        
+        return ((x2 + y2) > r12) && ((x2 + y2) < r22);
+    }
+    
+    template<typename T = Scalar>
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pointValid(const Derived& ccd, const typename ComplexTypes<T>::PointT& tmp_pt) 
+    {
+        // in front of the unit sphere projection centre, z / |p| + eps > 0
+        const T norm2 = tmp_pt.squaredNorm();
+        return (norm2 > T(0.0)) && (tmp_pt(2) + ccd.epsilon() * sqrt(norm2) > T(0.0));
     }
     
     template<typename T = Scalar>
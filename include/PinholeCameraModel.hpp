@@ -101,6 +101,7 @@ public:
     using FunctionsBase::pixelValid;
     using FunctionsBase::pixelValidSquare;
     using FunctionsBase::pixelValidCircular;
+    using FunctionsBase::pointValid;
     using FunctionsBase::resizeViewport;
     
     template<typename NewScalarType>
@@ -146,22 +147,21 @@ public:
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidSquare(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidSquare(const Derived& ccd, T x, T y) 
     {
-        if((x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height()))
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return (x >= T(0.0)) && (x < ccd.width()) && (y >= T(0.0)) && (y < ccd.height());
+    }
+    
+    template<typename T = Scalar>
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pixelValidCircular(const Derived& ccd, T x, T y) 
+    {
+        return typename ScalarMask<T>::Type(true);
     }
     
     template<typename T = Scalar>
-    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE bool pixelValidCircular(const Derived& ccd, T x, T y) 
+    static EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE typename ScalarMask<T>::Type pointValid(const Derived& ccd, const typename ComplexTypes<T>::PointT& tmp_pt) 
     {
-        return true;
+        return tmp_pt(2) > T(0.0);
     }
     
     EIGEN_DEVICE_FUNC EIGEN_STRONG_INLINE Scalar getFieldOfViewX() const { return getFieldOfView(fx(),width()); }
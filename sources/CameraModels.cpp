@@ -35,4 +35,32 @@
 
 #include <CameraModelHelpers.hpp>
 #include <CameraPyramid.hpp>
-#include <OpenGLProjectionMatrix.hpp>
\ No newline at end of file
+#include <CameraPacket.hpp>
+#include <CameraPointBlock.hpp>
+#include <CameraStridedView.hpp>
+#include <CameraFrameArena.hpp>
+#include <CameraProjectionService.hpp>
+#include <CameraPipeline.hpp>
+#include <CameraBatch.hpp>
+#include <OpenGLProjectionMatrix.hpp>
+#include <CameraTables.hpp>
+#include <CameraTableFile.hpp>
+#include <CameraTableRegistry.hpp>
+#include <CameraTableBudget.hpp>
+#include <CameraTiledTables.hpp>
+#include <CameraTableCodegen.hpp>
+#include <CameraNuma.hpp>
+#include <CameraKernelTuner.hpp>
+#include <CameraEvents.hpp>
+#include <CameraLidar.hpp>
+#include <CameraRangeImage.hpp>
+#include <CameraFeaturePrediction.hpp>
+#include <CameraStabilisation.hpp>
+#include <CameraBirdsEye.hpp>
+#include <CameraTsdf.hpp>
+#include <CameraColouriser.hpp>
+#include <CameraDepthPyramid.hpp>
+#include <CameraTexturing.hpp>
+#include <CameraPixelGrid.hpp>
+#include <CameraThreads.hpp>
+#include <CameraProjectedView.hpp>
\ No newline at end of file
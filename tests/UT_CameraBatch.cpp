@@ -0,0 +1,1268 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Tests for batch projection.
+ * ****************************************************************************
+ */
+
+// system
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// testing framework & libraries
+#include <gtest/gtest.h>
+
+// google logger
+#include <glog/logging.h>
+
+#include <CameraModels.hpp>
+#include <CameraBatch.hpp>
+#include <CameraProjectionService.hpp>
+#include <CameraEvents.hpp>
+#include <CameraLidar.hpp>
+#include <CameraRangeImage.hpp>
+#include <CameraFeaturePrediction.hpp>
+#include <CameraTsdf.hpp>
+#include <CameraColouriser.hpp>
+#include <CameraDepthPyramid.hpp>
+#include <CameraTexturing.hpp>
+#include <CameraPixelGrid.hpp>
+
+#include <CameraParameters.hpp>
+
+template <typename ModelT>
+class CameraBatchTests : public ::testing::Test 
+{
+public:
+    
+};
+
+typedef ::testing::Types<
+camera::PinholeCameraModel<float>,
+camera::PinholeDistortedCameraModel<double>,
+camera::IdealGenericCameraModel<float>,
+camera::FisheyeCameraModel<float>,
+camera::FisheyeCameraModel<double>,
+camera::IdealFisheyeCameraModel<double>
+> CameraBatchTypes;
+TYPED_TEST_CASE(CameraBatchTests, CameraBatchTypes);
+
+TYPED_TEST(CameraBatchTests, TestStatus)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    typedef typename ModelT::PixelT PixelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    std::vector<PointT> points;
+    std::vector<camera::ProjectionStatus> expected;
+    
+    // rays through a grid of pixels, some lifted from outside the image
+    for(Scalar y = Scalar(-50.0) ; y < camera.height() + Scalar(50.0) ; y += camera.height() / Scalar(7.0))
+    {
+        for(Scalar x = Scalar(-50.0) ; x < camera.width() + Scalar(50.0) ; x += camera.width() / Scalar(9.0))
+        {
+            const PointT ray = camera.inverse(x, y);
+            if(!camera.pointValid(ray))
+            {
+                continue;
+            }
+            
+            points.push_back(ray * Scalar(3.0));
+            const PixelT pix = camera.forward(points.back());
+            expected.push_back(!camera.pixelValidSquare(pix) ? camera::ProjectionStatus::OutsideImage :
+                               !camera.pixelValidCircular(pix) ? camera::ProjectionStatus::OutsideCircularFOV : camera::ProjectionStatus::Ok);
+        }
+    }
+    
+    // on the image plane is still in front for omnidirectional (Mei, eps > 0) models
+    const PointT behind[] = { PointT(Scalar(0.1), Scalar(0.2), Scalar(-1.0)), PointT(Scalar(0.1), Scalar(0.2), Scalar(0.0)) };
+    for(const PointT& pt : behind)
+    {
+        if(!camera.pointValid(pt))
+        {
+            points.push_back(pt);
+            expected.push_back(camera::ProjectionStatus::BehindCamera);
+        }
+    }
+    
+    // finite, but the sum of the components overflows
+    {
+        const PointT ray = camera.inverse(camera.width() * Scalar(0.8), camera.height() * Scalar(0.8));
+        const PointT huge = ray * (std::numeric_limits<Scalar>::max() * Scalar(0.5) / ray.cwiseAbs().maxCoeff());
+        if(camera.pointValid(huge))
+        {
+            const PixelT pix = camera.forward(huge);
+            points.push_back(huge);
+            expected.push_back(!std::isfinite(pix(0)) || !std::isfinite(pix(1)) ? camera::ProjectionStatus::NumericalFailure :
+                               !camera.pixelValidSquare(pix) ? camera::ProjectionStatus::OutsideImage :
+                               !camera.pixelValidCircular(pix) ? camera::ProjectionStatus::OutsideCircularFOV : camera::ProjectionStatus::Ok);
+        }
+    }
+    
+    points.push_back(PointT(std::numeric_limits<Scalar>::quiet_NaN(), Scalar(0.0), Scalar(1.0)));
+    expected.push_back(camera::ProjectionStatus::NumericalFailure);
+    
+    std::vector<PixelT> pixels(points.size());
+    std::vector<camera::ProjectionStatus> status(points.size());
+    camera::forwardBatch(camera, points.data(), points.size(), pixels.data(), status.data());
+    
+    int cnt_ok = 0, cnt_bad = 0;
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        if(status[i] != expected[i])
+        {
+            cnt_bad++;
+        }
+        
+        if(status[i] == camera::ProjectionStatus::Ok)
+        {
+            cnt_ok++;
+            if((pixels[i] - camera.forward(points[i])).norm() > Scalar(1e-2))
+            {
+                cnt_bad++;
+            }
+        }
+    }
+    
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_GT(cnt_ok, 0);
+}
+
+TYPED_TEST(CameraBatchTests, TestChirality)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    EXPECT_TRUE(camera.pointValid(camera.inverse(camera.width() / Scalar(2.0), camera.height() / Scalar(2.0))));
+    EXPECT_FALSE(camera.pointValid(PointT(Scalar(0.0), Scalar(0.0), Scalar(-1.0))));
+    EXPECT_FALSE(camera.pointValid(PointT(Scalar(0.0), Scalar(0.0), Scalar(0.0))));
+}
+
+TYPED_TEST(CameraBatchTests, TestBlocks)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    // not a multiple of the block width
+    std::vector<Eigen::Vector3d> cloud;
+    for(int i = 0 ; i < 37 ; ++i)
+    {
+        const PointT ray = camera.inverse((Scalar(0.1) + Scalar(0.8) * Scalar(i * 7 % 31) / Scalar(31.0)) * camera.width(),
+                                          (Scalar(0.1) + Scalar(0.8) * Scalar(i * 3 % 29) / Scalar(29.0)) * camera.height());
+        cloud.push_back(ray.template cast<double>() * (1.0 + 0.1 * i));
+    }
+    
+    Eigen::Matrix<double,3,Eigen::Dynamic> cloud_mat(3, (int)cloud.size());
+    for(std::size_t i = 0 ; i < cloud.size() ; ++i) { cloud_mat.col(i) = cloud[i]; }
+    
+    const camera::PointBlockArray<Scalar> points(cloud);
+    const camera::PointBlockArray<Scalar> points_mat(cloud_mat);
+    ASSERT_EQ(points.size(), cloud.size());
+    ASSERT_EQ(points.getBlockCount(), (cloud.size() + points.Width - 1) / points.Width);
+    EXPECT_EQ(points.block(points.getBlockCount() - 1).z[points.Width - 1], Scalar(1.0));
+    
+    camera::PixelBlockArray<Scalar> pixels;
+    std::vector<camera::ProjectionStatus> status(points.size());
+    camera::forwardBatch(camera, points, pixels, status.data());
+    ASSERT_EQ(pixels.size(), points.size());
+    
+    camera::PointBlockArray<Scalar> rays;
+    camera::inverseBatch(camera, pixels, rays);
+    ASSERT_EQ(rays.size(), pixels.size());
+    
+    int cnt_bad = 0;
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        const PointT pt = cloud[i].template cast<Scalar>();
+        if((points_mat.get(i) - pt).norm() > Scalar(0.0) || (points.get(i) - pt).norm() > Scalar(0.0)) { cnt_bad++; }
+        if((pixels.get(i) - camera.forward(pt)).norm() > Scalar(1e-2)) { cnt_bad++; }
+        if((rays.get(i) - camera.inverse(pixels.get(i))).norm() > Scalar(1e-4)) { cnt_bad++; }
+        if(status[i] != camera::ProjectionStatus::Ok && status[i] != camera::ProjectionStatus::OutsideCircularFOV) { cnt_bad++; }
+    }
+    
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_EQ(rays.block(rays.getBlockCount() - 1).z[rays.Width - 1], Scalar(1.0));
+    EXPECT_EQ((rays.toMatrix().col(3) - rays.get(3)).norm(), Scalar(0.0));
+}
+
+TYPED_TEST(CameraBatchTests, TestStridedViews)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    typedef typename ModelT::PixelT PixelT;
+    
+    // PCL PointXYZ like: padded to 16 bytes
+    struct CloudPoint { float x, y, z, pad; };
+    // keypoint like: pixel plus payload
+    struct KeyPoint { float response; float x, y; int id; };
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    std::vector<CloudPoint> cloud;
+    std::vector<PointT> points;
+    for(int i = 0 ; i < 23 ; ++i)
+    {
+        const PointT ray = camera.inverse((Scalar(0.1) + Scalar(0.8) * Scalar(i * 5 % 23) / Scalar(23.0)) * camera.width(),
+                                          (Scalar(0.1) + Scalar(0.8) * Scalar(i * 11 % 19) / Scalar(19.0)) * camera.height());
+        const CloudPoint cp = { float(ray(0) * Scalar(2.0)), float(ray(1) * Scalar(2.0)), float(ray(2) * Scalar(2.0)), -1.0f };
+        cloud.push_back(cp);
+        points.push_back(PointT(Scalar(cp.x), Scalar(cp.y), Scalar(cp.z)));
+    }
+    
+    std::vector<KeyPoint> keypoints(cloud.size());
+    for(std::size_t i = 0 ; i < keypoints.size() ; ++i) { keypoints[i].id = (int)i; }
+    
+    const camera::PointView<const float> cloud_view = camera::makePointView(&cloud[0].x, cloud.size(), sizeof(CloudPoint), 0, sizeof(float), 2 * sizeof(float));
+    const camera::PixelView<float> kp_view = camera::makePixelView(&keypoints[0].x, keypoints.size(), sizeof(KeyPoint), 0, sizeof(float));
+    
+    std::vector<camera::ProjectionStatus> status(cloud.size());
+    camera::forwardBatch(camera, cloud_view, kp_view, status.data());
+    
+    // and back, in place into the cloud
+    camera::inverseBatch(camera, camera::PixelView<const float>(kp_view), camera::makePointView(&cloud[0].x, cloud.size(), sizeof(CloudPoint), 0, sizeof(float), 2 * sizeof(float)));
+    
+    int cnt_bad = 0;
+    for(std::size_t i = 0 ; i < cloud.size() ; ++i)
+    {
+        const PixelT pix = camera.forward(points[i]);
+        if(std::abs(keypoints[i].x - float(pix(0))) > 1e-2f || std::abs(keypoints[i].y - float(pix(1))) > 1e-2f) { cnt_bad++; }
+        if(keypoints[i].id != (int)i || cloud[i].pad != -1.0f) { cnt_bad++; }
+        
+        const PointT ray = camera.inverse(PixelT(Scalar(keypoints[i].x), Scalar(keypoints[i].y)));
+        if(std::abs(cloud[i].x - float(ray(0))) > 1e-4f || std::abs(cloud[i].z - float(ray(2))) > 1e-4f) { cnt_bad++; }
+    }
+    
+    // identity pose matches
+    std::vector<PixelT> pixels(points.size());
+    camera::forwardBatch(camera, typename camera::ComplexTypes<Scalar>::TransformT(), points.data(), points.size(), pixels.data(), status.data());
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        if((pixels[i] - camera.forward(points[i])).norm() > Scalar(1e-2)) { cnt_bad++; }
+    }
+    
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_EQ(kp_view.segment(3, 5).size(), std::size_t(5));
+    EXPECT_EQ(&kp_view.segment(3, 5)(0, 1), &keypoints[3].y);
+}
+
+TYPED_TEST(CameraBatchTests, TestFrameArena)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    typedef typename ModelT::PixelT PixelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    std::vector<PixelT> pixels;
+    for(int i = 0 ; i < 50 ; ++i)
+    {
+        pixels.push_back(PixelT((Scalar(0.1) + Scalar(0.8) * Scalar(i * 7 % 50) / Scalar(50.0)) * camera.width(),
+                                (Scalar(0.1) + Scalar(0.8) * Scalar(i * 3 % 50) / Scalar(50.0)) * camera.height()));
+    }
+    
+    // small on purpose, the first frames grow it
+    camera::FrameArena arena(256);
+    
+    for(int frame = 0 ; frame < 4 ; ++frame)
+    {
+        arena.reset();
+        
+        const camera::PointView<Scalar> rays = camera::inverseBatch(camera, camera::makePixelView(pixels.data(), pixels.size()), arena);
+        const camera::ProjectionBatch<Scalar> proj = camera::forwardBatch(camera, camera::PointView<const Scalar>(rays), arena);
+        
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(rays.data()) % camera::FrameArena::DefaultAlignment, std::uintptr_t(0));
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(proj.pixels.data()) % camera::FrameArena::DefaultAlignment, std::uintptr_t(0));
+        
+        int cnt_bad = 0;
+        for(std::size_t i = 0 ; i < pixels.size() ; ++i)
+        {
+            const PointT ray(rays(i, 0), rays(i, 1), rays(i, 2));
+            if((ray - camera.inverse(pixels[i])).norm() > Scalar(1e-4)) { cnt_bad++; }
+            if((PixelT(proj.pixels(i, 0), proj.pixels(i, 1)) - camera.forward(ray)).norm() > Scalar(1e-2)) { cnt_bad++; }
+        }
+        EXPECT_EQ(cnt_bad, 0);
+    }
+    
+    // grown once, merged on the first reset, then stable
+    const std::size_t heap_allocations = arena.getHeapAllocations();
+    arena.reset();
+    camera::inverseBatch(camera, camera::makePixelView(pixels.data(), pixels.size()), arena);
+    EXPECT_EQ(arena.getHeapAllocations(), heap_allocations);
+    EXPECT_GE(arena.getCapacityBytes(), arena.getHighWaterBytes());
+    
+    std::vector<Scalar, camera::FrameArenaAllocator<Scalar>> scratch(16, Scalar(1.0), camera::FrameArenaAllocator<Scalar>(arena));
+    EXPECT_EQ(scratch[15], Scalar(1.0));
+}
+
+TEST(CameraProjectionServiceTests, TestCoalescing)
+{
+    typedef camera::PinholeDistortedCameraModel<float> ModelT;
+    typedef ModelT::PointT PointT;
+    typedef ModelT::PixelT PixelT;
+    
+    ModelT model;
+    CameraParameters<ModelT>::configure(model);
+    const camera::CameraFromCRTP<ModelT> poly(model);
+    
+    // the last one waits long enough for its callers to park
+    std::unique_ptr<camera::ProjectionService<float>> services[3] = { camera::makeProjectionService(model, std::chrono::microseconds(200), 64),
+                                                                      camera::makeProjectionService<float>(poly, std::chrono::microseconds(200), 64),
+                                                                      camera::makeProjectionService(model, std::chrono::milliseconds(2), 64) };
+    
+    for(int s = 0 ; s < 3 ; ++s)
+    {
+        camera::ProjectionService<float>& service = *services[s];
+        std::atomic<int> cnt_bad(0);
+        
+        std::vector<std::thread> threads;
+        for(int t = 0 ; t < 8 ; ++t)
+        {
+            threads.push_back(std::thread([&, t]()
+            {
+                for(int i = 0 ; i < 100 ; ++i)
+                {
+                    const PixelT pix((0.1f + 0.8f * float((i * 7 + t) % 50) / 50.0f) * model.width(), (0.1f + 0.8f * float((i * 3 + t) % 50) / 50.0f) * model.height());
+                    const PointT ray = service.inverse(pix);
+                    if((ray - model.inverse(pix)).norm() > 1e-5f) { cnt_bad++; }
+                    
+                    PointT pts[3] = { ray, ray * 2.0f, PointT(0.0f, 0.0f, -1.0f) };
+                    PixelT out[3];
+                    camera::ProjectionStatus status[3];
+                    service.forward(pts, 3, out, status);
+                    if((out[1] - model.forward(pts[1])).norm() > 1e-3f || status[2] != camera::ProjectionStatus::BehindCamera) { cnt_bad++; }
+                }
+            }));
+        }
+        
+        for(std::thread& th : threads) { th.join(); }
+        
+        EXPECT_EQ(cnt_bad.load(), 0);
+        
+        const camera::ProjectionServiceStatistics stats = service.getStatistics();
+        EXPECT_EQ(stats.requests, std::size_t(8 * 100 * 2));
+        EXPECT_EQ(stats.points, std::size_t(8 * 100 * 4));
+        EXPECT_LE(stats.batches, stats.requests);
+    }
+    
+    // large requests bypass the queue
+    std::vector<PointT> many(100, PointT(0.1f, 0.2f, 1.0f));
+    std::vector<PixelT> many_pix(many.size());
+    std::vector<camera::ProjectionStatus> many_status(many.size());
+    services[0]->forward(many.data(), many.size(), many_pix.data(), many_status.data());
+    EXPECT_EQ(services[0]->getStatistics().direct, std::size_t(1));
+    EXPECT_EQ(many_status[99], camera::ProjectionStatus::Ok);
+}
+
+TEST(CameraProjectionServiceTests, TestPolymorphicStatus)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    typedef ModelT::PointT PointT;
+    typedef ModelT::PixelT PixelT;
+    
+    ModelT model;
+    CameraParameters<ModelT>::configure(model);
+    const camera::CameraFromCRTP<ModelT> poly(model);
+    std::unique_ptr<camera::ProjectionService<float>> service = camera::makeProjectionService<float>(poly);
+    
+    // finite with a sum that overflows, non-finite, behind, outside and more than a packet of ordinary points
+    std::vector<PointT> points = { PointT(1e35f, 1e35f, std::numeric_limits<float>::max()), PointT(std::numeric_limits<float>::quiet_NaN(), 0.0f, 1.0f),
+                                   PointT(0.0f, std::numeric_limits<float>::infinity(), 1.0f), PointT(0.0f, 0.0f, -1.0f), PointT(10.0f, 0.0f, 1.0f) };
+    for(int i = 0 ; i < 20 ; ++i) { points.push_back(PointT(0.05f * i - 0.5f, 0.3f - 0.03f * i, 2.0f)); }
+    
+    std::vector<PixelT> expected(points.size()), pixels(points.size()), direct(points.size());
+    std::vector<camera::ProjectionStatus> expected_status(points.size()), status(points.size()), direct_status(points.size());
+    camera::forwardBatch(model, points.data(), points.size(), expected.data(), expected_status.data());
+    service->forward(points.data(), points.size(), pixels.data(), status.data());
+    static_cast<const camera::CameraInterface<float>&>(poly).forwardBatch(points.data(), points.size(), direct.data(), direct_status.data());
+    
+    EXPECT_EQ(expected_status[0], camera::ProjectionStatus::Ok);
+    EXPECT_EQ(expected_status[1], camera::ProjectionStatus::NumericalFailure);
+    EXPECT_EQ(expected_status[2], camera::ProjectionStatus::NumericalFailure);
+    EXPECT_EQ(expected_status[3], camera::ProjectionStatus::BehindCamera);
+    EXPECT_EQ(expected_status[4], camera::ProjectionStatus::OutsideImage);
+    EXPECT_TRUE(status == expected_status);
+    EXPECT_TRUE(direct_status == expected_status);
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        if(expected_status[i] != camera::ProjectionStatus::Ok) { continue; }
+        EXPECT_EQ(pixels[i], expected[i]);
+        EXPECT_EQ(direct[i], expected[i]);
+    }
+    
+    std::vector<PointT> rays(expected.size()), expected_rays(expected.size());
+    camera::inverseBatch(model, expected.data(), expected.size(), expected_rays.data());
+    service->inverse(expected.data(), expected.size(), rays.data());
+    for(std::size_t i = 0 ; i < rays.size() ; ++i)
+    {
+        if(expected_status[i] == camera::ProjectionStatus::Ok) { EXPECT_EQ(rays[i], expected_rays[i]); }
+    }
+}
+
+template<typename ModelT>
+static void checkEventUndistorter()
+{
+    typedef typename ModelT::Scalar Scalar;
+    
+    ModelT src;
+    CameraParameters<ModelT>::configure(src);
+    const camera::EventUndistorter<ModelT> undistorter(src);
+    const camera::PinholeCameraModel<float>& dst = undistorter.getTarget();
+    
+    std::vector<camera::CameraEvent> events;
+    for(int i = 0 ; i < 1003 ; ++i)
+    {
+        camera::CameraEvent e;
+        e.x = (std::uint16_t)((i * 37) % (int)src.width());
+        e.y = (std::uint16_t)((i * 53) % (int)src.height());
+        e.t = 1000 + i * 10;
+        e.polarity = (i % 2) ? 1 : -1;
+        events.push_back(e);
+    }
+    
+    std::vector<Eigen::Vector2f> plain(events.size()), rotated(events.size()), still(events.size());
+    std::vector<std::uint8_t> valid(events.size()), valid_rotated(events.size());
+    const std::size_t cnt_valid = undistorter.undistort(events.data(), events.size(), camera::makePixelView(plain.data(), plain.size()), valid.data());
+    EXPECT_GT(cnt_valid, 0u);
+    EXPECT_EQ(cnt_valid, (std::size_t)std::count(valid.begin(), valid.end(), 1));
+    
+    // zero angular velocity is the plain path
+    undistorter.undistort(events.data(), events.size(), Eigen::Vector3f::Zero(), 0, camera::makePixelView(still.data(), still.size()));
+    
+    const Eigen::Vector3f omega(0.2f, -0.5f, 0.3f);
+    const std::int64_t t_ref = 6000;
+    undistorter.undistort(events.data(), events.size(), omega, t_ref, camera::makePixelView(rotated.data(), rotated.size()), valid_rotated.data());
+    
+    int cnt_bad = 0;
+    for(std::size_t i = 0 ; i < events.size() ; ++i)
+    {
+        const Eigen::Vector3f ray = src.inverse((Scalar)events[i].x, (Scalar)events[i].y).template cast<float>().normalized();
+        if(!valid[i]) { continue; }
+        
+        if((plain[i] - dst.forward(ray)).norm() > 1e-2f) { cnt_bad++; }
+        if((still[i] - plain[i]).norm() > 1e-2f) { cnt_bad++; }
+        
+        const float dt = float(events[i].t - t_ref) * 1e-6f;
+        const Eigen::Vector3f back = Eigen::AngleAxisf(omega.norm() * dt, omega.normalized()) * ray;
+        if(valid_rotated[i] && (rotated[i] - dst.forward(back)).norm() > 0.1f) { cnt_bad++; }
+    }
+    EXPECT_EQ(cnt_bad, 0);
+}
+
+TEST(CameraEventsTests, TestUndistorter)
+{
+    checkEventUndistorter<camera::PinholeDistortedCameraModel<float>>();
+    checkEventUndistorter<camera::FisheyeCameraModel<double>>();
+}
+
+TEST(CameraLidarTests, TestMotionCompensation)
+{
+    typedef camera::PinholeDistortedCameraModel<double> ModelT;
+    typedef Sophus::SE3Group<double> TransformT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    camera::PoseTrajectory<double> trajectory;
+    for(int i = 0 ; i < 5 ; ++i)
+    {
+        const Sophus::SO3Group<double> rot(Eigen::Quaterniond(Eigen::AngleAxisd(0.05 * i, Eigen::Vector3d(0.2, 1.0, 0.1).normalized())));
+        EXPECT_TRUE(trajectory.add(0.025 * i, TransformT(rot, Eigen::Vector3d(0.3 * i, 0.05 * i, 0.1 * i))));
+    }
+    EXPECT_FALSE(trajectory.add(0.05, TransformT()));
+    
+    TransformT pose;
+    EXPECT_TRUE(trajectory.interpolate(0.05, pose));
+    EXPECT_NEAR((pose.translation() - trajectory.getPose(2).translation()).norm(), 0.0, 1e-9);
+    EXPECT_FALSE(trajectory.interpolate(0.11, pose));
+    
+    // a sweep out of order, lasers fire in groups sharing a timestamp
+    const std::size_t count = 1001;
+    std::vector<Eigen::Vector3d> points(count);
+    std::vector<double> timestamps(count);
+    for(std::size_t i = 0 ; i < count ; ++i)
+    {
+        const double a = double(i) * 0.37;
+        points[i] = Eigen::Vector3d(2.0 * std::sin(a), 0.5 * std::cos(a * 3.0), 8.0 + std::cos(a));
+        timestamps[i] = 0.0001 * double((i * 7) % 1000 / 4);
+    }
+    timestamps[5] = 0.2; // no pose
+    
+    std::vector<Eigen::Vector2d> pixels(count);
+    std::vector<camera::ProjectionStatus> status(count);
+    camera::LidarProjector<ModelT> projector(camera);
+    const std::size_t interpolated = projector.project(trajectory, camera::makePointView(points.data(), count), timestamps.data(),
+                                                       camera::makePixelView(pixels.data(), count), status.data());
+    EXPECT_EQ(interpolated, 250u);
+    EXPECT_EQ(status[5], camera::ProjectionStatus::NoPose);
+    EXPECT_TRUE(std::isnan(pixels[5](0)));
+    
+    int cnt_ok = 0;
+    for(std::size_t i = 0 ; i < count ; ++i)
+    {
+        if(i == 5) { continue; }
+        
+        ASSERT_TRUE(trajectory.interpolate(timestamps[i], pose));
+        const Eigen::Vector2d expected = camera.forward(pose, points[i]);
+        
+        camera::ProjectionStatus expected_status;
+        camera::forwardWithStatus<double>(camera, pose.inverse() * points[i], &expected_status);
+        EXPECT_EQ(status[i], expected_status);
+        EXPECT_NEAR((pixels[i] - expected).norm(), 0.0, 1e-6);
+        if(status[i] == camera::ProjectionStatus::Ok) { cnt_ok++; }
+    }
+    EXPECT_GT(cnt_ok, 0);
+    
+    // coarser groups reuse poses, at a small cost in accuracy
+    std::vector<Eigen::Vector2f> coarse(count);
+    projector.setTimeResolution(0.001);
+    EXPECT_LT(projector.project(trajectory, camera::makePointView(points.data(), count), timestamps.data(),
+                                camera::makePixelView(coarse.data(), count), status.data()), 30u);
+    for(std::size_t i = 0 ; i < count ; ++i)
+    {
+        if(status[i] != camera::ProjectionStatus::Ok) { continue; }
+        EXPECT_NEAR((coarse[i].cast<double>() - pixels[i]).norm(), 0.0, 2.0);
+    }
+    
+    // coarse groups straddling either end of the trajectory, only points outside get NoPose
+    std::vector<double> straddling(count);
+    for(std::size_t i = 0 ; i < count ; ++i) { straddling[i] = -0.0005 + 0.101 * double(i) / double(count - 1); }
+    projector.setTimeResolution(0.002);
+    projector.project(trajectory, camera::makePointView(points.data(), count), straddling.data(), camera::makePixelView(coarse.data(), count), status.data());
+    for(std::size_t i = 0 ; i < count ; ++i)
+    {
+        const bool covered = straddling[i] >= trajectory.getStartTime() && straddling[i] <= trajectory.getEndTime();
+        EXPECT_EQ(status[i] == camera::ProjectionStatus::NoPose, !covered) << "at " << straddling[i];
+    }
+}
+
+TEST(CameraRangeImageTests, TestFastAtan2)
+{
+    float max_err = 0.0f;
+    for(int i = 0 ; i < 4096 ; ++i)
+    {
+        const float a = -3.14f + 6.28f * float(i) / 4095.0f;
+        const float y = std::sin(a) * (1.0f + float(i % 7)), x = std::cos(a) * (1.0f + float(i % 7));
+        max_err = std::max(max_err, std::abs(camera::internal::fastAtan2(y, x) - std::atan2(y, x)));
+        
+        const camera::Packet8f p = camera::internal::fastAtan2(camera::Packet8f(y), camera::Packet8f(x));
+        EXPECT_EQ(p[3], camera::internal::fastAtan2(y, x));
+    }
+    EXPECT_LT(max_err, 2e-5f);
+    EXPECT_EQ(camera::internal::fastAtan2(0.0f, 0.0f), 0.0f);
+}
+
+TEST(CameraRangeImageTests, TestBuilder)
+{
+    typedef camera::SphericalCameraModel<float> ModelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    const std::size_t w = (std::size_t)camera.width(), h = (std::size_t)camera.height();
+    
+    // points at pixel centres, several per pixel, some with equal ranges
+    std::vector<Eigen::Vector3f> points;
+    std::vector<std::uint16_t> intensities;
+    for(std::size_t i = 0 ; i < 20000 ; ++i)
+    {
+        const std::size_t x = (i * 7919) % w, y = (i * 104729) % h;
+        const float range = 1.0f + float((i * 31) % 50);
+        points.push_back(camera.inverse(float(x) + 0.5f, float(y) + 0.5f).normalized() * range);
+        intensities.push_back((std::uint16_t)(i % 1000));
+    }
+    points.push_back(Eigen::Vector3f::Zero());
+    points.push_back(Eigen::Vector3f(0.0f, 0.0f, 1.0f)); // outside of the vertical field of view
+    points.push_back(Eigen::Vector3f(std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f));
+    
+    // brute force with the model
+    std::vector<float> ref_range(w * h, 0.0f);
+    std::vector<std::uint32_t> ref_index(w * h, camera::RangeImage<float>::InvalidIndex);
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        const Eigen::Vector2f pix = camera.forward(points[i]);
+        if(!(points[i].norm() > 0.0f) || !camera.pixelValidSquare(pix)) { continue; }
+        const std::size_t c = (std::size_t)pix(1) * w + (std::size_t)pix(0);
+        if(ref_index[c] == camera::RangeImage<float>::InvalidIndex || points[i].norm() < ref_range[c])
+        {
+            ref_range[c] = points[i].norm();
+            ref_index[c] = (std::uint32_t)i;
+        }
+    }
+    
+    camera::RangeImage<float> single, multi;
+    camera::RangeImageBuilder<float> builder1(camera, 1);
+    builder1.build(camera::makePointView(points.data(), points.size()), intensities.data(), single);
+    camera::RangeImageBuilder<float> builder4(camera, 4, 8);
+    builder4.build(camera::makePointView(points.data(), points.size()), intensities.data(), multi);
+    builder4.build(camera::makePointView(points.data(), points.size()), intensities.data(), multi); // reuses its buffers
+    
+    ASSERT_EQ(single.width(), w);
+    ASSERT_EQ(single.height(), h);
+    EXPECT_TRUE(single.index == multi.index);
+    EXPECT_TRUE(single.range == multi.range);
+    EXPECT_TRUE(single.intensity == multi.intensity);
+    
+    std::size_t cnt_filled = 0;
+    for(std::size_t c = 0 ; c < w * h ; ++c)
+    {
+        ASSERT_EQ(single.index[c], ref_index[c]);
+        if(ref_index[c] == camera::RangeImage<float>::InvalidIndex)
+        {
+            EXPECT_EQ(single.range[c], 0.0f);
+            continue;
+        }
+        cnt_filled++;
+        EXPECT_NEAR(single.range[c], ref_range[c], 1e-4f);
+        EXPECT_EQ(single.intensity[c], float(intensities[ref_index[c]]));
+    }
+    EXPECT_GT(cnt_filled, 1000u);
+}
+
+template<typename ModelT>
+static void checkFeaturePrediction()
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename camera::ComplexTypes<Scalar>::PixelT PixelT;
+    typedef typename camera::ComplexTypes<Scalar>::RotationT RotationT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> features;
+    for(int i = 0 ; i < 1003 ; ++i)
+    {
+        features.push_back(PixelT(camera.width() * Scalar(0.05 + 0.9 * double((i * 37) % 101) / 100.0),
+                                  camera.height() * Scalar(0.05 + 0.9 * double((i * 53) % 97) / 96.0)));
+    }
+    
+    const RotationT rotation(Eigen::Quaternion<Scalar>(Eigen::AngleAxis<Scalar>(Scalar(0.03), Eigen::Matrix<Scalar,3,1>(Scalar(0.3), Scalar(-1.0), Scalar(0.2)).normalized())));
+    
+    std::vector<PixelT, Eigen::aligned_allocator<PixelT>> fused(features.size()), cached(features.size());
+    std::vector<camera::ProjectionStatus> fused_status(features.size()), cached_status(features.size());
+    camera::predictFeatures(camera, rotation, camera::makePixelView(features.data(), features.size()), camera::makePixelView(fused.data(), fused.size()), fused_status.data());
+    
+    camera::FeaturePredictor<ModelT> predictor(camera);
+    predictor.setFeatures(camera::makePixelView(features.data(), features.size()));
+    EXPECT_EQ(predictor.getFeatureCount(), features.size());
+    predictor.predict(rotation, camera::makePixelView(cached.data(), cached.size()), cached_status.data());
+    
+    int cnt_ok = 0;
+    for(std::size_t i = 0 ; i < features.size() ; ++i)
+    {
+        const PixelT expected = camera.forward(rotation, camera.inverse(features[i](0), features[i](1)));
+        camera::ProjectionStatus expected_status;
+        camera::forwardWithStatus<Scalar>(camera, rotation.inverse() * camera.inverse(features[i](0), features[i](1)), &expected_status);
+        
+        EXPECT_EQ(fused_status[i], expected_status);
+        EXPECT_EQ(cached_status[i], expected_status);
+        if(expected_status != camera::ProjectionStatus::Ok) { continue; }
+        cnt_ok++;
+        EXPECT_NEAR((fused[i] - expected).norm(), 0.0, 1e-2);
+        EXPECT_NEAR((cached[i] - expected).norm(), 0.0, 1e-2);
+    }
+    EXPECT_GT(cnt_ok, 500);
+    
+    // a refined feature
+    predictor.setFeature(3, features[4](0), features[4](1));
+    predictor.predict(rotation, camera::makePixelView(cached.data(), cached.size()), cached_status.data());
+    EXPECT_NEAR((cached[3] - cached[4]).norm(), 0.0, 1e-6);
+}
+
+TEST(CameraFeaturePredictionTests, TestPrediction)
+{
+    checkFeaturePrediction<camera::PinholeCameraModel<float>>();
+    checkFeaturePrediction<camera::PinholeCameraModel<double>>();
+    static_assert(camera::internal::IsHomographyModel<camera::PinholeDisparityCameraModel<float>>::value, "undistorted");
+    checkFeaturePrediction<camera::PinholeDisparityCameraModel<float>>();
+    checkFeaturePrediction<camera::PinholeDistortedCameraModel<double>>();
+    checkFeaturePrediction<camera::FisheyeCameraModel<float>>();
+}
+
+template<typename ModelT>
+static void checkTsdfIntegration(camera::DepthType depth_type)
+{
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename camera::ComplexTypes<Scalar>::PointT PointT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    const std::size_t w = (std::size_t)camera.width(), h = (std::size_t)camera.height();
+    
+    // wall at z = 2 in front of the camera, which sits at the origin
+    const Scalar wall = Scalar(2.0);
+    std::vector<float> depth(w * h, 0.0f);
+    for(std::size_t y = 0 ; y < h ; ++y)
+    {
+        for(std::size_t x = 0 ; x < w ; ++x)
+        {
+            const PointT ray = camera.inverse(Scalar(x), Scalar(y));
+            if(!(ray(2) > Scalar(0.1)) || !camera.pixelValidCircular(Scalar(x), Scalar(y))) { continue; }
+            const PointT hit = ray * (wall / ray(2));
+            depth[y * w + x] = float(depth_type == camera::DepthType::ZDepth ? hit(2) : hit.norm());
+        }
+    }
+    
+    const Scalar voxel = Scalar(0.05), truncation = Scalar(0.15);
+    camera::TsdfVolume<Scalar> single(6, 6, 8, voxel, PointT(Scalar(-1.2), Scalar(-1.2), Scalar(-0.8)));
+    camera::TsdfVolume<Scalar> multi(6, 6, 8, voxel, PointT(Scalar(-1.2), Scalar(-1.2), Scalar(-0.8)));
+    
+    const typename camera::ComplexTypes<Scalar>::TransformT pose;
+    const camera::TsdfIntegrationStatistics stats = camera::TsdfIntegrator<ModelT>(camera, truncation, depth_type, 64.0f, 1).integrate(single, depth.data(), 0, pose);
+    camera::TsdfIntegrator<ModelT>(camera, truncation, depth_type, 64.0f, 4).integrate(multi, depth.data(), w, pose);
+    
+    EXPECT_EQ(stats.blocks, 6u * 6u * 8u);
+    EXPECT_GT(stats.culled_blocks, 0u); // behind the camera and beyond the wall
+    EXPECT_LT(stats.culled_blocks, stats.blocks);
+    EXPECT_GT(stats.updated_voxels, 1000u);
+    
+    std::size_t observed = 0;
+    for(std::size_t z = 0 ; z < 64 ; ++z)
+    {
+        for(std::size_t y = 0 ; y < 48 ; ++y)
+        {
+            for(std::size_t x = 0 ; x < 48 ; ++x)
+            {
+                const camera::TsdfVoxel& a = single.getVoxel(x, y, z);
+                const camera::TsdfVoxel& b = multi.getVoxel(x, y, z);
+                ASSERT_EQ(a.tsdf, b.tsdf);
+                ASSERT_EQ(a.weight, b.weight);
+                
+                const PointT centre = single.getVoxelCentre(x, y, z);
+                if(centre(2) < Scalar(0.0)) { ASSERT_EQ(a.weight, 0.0f); }
+                if(a.weight == 0.0f) { continue; }
+                
+                observed++;
+                ASSERT_EQ(a.weight, 1.0f);
+                
+                // along the ray the wall is at its depth, the signed distance is measured along the ray for range images
+                const Scalar scale = depth_type == camera::DepthType::ZDepth ? Scalar(1.0) : centre.norm() / centre(2);
+                const Scalar expected = std::min(Scalar(1.0), (wall - centre(2)) * scale / truncation);
+                ASSERT_NEAR(a.tsdf, expected, 0.1) << x << " " << y << " " << z;
+            }
+        }
+    }
+    EXPECT_EQ(observed, stats.updated_voxels);
+}
+
+TEST(CameraTsdfTests, TestIntegration)
+{
+    checkTsdfIntegration<camera::PinholeCameraModel<float>>(camera::DepthType::ZDepth);
+    checkTsdfIntegration<camera::PinholeDistortedCameraModel<double>>(camera::DepthType::ZDepth);
+    checkTsdfIntegration<camera::FisheyeCameraModel<float>>(camera::DepthType::Range);
+}
+
+TEST(CameraTsdfTests, TestWideFieldOfView)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    typedef ModelT::Scalar Scalar;
+    typedef camera::ComplexTypes<Scalar>::PointT PointT;
+    
+    // 90 degree field of view, so the corners of the wall are much further away than its z-depth
+    const ModelT camera(320.0f, 320.0f, 320.0f, 240.0f, 640, 480);
+    const std::size_t w = 640, h = 480;
+    const Scalar wall = 4.0f, voxel = 0.05f, truncation = 0.15f;
+    const std::vector<float> depth(w * h, wall);
+    
+    camera::TsdfVolume<Scalar> volume(20, 16, 2, voxel, PointT(-4.0f, -3.2f, 3.6f));
+    const camera::TsdfIntegrationStatistics stats = camera::TsdfIntegrator<ModelT>(camera, truncation, camera::DepthType::ZDepth, 64.0f, 2).integrate(volume, depth.data(), 0, camera::ComplexTypes<Scalar>::TransformT());
+    EXPECT_EQ(stats.blocks, 20u * 16u * 2u);
+    
+    // every voxel near the wall that is seen well inside the image is integrated, up to the image edges
+    std::size_t expected = 0;
+    for(std::size_t z = 0 ; z < 16 ; ++z)
+    {
+        for(std::size_t y = 0 ; y < 128 ; ++y)
+        {
+            for(std::size_t x = 0 ; x < 160 ; ++x)
+            {
+                const PointT centre = volume.getVoxelCentre(x, y, z);
+                const camera::ComplexTypes<Scalar>::PixelT pix = camera.forward(centre);
+                if(std::abs(centre(2) - wall) > Scalar(0.9) * truncation) { continue; }
+                if(!(pix(0) >= 1.0f && pix(0) < Scalar(w - 2) && pix(1) >= 1.0f && pix(1) < Scalar(h - 2))) { continue; }
+                
+                expected++;
+                const camera::TsdfVoxel& v = volume.getVoxel(x, y, z);
+                ASSERT_EQ(v.weight, 1.0f) << x << " " << y << " " << z;
+                ASSERT_NEAR(v.tsdf, (wall - centre(2)) / truncation, 0.01) << x << " " << y << " " << z;
+            }
+        }
+    }
+    EXPECT_GT(expected, 20000u);
+}
+
+TEST(CameraColouriserTests, TestOcclusion)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    const std::size_t w = (std::size_t)camera.width(), h = (std::size_t)camera.height();
+    
+    // wall at z = 3 and a small occluder at z = 1.5, both facing the cameras
+    std::vector<Eigen::Vector3f> points, normals;
+    for(int y = -50 ; y <= 50 ; ++y)
+    {
+        for(int x = -50 ; x <= 50 ; ++x)
+        {
+            points.push_back(Eigen::Vector3f(0.02f * x, 0.02f * y, 3.0f));
+            normals.push_back(Eigen::Vector3f(0.0f, 0.0f, -1.0f));
+        }
+    }
+    const std::size_t wall = points.size();
+    for(int y = -20 ; y <= 20 ; ++y)
+    {
+        for(int x = -20 ; x <= 20 ; ++x)
+        {
+            points.push_back(Eigen::Vector3f(0.01f * x, 0.01f * y, 1.5f));
+            normals.push_back(Eigen::Vector3f(0.0f, 0.0f, -1.0f));
+        }
+    }
+    
+    // camera a sees red, b (0.4 to the right) green
+    std::vector<std::uint8_t> red(w * h * 3, 0), green(w * h * 3, 0);
+    for(std::size_t i = 0 ; i < w * h ; ++i) { red[i * 3 + 0] = 200; green[i * 3 + 1] = 100; }
+    const Sophus::SE3Group<float> pose_a, pose_b(Sophus::SO3Group<float>(), Eigen::Vector3f(0.4f, 0.0f, 0.0f));
+    
+    std::vector<std::uint8_t> colours(points.size() * 3), colours_single(points.size() * 3);
+    camera::PointCloudColouriser<float> colouriser(3, 4, 0.02f, 3);
+    EXPECT_EQ(colouriser.addView(camera, pose_a, red.data()), 0u);
+    EXPECT_EQ(colouriser.addView(camera, pose_b, green.data()), 1u);
+    const std::size_t coloured = colouriser.colourise(camera::makePointView(points.data(), points.size()), colours.data());
+    
+    camera::PointCloudColouriser<float> single(3, 1, 0.02f, 3);
+    single.addView(camera, pose_a, red.data());
+    single.addView(camera, pose_b, green.data());
+    EXPECT_EQ(single.colourise(camera::makePointView(points.data(), points.size()), colours_single.data()), coloured);
+    EXPECT_TRUE(colours == colours_single);
+    
+    std::size_t cnt_both = 0, cnt_a = 0, cnt_b = 0, cnt_none = 0;
+    for(std::size_t i = 0 ; i < wall ; ++i)
+    {
+        const Eigen::Vector3f& pt = points[i];
+        const std::uint8_t* c = &colours[i * 3];
+        if(std::abs(pt(1)) > 0.45f)
+        {
+            // nothing in the way
+            EXPECT_EQ(c[0], 100); EXPECT_EQ(c[1], 50); cnt_both++;
+        }
+        else if(std::abs(pt(1)) > 0.35f)
+        {
+            continue; // shadow border
+        }
+        else if(pt(0) > -0.75f && pt(0) < -0.45f)
+        {
+            // b is blocked
+            EXPECT_EQ(c[0], 200); EXPECT_EQ(c[1], 0); cnt_a++;
+        }
+        else if(pt(0) > 0.05f && pt(0) < 0.35f)
+        {
+            // a is blocked
+            EXPECT_EQ(c[0], 0); EXPECT_EQ(c[1], 100); cnt_b++;
+        }
+        else if(pt(0) > -0.35f && pt(0) < -0.05f)
+        {
+            // both are blocked
+            EXPECT_EQ(c[0], 0); EXPECT_EQ(c[1], 0); cnt_none++;
+        }
+    }
+    EXPECT_GT(cnt_both, 0u);
+    EXPECT_GT(cnt_a, 0u);
+    EXPECT_GT(cnt_b, 0u);
+    EXPECT_GT(cnt_none, 0u);
+    
+    // the best view is the one looking straight at the point
+    camera::PointCloudColouriser<float> best(3, 2, 0.02f, 3, 0.1f, camera::ColourMode::Best);
+    best.addView(camera, pose_a, red.data());
+    best.addView(camera, pose_b, green.data());
+    best.colourise(camera::makePointView(points.data(), points.size()), normals.data(), colours.data());
+    for(std::size_t i = 0 ; i < wall ; ++i)
+    {
+        if(std::abs(points[i](1)) <= 0.45f || std::abs(points[i](0) - 0.2f) < 0.03f) { continue; }
+        EXPECT_EQ(colours[i * 3 + 0], points[i](0) < 0.2f ? 200 : 0);
+    }
+}
+
+TEST(CameraDepthPyramidTests, TestOcclusionQuery)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    const std::size_t w = (std::size_t)camera.width(), h = (std::size_t)camera.height();
+    
+    // range map of a wall at z = 3 with a square plate at z = 1.5 in front of it
+    std::vector<float> depth(w * h);
+    for(std::size_t y = 0 ; y < h ; ++y)
+    {
+        for(std::size_t x = 0 ; x < w ; ++x)
+        {
+            const Eigen::Vector3f ray = camera.inverse((float)x, (float)y);
+            const Eigen::Vector3f plate = ray * (1.5f / ray(2));
+            const float z = (std::abs(plate(0)) <= 0.2f && std::abs(plate(1)) <= 0.2f) ? 1.5f : 3.0f;
+            depth[y * w + x] = (ray * (z / ray(2))).norm();
+        }
+    }
+    depth[(h / 2) * w + 5] = 0.0f; // a hole is never occluding
+    
+    const camera::DepthPyramid pyramid(depth.data(), w, h);
+    EXPECT_EQ(pyramid.width(1), (w + 1) / 2);
+    EXPECT_EQ(pyramid.width(pyramid.getLevelCount() - 1), 1u);
+    EXPECT_EQ(pyramid.height(pyramid.getLevelCount() - 1), 1u);
+    float nearest = std::numeric_limits<float>::infinity();
+    for(float d : depth) { if(d > 0.0f) { nearest = std::min(nearest, d); } }
+    EXPECT_EQ(pyramid.getMin(pyramid.getLevelCount() - 1, 0, 0), nearest);
+    EXPECT_TRUE(std::isinf(pyramid.getMax(pyramid.getLevelCount() - 1, 0, 0)));
+    
+    // the wall sampled in scan order, the plate and points behind the camera
+    std::vector<Eigen::Vector3f> points;
+    for(int y = -60 ; y <= 60 ; ++y)
+    {
+        for(int x = -60 ; x <= 60 ; ++x)
+        {
+            points.push_back(Eigen::Vector3f(0.01f * x, 0.01f * y, 3.0f));
+        }
+    }
+    for(int y = -15 ; y <= 15 ; ++y)
+    {
+        for(int x = -15 ; x <= 15 ; ++x)
+        {
+            points.push_back(Eigen::Vector3f(0.01f * x, 0.01f * y, 1.5f));
+        }
+    }
+    points.push_back(Eigen::Vector3f(0.0f, 0.0f, -1.0f));
+    
+    const float tolerance = 0.01f;
+    const Sophus::SE3Group<float> pose;
+    camera::OcclusionQuery<ModelT> query(camera, camera::DepthType::Range, tolerance, 3, 1);
+    std::vector<std::uint8_t> visible(points.size(), 2);
+    const camera::OcclusionQueryStatistics stats = query.query(pyramid, pose, camera::makePointView(points.data(), points.size()), visible.data());
+    EXPECT_EQ(stats.points, points.size());
+    EXPECT_GT(stats.accepted_in_tiles, 0u);
+    EXPECT_GT(stats.rejected_in_tiles, 0u);
+    
+    // same as testing every point on the full resolution map
+    std::vector<Eigen::Vector2f> pixels(points.size());
+    std::vector<camera::ProjectionStatus> status(points.size());
+    camera::forwardBatch(camera, pose, camera::makePointView(points.data(), points.size()), camera::makePixelView(pixels.data(), points.size()), status.data());
+    std::size_t expected_visible = 0, hidden_wall = 0;
+    for(std::size_t i = 0 ; i < points.size() ; ++i)
+    {
+        bool expected = false;
+        if(status[i] == camera::ProjectionStatus::Ok)
+        {
+            const float u = std::floor(pixels[i](0) + 0.5f), v = std::floor(pixels[i](1) + 0.5f);
+            if(u >= 0.0f && v >= 0.0f && u < (float)w && v < (float)h)
+            {
+                expected = points[i].norm() <= depth[(std::size_t)v * w + (std::size_t)u] * (1.0f + tolerance) || depth[(std::size_t)v * w + (std::size_t)u] <= 0.0f;
+            }
+        }
+        
+        EXPECT_EQ(visible[i], expected ? 1 : 0) << "at " << i;
+        if(expected) { expected_visible++; }
+        if(!expected && points[i](2) == 3.0f) { hidden_wall++; }
+        
+        // the plate is in front, the wall around it too
+        if(points[i](2) == 1.5f) { EXPECT_EQ(visible[i], 1); }
+        if(points[i](2) == 3.0f && (std::abs(points[i](0)) > 0.45f || std::abs(points[i](1)) > 0.45f)) { EXPECT_EQ(visible[i], 1); }
+        if(points[i](2) == 3.0f && std::abs(points[i](0)) < 0.35f && std::abs(points[i](1)) < 0.35f) { EXPECT_EQ(visible[i], 0); }
+    }
+    EXPECT_EQ(stats.visible, expected_visible);
+    EXPECT_GT(hidden_wall, 0u);
+    EXPECT_EQ(visible.back(), 0);
+    
+    // independent of threading
+    camera::OcclusionQuery<ModelT> query_mt(camera, camera::DepthType::Range, tolerance, 3, 4);
+    std::vector<std::uint8_t> visible_mt(points.size(), 2);
+    const camera::OcclusionQueryStatistics stats_mt = query_mt.query(pyramid, pose, camera::makePointView(points.data(), points.size()), visible_mt.data());
+    EXPECT_EQ(stats_mt.visible, stats.visible);
+    EXPECT_TRUE(visible_mt == visible);
+}
+
+TEST(CameraTexturingTests, TestViewSelection)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    // wall at z = 3 and a small plate at z = 1.5 in front of it
+    std::vector<Eigen::Vector3f> vertices;
+    std::vector<std::uint32_t> indices;
+    const int nx = 30, ny = 20;
+    for(int y = 0 ; y <= ny ; ++y)
+    {
+        for(int x = 0 ; x <= nx ; ++x)
+        {
+            vertices.push_back(Eigen::Vector3f(-1.5f + 0.1f * x, -1.0f + 0.1f * y, 3.0f));
+        }
+    }
+    for(int y = 0 ; y < ny ; ++y)
+    {
+        for(int x = 0 ; x < nx ; ++x)
+        {
+            const std::uint32_t i = y * (nx + 1) + x;
+            const std::uint32_t quad[6] = { i, i + 1, i + nx + 2, i, i + nx + 2, i + nx + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    const std::size_t wall = indices.size() / 3;
+    const std::uint32_t p = (std::uint32_t)vertices.size();
+    vertices.push_back(Eigen::Vector3f(-0.2f, -0.2f, 1.5f));
+    vertices.push_back(Eigen::Vector3f(0.2f, -0.2f, 1.5f));
+    vertices.push_back(Eigen::Vector3f(0.2f, 0.2f, 1.5f));
+    vertices.push_back(Eigen::Vector3f(-0.2f, 0.2f, 1.5f));
+    const std::uint32_t plate[6] = { p, p + 1, p + 2, p, p + 2, p + 3 };
+    indices.insert(indices.end(), plate, plate + 6);
+    const std::size_t triangles = indices.size() / 3;
+    
+    // a at the origin, b closer to the wall (larger projected areas)
+    const Sophus::SE3Group<float> pose_a, pose_b(Sophus::SO3Group<float>(), Eigen::Vector3f(0.5f, 0.0f, 1.0f));
+    
+    camera::MeshTexturer<float> texturer(1, 0.0f);
+    texturer.addView(camera, pose_a);
+    texturer.addView(camera, pose_b);
+    camera::MeshTexture result;
+    texturer.texture(camera::makePointView(vertices.data(), vertices.size()), indices.data(), triangles, result);
+    
+    ASSERT_EQ(result.labels.size(), triangles);
+    EXPECT_EQ(result.textured, triangles);
+    EXPECT_EQ(result.atlas_width, 2 * camera.width());
+    EXPECT_EQ(result.atlas_height, camera.height());
+    
+    // b where it sees the wall, a where the plate shadows b (x < -0.7) or outside b's view (x < -1.24)
+    for(std::size_t t = 0 ; t < wall ; ++t)
+    {
+        const Eigen::Vector3f c = (vertices[indices[3 * t]] + vertices[indices[3 * t + 1]] + vertices[indices[3 * t + 2]]) / 3.0f;
+        if(std::abs(c(0) + 0.7f) < 0.1f || std::abs(c(0) + 1.24f) < 0.1f || std::abs(std::abs(c(1)) - 0.8f) < 0.1f) { continue; }
+        EXPECT_EQ(result.labels[t], ((c(0) < -0.7f && std::abs(c(1)) < 0.8f) || c(0) < -1.24f) ? 0 : 1) << "at " << c.transpose();
+    }
+    
+    // UVs are the projections in the selected view, placed in its atlas cell
+    for(std::size_t t = 0 ; t < triangles ; ++t)
+    {
+        const Sophus::SE3Group<float>& pose = result.labels[t] == 0 ? pose_a : pose_b;
+        for(std::size_t k = 0 ; k < 3 ; ++k)
+        {
+            const Eigen::Vector2f pix = camera.forward(pose, vertices[indices[3 * t + k]]);
+            const Eigen::Vector2f& uv = result.uvs[3 * t + k];
+            EXPECT_NEAR(uv(0) * result.atlas_width - 0.5f - result.getViewOffsetX(result.labels[t]), pix(0), 1e-2f);
+            EXPECT_NEAR(uv(1) * result.atlas_height - 0.5f - result.getViewOffsetY(result.labels[t]), pix(1), 1e-2f);
+        }
+    }
+    
+    // smoothing does not add seams and does not depend on threading
+    const auto count_seams = [&](const std::vector<std::int32_t>& labels)
+    {
+        std::vector<std::pair<std::pair<std::uint32_t,std::uint32_t>,std::int32_t>> edges;
+        for(std::size_t t = 0 ; t < triangles ; ++t)
+        {
+            for(std::size_t e = 0 ; e < 3 ; ++e)
+            {
+                const std::uint32_t a = indices[3 * t + e], b = indices[3 * t + (e + 1) % 3];
+                edges.push_back(std::make_pair(std::make_pair(std::min(a, b), std::max(a, b)), labels[t]));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        std::size_t seams = 0;
+        for(std::size_t i = 0 ; i + 1 < edges.size() ; ++i)
+        {
+            if(edges[i].first == edges[i + 1].first && edges[i].second != edges[i + 1].second) { seams++; }
+        }
+        return seams;
+    };
+    
+    camera::MeshTexturer<float> smooth(1, 2.0f), smooth_mt(4, 2.0f);
+    smooth.addView(camera, pose_a);
+    smooth.addView(camera, pose_b);
+    smooth_mt.addView(camera, pose_a);
+    smooth_mt.addView(camera, pose_b);
+    camera::MeshTexture smoothed, smoothed_mt;
+    smooth.texture(camera::makePointView(vertices.data(), vertices.size()), indices.data(), triangles, smoothed);
+    smooth_mt.texture(camera::makePointView(vertices.data(), vertices.size()), indices.data(), triangles, smoothed_mt);
+    EXPECT_GT(smoothed.iterations, 0u);
+    EXPECT_LT(smoothed.iterations, 10u); // settled before running out of sweeps
+    EXPECT_LE(count_seams(smoothed.labels), count_seams(result.labels));
+    EXPECT_TRUE(smoothed.labels == smoothed_mt.labels);
+    EXPECT_EQ(smoothed.textured, triangles);
+    
+    // non-manifold: every edge of the middle triangle z (index 4) has a fin before and after it in index order,
+    // so z has more neighbour pairs than it keeps. Small plates (not connected) hide two fins from a, so they
+    // stay with c and pull z over while its other neighbours are updated.
+    const std::vector<Eigen::Vector3f> fan_vertices = { Eigen::Vector3f(-0.3f, -0.2f, 2.5f), Eigen::Vector3f(0.3f, -0.2f, 2.5f), Eigen::Vector3f(0.0f, 0.3f, 2.5f),
+                                                        Eigen::Vector3f(0.4f, 0.2f, 2.3f), Eigen::Vector3f(0.1f, -0.1f, 3.0f), Eigen::Vector3f(0.0f, -0.5f, 2.3f),
+                                                        Eigen::Vector3f(0.0f, -0.5f, 2.7f), Eigen::Vector3f(-0.4f, 0.2f, 2.3f), Eigen::Vector3f(-0.4f, 0.2f, 2.7f),
+                                                        Eigen::Vector3f(0.4f, 0.2f, 2.7f),
+                                                        Eigen::Vector3f(-0.02f, -0.291f, 2.2f), Eigen::Vector3f(0.02f, -0.291f, 2.2f), Eigen::Vector3f(0.02f, -0.251f, 2.2f), Eigen::Vector3f(-0.02f, -0.251f, 2.2f),
+                                                        Eigen::Vector3f(-0.231f, 0.07f, 2.2f), Eigen::Vector3f(-0.191f, 0.07f, 2.2f), Eigen::Vector3f(-0.191f, 0.11f, 2.2f), Eigen::Vector3f(-0.231f, 0.11f, 2.2f) };
+    const std::vector<std::uint32_t> fan = { 1, 3, 4,  1, 2, 3,  0, 1, 5,  0, 2, 7,  0, 1, 2,  0, 1, 6,  0, 2, 8,  1, 2, 9,
+                                             10, 11, 12,  10, 12, 13,  14, 15, 16,  14, 16, 17 };
+    const Sophus::SE3Group<float> pose_c(Sophus::SO3Group<float>(), Eigen::Vector3f(1.5f, 0.0f, 0.0f));
+    camera::MeshTexturer<float> fan_st(1, 2.0f), fan_mt(4, 2.0f);
+    fan_st.addView(camera, pose_a);
+    fan_st.addView(camera, pose_c);
+    fan_mt.addView(camera, pose_a);
+    fan_mt.addView(camera, pose_c);
+    camera::MeshTexture fan_result, fan_result_mt;
+    fan_st.texture(camera::makePointView(fan_vertices.data(), fan_vertices.size()), fan.data(), fan.size() / 3, fan_result);
+    fan_mt.texture(camera::makePointView(fan_vertices.data(), fan_vertices.size()), fan.data(), fan.size() / 3, fan_result_mt);
+    EXPECT_GT(fan_result.textured, 0u);
+    EXPECT_TRUE(fan_result.labels == fan_result_mt.labels);
+    EXPECT_EQ(fan_result.iterations, fan_result_mt.iterations);
+}
+
+TEST(CameraPixelGridTests, TestRadiusQueries)
+{
+    typedef camera::PinholeCameraModel<float> ModelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    // map points around the camera, some behind it or outside the image
+    std::vector<Eigen::Vector3f> points;
+    for(std::size_t i = 0 ; i < 5000 ; ++i)
+    {
+        points.push_back(Eigen::Vector3f::Random() * 4.0f + Eigen::Vector3f(0.0f, 0.0f, 3.0f));
+    }
+    const Sophus::SE3Group<float> pose(Sophus::SO3Group<float>(), Eigen::Vector3f(0.1f, -0.2f, 0.0f));
+    
+    // and some in the last pixel column and row
+    const float last_x = camera.width() - 0.4f, last_y = camera.height() - 0.3f;
+    points.push_back(pose * (camera.inverse(last_x, 100.0f) * 2.0f));
+    points.push_back(pose * (camera.inverse(10.0f, last_y) * 2.0f));
+    points.push_back(pose * (camera.inverse(last_x, last_y) * 2.0f));
+    
+    camera::PixelGrid<float> grid(20);
+    const std::size_t binned = grid.project(camera, pose, camera::makePointView(points.data(), points.size()));
+    EXPECT_EQ(binned, grid.size());
+    EXPECT_EQ(grid.getCellsX(), (std::size_t)(camera.width() + 19) / 20);
+    EXPECT_EQ(grid.getCellsY(), (std::size_t)(camera.height() + 19) / 20);
+    
+    std::vector<Eigen::Vector2f> pixels(points.size());
+    std::vector<camera::ProjectionStatus> status(points.size());
+    camera::forwardBatch(camera, pose, camera::makePointView(points.data(), points.size()), camera::makePixelView(pixels.data(), points.size()), status.data());
+    const auto in_image = [&](std::size_t i)
+    {
+        return status[i] == camera::ProjectionStatus::Ok && pixels[i](0) >= 0.0f && pixels[i](1) >= 0.0f && pixels[i](0) < camera.width() && pixels[i](1) < camera.height();
+    };
+    
+    std::size_t expected_binned = 0;
+    for(std::size_t i = 0 ; i < points.size() ; ++i) { if(in_image(i)) { expected_binned++; } }
+    EXPECT_EQ(binned, expected_binned);
+    EXPECT_GT(binned, 0u);
+    EXPECT_LT(binned, points.size());
+    
+    // cells are ordered and hold their points
+    for(std::size_t cy = 0 ; cy < grid.getCellsY() ; ++cy)
+    {
+        for(std::size_t cx = 0 ; cx < grid.getCellsX() ; ++cx)
+        {
+            for(std::size_t i = grid.getCellBegin(cx, cy) ; i < grid.getCellEnd(cx, cy) ; ++i)
+            {
+                EXPECT_EQ((std::size_t)grid.getPixel(i)(0) / 20, cx);
+                EXPECT_EQ((std::size_t)grid.getPixel(i)(1) / 20, cy);
+                EXPECT_EQ(grid.getPixel(i), pixels[grid.getIndex(i)]);
+            }
+        }
+    }
+    
+    // same as a linear scan, including queries centred in the last pixel or just outside the image
+    std::vector<std::pair<Eigen::Vector2f, float>> queries;
+    for(int q = 0 ; q < 200 ; ++q)
+    {
+        queries.push_back(std::make_pair(Eigen::Vector2f((Eigen::Vector2f::Random() * 0.6f + Eigen::Vector2f::Constant(0.5f)).cwiseProduct(Eigen::Vector2f(camera.width(), camera.height()))), 5.0f + 3.0f * (q % 20)));
+    }
+    const float w = camera.width(), h = camera.height();
+    const Eigen::Vector2f border[] = { Eigen::Vector2f(w - 0.2f, 100.0f), Eigen::Vector2f(10.0f, h - 0.1f), Eigen::Vector2f(w - 0.1f, h - 0.1f),
+                                       Eigen::Vector2f(w + 0.2f, 100.0f), Eigen::Vector2f(10.0f, h + 0.2f), Eigen::Vector2f(w + 0.1f, h + 0.1f),
+                                       Eigen::Vector2f(-0.5f, 100.0f), Eigen::Vector2f(10.0f, -0.5f), Eigen::Vector2f(-3.0f, -3.0f) };
+    for(std::size_t b = 0 ; b < sizeof(border) / sizeof(border[0]) ; ++b)
+    {
+        queries.push_back(std::make_pair(border[b], 0.5f));
+        queries.push_back(std::make_pair(border[b], 25.0f));
+    }
+    
+    std::vector<std::uint32_t> found(points.size());
+    for(std::size_t q = 0 ; q < queries.size() ; ++q)
+    {
+        const Eigen::Vector2f centre = queries[q].first;
+        const float radius = queries[q].second;
+        
+        std::vector<std::uint32_t> expected;
+        std::uint32_t expected_nearest = camera::PixelGrid<float>::InvalidIndex;
+        float best = std::numeric_limits<float>::infinity();
+        for(std::size_t i = 0 ; i < points.size() ; ++i)
+        {
+            if(!in_image(i)) { continue; }
+            const float d2 = (pixels[i] - centre).squaredNorm();
+            if(d2 <= radius * radius) { expected.push_back((std::uint32_t)i); }
+            if(d2 <= radius * radius && d2 < best) { best = d2; expected_nearest = (std::uint32_t)i; }
+        }
+        
+        const std::size_t count = grid.query(centre(0), centre(1), radius, found.data(), found.size());
+        std::vector<std::uint32_t> result(found.begin(), found.begin() + count);
+        std::sort(result.begin(), result.end());
+        EXPECT_TRUE(result == expected) << "query " << q;
+        
+        const std::uint32_t nearest = grid.nearest(centre(0), centre(1), radius);
+        EXPECT_EQ(nearest == camera::PixelGrid<float>::InvalidIndex, expected_nearest == camera::PixelGrid<float>::InvalidIndex);
+        if(nearest != camera::PixelGrid<float>::InvalidIndex)
+        {
+            EXPECT_EQ((pixels[nearest] - centre).squaredNorm(), best);
+        }
+    }
+    
+    // the points in the last column and row are found from there
+    EXPECT_NE(grid.nearest(w - 0.2f, 100.0f, 0.5f), camera::PixelGrid<float>::InvalidIndex);
+    EXPECT_NE(grid.nearest(10.0f, h - 0.1f, 0.5f), camera::PixelGrid<float>::InvalidIndex);
+    EXPECT_NE(grid.nearest(w + 0.1f, h + 0.1f, 1.0f), camera::PixelGrid<float>::InvalidIndex);
+}
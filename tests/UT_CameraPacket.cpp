@@ -0,0 +1,128 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Tests for packet scalar instantiations of the camera models.
+ * ****************************************************************************
+ */
+
+// system
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+
+// testing framework & libraries
+#include <gtest/gtest.h>
+
+// google logger
+#include <glog/logging.h>
+
+#include <CameraModels.hpp>
+#include <CameraPacket.hpp>
+
+#include <CameraParameters.hpp>
+
+template<typename T>
+static bool sameLane(T packet_value, T scalar_value)
+{
+    if(std::isnan(scalar_value))
+    {
+        return std::isnan(packet_value);
+    }
+    
+    return std::abs(packet_value - scalar_value) <= T(1e-4) * std::max(T(1.0), std::abs(scalar_value));
+}
+
+template <typename ModelT>
+class CameraPacketTests : public ::testing::Test 
+{
+public:
+    
+};
+
+typedef ::testing::Types<
+camera::PinholeCameraModel<float>,
+camera::PinholeDistortedCameraModel<float>,
+camera::PinholeDisparityCameraModel<float>,
+camera::PinholeDisparityDistortedCameraModel<float>,
+camera::PinholeDisparityBrownConradyCameraModel<float>,
+camera::IdealGenericCameraModel<float>,
+camera::FullGenericCameraModel<float>,
+camera::SphericalCameraModel<float>,
+camera::SphericalPovRayCameraModel<float>,
+camera::FisheyeCameraModel<float>,
+camera::IdealFisheyeCameraModel<float>
+> CameraPacketTypes;
+TYPED_TEST_CASE(CameraPacketTests, CameraPacketTypes);
+
+TYPED_TEST(CameraPacketTests, TestPacketMatchesScalar)
+{
+    typedef TypeParam ModelT;
+    typedef camera::Packet8f PacketT;
+    typedef typename camera::ComplexTypes<PacketT>::PointT PacketPointT;
+    typedef typename camera::ComplexTypes<PacketT>::PixelT PacketPixelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    const float width = CameraParameters<ModelT>::DefaultWidth, height = CameraParameters<ModelT>::DefaultHeight;
+    
+    int cnt_bad = 0;
+    for(float y = -8.0f ; y < height + 8.0f ; y += height / 13.0f)
+    {
+        // the lanes span the row and a point past the right border
+        PacketT px, py(y);
+        for(int i = 0 ; i < PacketT::Size ; ++i)
+        {
+            px[i] = (float)i * (width + 16.0f) / (float)(PacketT::Size - 1) - 8.0f;
+        }
+        
+        const PacketPointT rays = camera.template inverse<PacketT>(px, py);
+        const PacketPixelT pixels = camera.template forward<PacketT>(rays);
+        const typename PacketT::Mask square = camera.template pixelValidSquare<PacketT>(px, py);
+        const typename PacketT::Mask circular = camera.template pixelValidCircular<PacketT>(px, py);
+        
+        for(int i = 0 ; i < PacketT::Size ; ++i)
+        {
+            const typename ModelT::PointT ray = camera.inverse(px[i], py[i]);
+            const typename ModelT::PixelT pix = camera.forward(ray);
+            
+            if(!sameLane(rays(0)[i], ray(0)) || !sameLane(rays(1)[i], ray(1)) || !sameLane(rays(2)[i], ray(2)) ||
+               !sameLane(pixels(0)[i], pix(0)) || !sameLane(pixels(1)[i], pix(1)) ||
+               square[i] != camera.pixelValidSquare(px[i], py[i]) || circular[i] != camera.pixelValidCircular(px[i], py[i]))
+            {
+                cnt_bad++;
+            }
+        }
+    }
+    
+    EXPECT_EQ(cnt_bad, 0);
+}
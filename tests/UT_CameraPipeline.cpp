@@ -0,0 +1,157 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Tests for the frame pipeline.
+ * ****************************************************************************
+ */
+
+// system
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <thread>
+
+// testing framework & libraries
+#include <gtest/gtest.h>
+
+// google logger
+#include <glog/logging.h>
+
+#include <CameraModels.hpp>
+#include <CameraBatch.hpp>
+#include <CameraPipeline.hpp>
+
+#include <CameraParameters.hpp>
+
+TEST(CameraPipelineTests, TestSpscRing)
+{
+    camera::SpscRing<int> ring(3);
+    EXPECT_EQ(ring.capacity(), std::size_t(4));
+    
+    const int count = 10000;
+    std::thread producer([&]()
+    {
+        for(int i = 0 ; i < count ; ++i)
+        {
+            ring.push(int(i));
+        }
+        ring.close();
+    });
+    
+    int expected = 0, value = 0, cnt_bad = 0;
+    while(ring.pop(value))
+    {
+        if(value != expected) { cnt_bad++; }
+        expected++;
+    }
+    producer.join();
+    
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_EQ(expected, count);
+    EXPECT_FALSE(ring.push(int(0)));
+}
+
+namespace
+{
+    
+struct PipelineFrame
+{
+    int id;
+    std::vector<Eigen::Vector2f> pixels;
+    std::vector<Eigen::Vector3f> rays;
+    std::vector<Eigen::Vector2f> warped;
+    std::vector<camera::ProjectionStatus> status;
+};
+
+}
+
+TEST(CameraPipelineTests, TestFramePipeline)
+{
+    typedef camera::PinholeDistortedCameraModel<float> SrcModelT;
+    typedef camera::IdealFisheyeCameraModel<float> DstModelT;
+    
+    SrcModelT src;
+    DstModelT dst;
+    CameraParameters<SrcModelT>::configure(src);
+    CameraParameters<DstModelT>::configure(dst);
+    
+    camera::FramePipeline<PipelineFrame> pipeline(2);
+    pipeline.addStage("backproject", [&](PipelineFrame& f) 
+    { 
+        f.rays.resize(f.pixels.size());
+        camera::inverseBatch(src, f.pixels.data(), f.pixels.size(), f.rays.data()); 
+    }, 0);
+    pipeline.addStage("project", [&](PipelineFrame& f) 
+    { 
+        f.warped.resize(f.rays.size());
+        f.status.resize(f.rays.size());
+        camera::forwardBatch(dst, f.rays.data(), f.rays.size(), f.warped.data(), f.status.data()); 
+    });
+    pipeline.start();
+    
+    const int frames = 20;
+    int cnt_bad = 0, next_id = 0;
+    
+    std::thread consumer([&]()
+    {
+        PipelineFrame f;
+        while(pipeline.pop(f))
+        {
+            if(f.id != next_id++) { cnt_bad++; }
+            for(std::size_t i = 0 ; i < f.pixels.size() ; ++i)
+            {
+                if((f.warped[i] - dst.forward(src.inverse(f.pixels[i]))).norm() > 1e-3f) { cnt_bad++; }
+            }
+        }
+    });
+    
+    for(int i = 0 ; i < frames ; ++i)
+    {
+        PipelineFrame f;
+        f.id = i;
+        for(int j = 0 ; j < 37 ; ++j)
+        {
+            f.pixels.push_back(Eigen::Vector2f((0.1f + 0.8f * float((j * 7 + i) % 37) / 37.0f) * src.width(), (0.1f + 0.8f * float(j) / 37.0f) * src.height()));
+        }
+        EXPECT_TRUE(pipeline.push(std::move(f)));
+    }
+    
+    pipeline.finish();
+    consumer.join();
+    pipeline.stop();
+    
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_EQ(next_id, frames);
+    ASSERT_EQ(pipeline.getStageCount(), std::size_t(2));
+    EXPECT_EQ(pipeline.getStatistics(0).frames, std::size_t(frames));
+    EXPECT_EQ(pipeline.getStatistics(1).name, std::string("project"));
+}
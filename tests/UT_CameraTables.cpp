@@ -0,0 +1,690 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Tests for derived camera tables.
+ * ****************************************************************************
+ */
+
+// system
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#endif // __unix__ || __APPLE__
+
+// testing framework & libraries
+#include <gtest/gtest.h>
+
+// google logger
+#include <glog/logging.h>
+
+#include <CameraModels.hpp>
+
+#include <CameraParameters.hpp>
+
+#include <CameraTables.hpp>
+#include <CameraTableFile.hpp>
+#include <CameraTableRegistry.hpp>
+#include <CameraTableBudget.hpp>
+#include <CameraTiledTables.hpp>
+#include <CameraTableCodegen.hpp>
+#include <CameraNuma.hpp>
+#include <CameraKernelTuner.hpp>
+#include <CameraPyramid.hpp>
+#include <CameraStabilisation.hpp>
+#include <CameraBirdsEye.hpp>
+
+template <typename ModelT>
+class CameraTablesTests : public ::testing::Test
+{
+public:
+
+};
+
+typedef ::testing::Types<
+camera::PinholeDistortedCameraModel<float>,
+camera::FisheyeCameraModel<float>,
+camera::SphericalCameraModel<double>,
+camera::FullGenericCameraModel<double>
+> CameraTablesTypes;
+TYPED_TEST_CASE(CameraTablesTests, CameraTablesTypes);
+
+// empty scratch directory, removed (with what is left in it) at the end of the scope
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory()
+    {
+#ifdef CAMERA_MODELS_HAVE_MMAP
+        const std::string pattern = ::testing::TempDir() + "camera_models_XXXXXX";
+        std::vector<char> buffer(pattern.begin(), pattern.end());
+        buffer.push_back('\0');
+        if(::mkdtemp(buffer.data()) != nullptr) { path = buffer.data(); }
+#endif // CAMERA_MODELS_HAVE_MMAP
+    }
+    
+    ~TemporaryDirectory()
+    {
+#ifdef CAMERA_MODELS_HAVE_MMAP
+        if(path.empty()) { return; }
+        DIR* dir = ::opendir(path.c_str());
+        if(dir != nullptr)
+        {
+            for(struct dirent* entry = ::readdir(dir) ; entry != nullptr ; entry = ::readdir(dir))
+            {
+                if(std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+                {
+                    std::remove((path + "/" + entry->d_name).c_str());
+                }
+            }
+            ::closedir(dir);
+        }
+        ::rmdir(path.c_str());
+#endif // CAMERA_MODELS_HAVE_MMAP
+    }
+    
+    inline bool valid() const { return !path.empty(); }
+    inline const std::string& getPath() const { return path; }
+    
+private:
+    std::string path;
+};
+
+TYPED_TEST(CameraTablesTests, TestParameterHash)
+{
+    typedef TypeParam ModelT;
+    typedef typename std::conditional<std::is_same<typename ModelT::Scalar,float>::value,double,float>::type OtherScalar;
+
+    ModelT camera1, camera2;
+    CameraParameters<ModelT>::configure(camera1);
+    CameraParameters<ModelT>::configure(camera2);
+
+    EXPECT_EQ(camera::getParameterHash(camera1), camera::getParameterHash(camera2));
+
+    // same parameters, different scalar
+    EXPECT_NE(camera::getParameterHash(camera1), camera::getParameterHash(camera1.template cast<OtherScalar>()));
+
+    camera2.resizeViewport(camera2.width() / 2, camera2.height() / 2);
+    EXPECT_NE(camera::getParameterHash(camera1), camera::getParameterHash(camera2));
+
+    EXPECT_NE(camera::getTableKey(camera::TableKind::Ray, camera1), camera::getTableKey(camera::TableKind::ValidMask, camera1));
+}
+
+TYPED_TEST(CameraTablesTests, TestFileCache)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    camera.resizeViewport(camera.width() / 4, camera.height() / 4);
+
+    const TemporaryDirectory directory;
+    if(!directory.valid()) { return; } // no scratch space on this platform
+    
+    camera::TableFileCache cache(directory.getPath());
+    const std::uint64_t key = camera::getTableKey(camera::TableKind::Ray, camera);
+
+    camera::RayTable<Scalar> built = cache.getRayTable(camera);
+    camera::RayTable<Scalar> loaded;
+    ASSERT_TRUE(cache.load(key, loaded));
+
+    ASSERT_EQ(built.width(), loaded.width());
+    ASSERT_EQ(built.height(), loaded.height());
+    ASSERT_NE(built.data(), loaded.data());
+    EXPECT_FALSE(built.isReadOnly());
+    EXPECT_TRUE(loaded.isReadOnly()); // mapped
+
+    int cnt_bad = 0;
+    for(std::size_t y = 0 ; y < loaded.height() ; ++y)
+    {
+        for(std::size_t x = 0 ; x < loaded.width() ; ++x)
+        {
+            const typename ModelT::PointT ray = camera.inverse((Scalar)x, (Scalar)y);
+            for(int c = 0 ; c < 3 ; ++c)
+            {
+                if(!(loaded(x,y)[c] == ray(c)) && !(std::isnan(ray(c)) && std::isnan(loaded(x,y)[c])))
+                {
+                    cnt_bad++;
+                }
+            }
+        }
+    }
+
+    EXPECT_EQ(cnt_bad, 0);
+
+    // a different calibration must not pick up the stored table
+    camera::RayTable<Scalar> other;
+    EXPECT_FALSE(cache.load(key + 1, other));
+    
+    // concurrent writers of one table each use their own temporary file, the survivor is complete
+    const std::string path = directory.getPath() + "/concurrent.tbl";
+    std::atomic<int> cnt_saved(0);
+    std::vector<std::thread> writers;
+    for(int t = 0 ; t < 8 ; ++t)
+    {
+        writers.push_back(std::thread([&]()
+        {
+            for(int i = 0 ; i < 4 ; ++i) { if(camera::saveTable(path, key, built)) { cnt_saved++; } }
+        }));
+    }
+    for(std::thread& th : writers) { th.join(); }
+    EXPECT_EQ(cnt_saved.load(), 32);
+    
+    camera::RayTable<Scalar> reloaded;
+    ASSERT_TRUE(camera::loadTable(path, key, reloaded));
+    EXPECT_EQ(std::memcmp(reloaded.data(), built.data(), built.bytes()), 0);
+    
+#ifdef CAMERA_MODELS_HAVE_MMAP
+    std::size_t temporaries = 0;
+    DIR* dir = ::opendir(directory.getPath().c_str());
+    ASSERT_TRUE(dir != nullptr);
+    for(struct dirent* entry = ::readdir(dir) ; entry != nullptr ; entry = ::readdir(dir))
+    {
+        if(std::strstr(entry->d_name, ".tmp") != nullptr) { temporaries++; }
+    }
+    ::closedir(dir);
+    EXPECT_EQ(temporaries, 0u);
+#endif // CAMERA_MODELS_HAVE_MMAP
+}
+
+TYPED_TEST(CameraTablesTests, TestKernelTuner)
+{
+    typedef TypeParam ModelT;
+    typedef typename ModelT::Scalar Scalar;
+    typedef typename ModelT::PointT PointT;
+    typedef typename ModelT::PixelT PixelT;
+    
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    
+    const Scalar tolerance = Scalar(1e-3);
+    camera::KernelTuner<ModelT> tuner(camera, tolerance);
+    tuner.tune(std::chrono::microseconds(300));
+    
+    std::vector<PixelT> pixels;
+    for(int i = 0 ; i < 2000 ; ++i)
+    {
+        const PixelT pix((Scalar(0.1) + Scalar(0.8) * Scalar(i * 7 % 101) / Scalar(101.0)) * camera.width(), 
+                         (Scalar(0.1) + Scalar(0.8) * Scalar(i * 13 % 97) / Scalar(97.0)) * camera.height());
+        if(camera.pixelValidCircular(pix)) { pixels.push_back(pix); }
+    }
+    
+    // every size class stays within tolerance
+    const std::size_t counts[3] = { 10, 300, pixels.size() };
+    for(std::size_t c = 0 ; c < 3 ; ++c)
+    {
+        std::vector<PointT> rays(counts[c]);
+        tuner.inverseBatch(pixels.data(), counts[c], rays.data());
+        
+        int cnt_bad = 0;
+        for(std::size_t i = 0 ; i < counts[c] ; ++i)
+        {
+            if((rays[i] - camera.inverse(pixels[i])).norm() > tolerance) { cnt_bad++; }
+        }
+        EXPECT_EQ(cnt_bad, 0) << camera::getKernelPathName(tuner.getChoice(camera::KernelTuner<ModelT>::getSizeClass(counts[c])).inverse);
+    }
+    
+    // outside the tabulated domain the analytic inverse is used, whatever the path
+    for(std::size_t c = 0 ; c < 3 ; ++c)
+    {
+        std::vector<PixelT> outside(counts[c]);
+        for(std::size_t i = 0 ; i < outside.size() ; ++i)
+        {
+            outside[i] = pixels[i] + PixelT((i % 2 == 0 ? Scalar(-1.0) : Scalar(1.0)) * camera.width(), Scalar(0.0));
+        }
+        std::vector<PointT> rays(counts[c]);
+        tuner.inverseBatch(outside.data(), outside.size(), rays.data());
+        
+        int cnt_bad = 0;
+        for(std::size_t i = 0 ; i < outside.size() ; ++i)
+        {
+            const PointT expected = camera.inverse(outside[i]);
+            if(!((rays[i] - expected).norm() <= tolerance) && !(std::isnan(expected.norm()) && std::isnan(rays[i].norm()))) { cnt_bad++; }
+        }
+        EXPECT_EQ(cnt_bad, 0) << camera::getKernelPathName(tuner.getChoice(camera::KernelTuner<ModelT>::getSizeClass(counts[c])).inverse);
+    }
+    
+    std::vector<PointT> points(pixels.size());
+    std::vector<PixelT> projected(pixels.size());
+    std::vector<camera::ProjectionStatus> status(pixels.size());
+    for(std::size_t i = 0 ; i < pixels.size() ; ++i) { points[i] = camera.inverse(pixels[i]); }
+    tuner.forwardBatch(points.data(), points.size(), projected.data(), status.data());
+    EXPECT_LT((projected[5] - camera.forward(points[5])).norm(), Scalar(1e-2));
+    
+    // profile round trip
+    camera::KernelProfile profile;
+    tuner.store(profile);
+    const std::string path = ::testing::TempDir() + "kernel_profile.txt";
+    ASSERT_TRUE(profile.save(path));
+    
+    camera::KernelProfile loaded;
+    ASSERT_TRUE(loaded.load(path));
+    std::remove(path.c_str());
+    
+    camera::KernelTuner<ModelT> restored(camera, tolerance);
+    ASSERT_TRUE(restored.load(loaded));
+    for(std::size_t c = 0 ; c < camera::KernelTuner<ModelT>::SizeClasses ; ++c)
+    {
+        EXPECT_EQ(restored.getChoice(c).inverse, tuner.getChoice(c).inverse);
+        EXPECT_EQ(restored.getChoice(c).forward, tuner.getChoice(c).forward);
+    }
+    
+    // a different tolerance is a different profile entry
+    camera::KernelTuner<ModelT> other(camera, tolerance * Scalar(2.0));
+    EXPECT_FALSE(other.load(loaded));
+}
+
+TEST(CameraTableRegistryTests, TestSharedHandles)
+{
+    typedef camera::PinholeDistortedCameraModel<float> ModelT;
+
+    ModelT camera1, camera2;
+    CameraParameters<ModelT>::configure(camera1);
+    CameraParameters<ModelT>::configure(camera2);
+    camera1.resizeViewport(160.0f, 120.0f);
+    camera2.resizeViewport(160.0f, 120.0f);
+
+    camera::TableRegistry registry;
+    int builds = 0;
+    const std::uint64_t key = camera::getTableKey(camera::TableKind::Ray, camera1);
+    auto builder = [&]() { ++builds; return camera::buildRayTable(camera1); };
+
+    std::vector<std::thread> threads;
+    std::vector<std::shared_ptr<const camera::RayTable<float>>> handles(4);
+    for(std::size_t i = 0 ; i < handles.size() ; ++i)
+    {
+        threads.push_back(std::thread([&,i]() { handles[i] = registry.acquire<camera::RayTable<float>>(key, builder); }));
+    }
+    for(std::size_t i = 0 ; i < threads.size() ; ++i)
+    {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(builds, 1);
+    for(std::size_t i = 0 ; i < handles.size() ; ++i)
+    {
+        EXPECT_EQ(handles[i].get(), handles[0].get());
+    }
+
+    // identical calibration, different instance
+    EXPECT_EQ(registry.getRayTable(camera2).get(), handles[0].get());
+    EXPECT_EQ(registry.getLiveCount(), 1u);
+    EXPECT_EQ(registry.getResidentBytes(), handles[0]->bytes());
+
+    handles.clear();
+    EXPECT_FALSE(registry.find<camera::RayTable<float>>(key));
+    EXPECT_EQ(registry.getLiveCount(), 0u);
+}
+
+TEST(CameraTableBudgetTests, TestEviction)
+{
+    typedef camera::FisheyeCameraModel<float> ModelT;
+
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+    camera.resizeViewport(200.0f, 150.0f);
+
+    camera::CameraPyramid<ModelT,3> pyr(camera);
+
+    // room for the first two pyramid levels, not for all three
+    const std::size_t level0_bytes = 200 * 150 * 3 * sizeof(float);
+    camera::TableBudgetCache cache(level0_bytes + level0_bytes / 4 + 16);
+
+    std::shared_ptr<const camera::RayTable<float>> t0 = cache.getRayTable(pyr[0]);
+    cache.getRayTable(pyr[1]);
+    EXPECT_EQ(cache.getRayTable(pyr[0]).get(), t0.get());
+    t0.reset();
+
+    cache.getRayTable(pyr[2]); // evicts level 1, the least recently used
+
+    camera::TableCacheStatistics stats = cache.getStatistics();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 3u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_LE(stats.resident_bytes, stats.budget_bytes);
+    EXPECT_FALSE(cache.peek<camera::RayTable<float>>(camera::getTableKey(camera::TableKind::Ray, pyr[1])));
+
+    // evicted level falls back to the analytic inverse
+    camera::TableBackedInverse<ModelT> lifted1(cache, pyr[1]);
+    EXPECT_FALSE(lifted1.lock());
+    EXPECT_TRUE((lifted1.inverse(40.0f, 30.0f) - pyr[1].inverse(40.0f, 30.0f)).norm() < 1e-6f);
+
+    camera::TableBackedInverse<ModelT> lifted0(cache, pyr[0]);
+    EXPECT_TRUE(lifted0.lock());
+    EXPECT_TRUE((lifted0.inverse(80.0f, 60.0f) - pyr[0].inverse(80.0f, 60.0f)).norm() < 1e-6f);
+}
+
+TEST(CameraTiledTablesTests, TestLazyTiles)
+{
+    typedef camera::SphericalCameraModel<float> ModelT;
+
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+
+    std::unique_ptr<camera::TiledRayTable<ModelT>> table = camera::makeTiledRayTable(camera);
+    EXPECT_EQ(table->getMaterialisedTiles(), 0u);
+
+    // concurrent first touch of the same tile publishes exactly one
+    std::vector<std::thread> threads;
+    for(int i = 0 ; i < 4 ; ++i)
+    {
+        threads.push_back(std::thread([&]() { table->operator()(100, 70); }));
+    }
+    for(std::size_t i = 0 ; i < threads.size() ; ++i)
+    {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(table->getMaterialisedTiles(), 1u);
+    EXPECT_TRUE(table->isTileMaterialised(1, 1));
+
+    int cnt_bad = 0;
+    for(std::size_t y = 64 ; y < 128 ; ++y)
+    {
+        for(std::size_t x = 64 ; x < 128 ; ++x)
+        {
+            const ModelT::PointT ray = camera.inverse((float)x, (float)y);
+            const float* val = (*table)(x, y);
+            if(!(val[0] == ray(0) && val[1] == ray(1) && val[2] == ray(2)))
+            {
+                cnt_bad++;
+            }
+        }
+    }
+
+    EXPECT_EQ(cnt_bad, 0);
+    EXPECT_EQ(table->getMaterialisedTiles(), 1u);
+
+    // ROI spanning a tile border, plus the partial tile at the right edge
+    table->materialise(120, 10, 20, 20);
+    (*table)(2047, 255);
+    EXPECT_EQ(table->getMaterialisedTiles(), 4u);
+}
+
+TEST(CameraTableCodegenTests, TestEmbeddedTables)
+{
+    typedef camera::FisheyeCameraModel<float> ModelT;
+
+    ModelT camera;
+    CameraParameters<ModelT>::configure(camera);
+
+    // radial table reproduces the 2D inverse
+    const camera::RadialTable<float> radial = camera::buildRadialTable(camera, 4096);
+    float max_err = 0.0f;
+    for(float y = 0.0f ; y < camera.height() ; y += 37.0f)
+    {
+        for(float x = 0.0f ; x < camera.width() ; x += 41.0f)
+        {
+            if(camera.pixelValidCircular(x, y))
+            {
+                const ModelT::PointT ray = camera.inverse(x, y);
+                max_err = std::max(max_err, (camera::inverseRadial(radial, camera, x, y).normalized() - ray.normalized()).norm());
+            }
+        }
+    }
+    EXPECT_LT(max_err, 1e-3f);
+
+    // emitted source carries the key and all the values
+    const std::uint64_t key = camera::getRadialTableKey(camera, 4096);
+    std::stringstream src;
+    camera::writeEmbeddedTableSource(src, "lens_radial", key, radial);
+    std::stringstream key_str;
+    key_str << "0x" << std::hex << key << "ull";
+    EXPECT_NE(src.str().find("lens_radial_data[8192]"), std::string::npos);
+    EXPECT_NE(src.str().find(key_str.str()), std::string::npos);
+
+    // as the generated source would define it
+    static const float data[] = { 0.0f, 1.0f, 0.5f, 0.75f };
+    const camera::EmbeddedTable<float> embedded = { key, 2u, 1u, 2u, data };
+
+    camera::RadialTable<float> wrapped;
+    ASSERT_TRUE(camera::getEmbeddedTable(embedded, key, wrapped));
+    EXPECT_EQ(wrapped.data(), data);
+    EXPECT_EQ(wrapped(1,0)[1], 0.75f);
+    EXPECT_TRUE(wrapped.isReadOnly());
+
+    // recalibrated lens must not use the stale data
+    EXPECT_FALSE(camera::getEmbeddedTable(embedded, key + 1, wrapped));
+}
+
+TEST(CameraNumaTests, TestReplicatedTables)
+{
+    typedef camera::PinholeDistortedCameraModel<float> ModelT;
+    
+    ModelT model;
+    CameraParameters<ModelT>::configure(model);
+    
+    const int nodes = camera::getNumaNodeCount();
+    ASSERT_GE(nodes, 1);
+    EXPECT_FALSE(camera::getNumaNodeCpus(0).empty());
+    EXPECT_LT(camera::getCurrentNumaNode(), nodes);
+    
+    const camera::RemapTable<float> remap = camera::buildRemapTable(model, model);
+    
+    // first-touch copy and huge page backed replicas hold the same data
+    const camera::RemapTable<float> local = camera::copyTableToNumaNode(remap);
+    const camera::NumaReplicatedTable<camera::RemapTable<float>> replicated(remap, true);
+    EXPECT_EQ(replicated.getReplicaCount(), std::size_t(nodes));
+    EXPECT_NE(local.data(), remap.data());
+    EXPECT_EQ(std::memcmp(local.data(), remap.data(), remap.bytes()), 0);
+    EXPECT_EQ(std::memcmp(replicated.get().data(), remap.data(), remap.bytes()), 0);
+    
+    // every pixel visited once, from node local replicas
+    camera::NumaWorkerPool pool(2);
+    EXPECT_EQ(pool.getThreadCount(), std::size_t(2 * nodes));
+    
+    std::vector<std::atomic<int>> visits(remap.pixels());
+    for(std::size_t i = 0 ; i < visits.size() ; ++i) { visits[i].store(0); }
+    std::atomic<int> cnt_bad(0);
+    
+    for(int run = 0 ; run < 2 ; ++run)
+    {
+        pool.parallelFor(remap.pixels(), [&](std::size_t begin, std::size_t end, int node)
+        {
+            const camera::RemapTable<float>& table = replicated.get(node);
+            for(std::size_t i = begin ; i < end ; ++i)
+            {
+                visits[i]++;
+                if(table.data()[2 * i] != remap.data()[2 * i]) { cnt_bad++; }
+            }
+        });
+    }
+    
+    int cnt_visits = 0;
+    for(std::size_t i = 0 ; i < visits.size() ; ++i) { if(visits[i].load() != 2) { cnt_visits++; } }
+    EXPECT_EQ(cnt_visits, 0);
+    EXPECT_EQ(cnt_bad.load(), 0);
+}
+
+template<typename SrcModelT>
+static void checkStabilisationWarp()
+{
+    typedef typename SrcModelT::Scalar Scalar;
+    typedef typename camera::ComplexTypes<Scalar>::RotationT RotationT;
+    typedef typename camera::ComplexTypes<Scalar>::PixelT PixelT;
+    
+    SrcModelT src;
+    CameraParameters<SrcModelT>::configure(src);
+    
+    // output view a bit narrower than the source, cropping the stabilisation margin
+    const camera::PinholeCameraModel<Scalar> dst(src.fx() * Scalar(1.1), src.fy() * Scalar(1.1), src.u0(), src.v0(), src.width(), src.height());
+    const camera::StabilisationWarp<SrcModelT> warp(dst, src);
+    
+    const RotationT rotation(Eigen::Quaternion<Scalar>(Eigen::AngleAxis<Scalar>(Scalar(0.02), Eigen::Matrix<Scalar,3,1>(Scalar(0.1), Scalar(1.0), Scalar(-0.3)).normalized())));
+    camera::RemapTable<Scalar> map;
+    warp.generate(rotation, map);
+    ASSERT_EQ(map.width(), (std::size_t)dst.width());
+    ASSERT_EQ(map.height(), (std::size_t)dst.height());
+    
+    const camera::RemapTable<Scalar> expected = camera::buildRemapTable(dst, src, rotation);
+    for(std::size_t y = 0 ; y < map.height() ; y += 7)
+    {
+        for(std::size_t x = 0 ; x < map.width() ; ++x)
+        {
+            const PixelT a(map(x,y)[0], map(x,y)[1]), b(expected(x,y)[0], expected(x,y)[1]);
+            ASSERT_NEAR((a - b).norm(), 0.0, 1e-2) << x << " " << y;
+        }
+    }
+    
+    // rolling shutter, rotation grows along the rows
+    std::vector<RotationT, Eigen::aligned_allocator<RotationT>> rows;
+    for(std::size_t y = 0 ; y < map.height() ; ++y)
+    {
+        rows.push_back(RotationT(Eigen::Quaternion<Scalar>(Eigen::AngleAxis<Scalar>(Scalar(0.03) * Scalar(y) / dst.height(), Eigen::Matrix<Scalar,3,1>::UnitX()))));
+    }
+    const Scalar* data = map.data();
+    warp.generate(rows.data(), map);
+    EXPECT_EQ(map.data(), data); // reused
+    
+    for(std::size_t y = 0 ; y < map.height() ; y += 5)
+    {
+        for(std::size_t x = 0 ; x < map.width() ; x += 3)
+        {
+            const PixelT b = src.forward(rows[y], dst.inverse(Scalar(x), Scalar(y)));
+            ASSERT_NEAR((PixelT(map(x,y)[0], map(x,y)[1]) - b).norm(), 0.0, 1e-2) << x << " " << y;
+        }
+    }
+}
+
+TEST(CameraStabilisationTests, TestWarp)
+{
+    checkStabilisationWarp<camera::PinholeCameraModel<float>>();
+    checkStabilisationWarp<camera::PinholeDistortedCameraModel<double>>();
+    checkStabilisationWarp<camera::PinholeDistortedCameraModel<float>>();
+}
+
+// camera at height 1m, looking along yaw, pitched down
+static Sophus::SE3Group<float> getRigPose(float yaw, float pitch, const Eigen::Vector3f& position)
+{
+    const Eigen::Vector3f forward(std::cos(yaw) * std::cos(pitch), std::sin(yaw) * std::cos(pitch), -std::sin(pitch));
+    const Eigen::Vector3f right(std::sin(yaw), -std::cos(yaw), 0.0f);
+    Eigen::Matrix3f rot;
+    rot.col(0) = right;
+    rot.col(1) = forward.cross(right);
+    rot.col(2) = forward;
+    return Sophus::SE3Group<float>(Sophus::SO3Group<float>(Eigen::Quaternionf(rot)), position);
+}
+
+TEST(CameraBirdsEyeTests, TestSurroundView)
+{
+    camera::FisheyeCameraModel<float> fisheye;
+    CameraParameters<camera::FisheyeCameraModel<float>>::configure(fisheye);
+    camera::IdealGenericCameraModel<float> generic;
+    CameraParameters<camera::IdealGenericCameraModel<float>>::configure(generic);
+    
+    // 10m x 10m around the car, 5cm cells
+    const camera::BirdsEyeGrid<float> grid(200, 200, 0.05f, Eigen::Vector2f(-5.0f, -5.0f));
+    camera::BirdsEyeTableBuilder<float> builder(grid);
+    
+    std::vector<Sophus::SE3Group<float>> poses;
+    poses.push_back(getRigPose(0.0f, 0.5f, Eigen::Vector3f(2.0f, 0.0f, 1.0f)));
+    poses.push_back(getRigPose(float(M_PI / 2.0), 0.5f, Eigen::Vector3f(0.0f, 1.0f, 1.0f)));
+    poses.push_back(getRigPose(float(M_PI), 0.5f, Eigen::Vector3f(-2.0f, 0.0f, 1.0f)));
+    poses.push_back(getRigPose(float(-M_PI / 2.0), 0.5f, Eigen::Vector3f(0.0f, -1.0f, 1.0f)));
+    
+    EXPECT_EQ(builder.addCamera(fisheye, poses[0]), 0u);
+    EXPECT_EQ(builder.addCamera(generic, poses[1]), 1u);
+    EXPECT_EQ(builder.addCamera(fisheye, poses[2]), 2u);
+    EXPECT_EQ(builder.addCamera(generic, poses[3]), 3u);
+    const camera::BirdsEyeTable table = builder.build();
+    ASSERT_EQ(table.getCameraCount(), 4u);
+    
+    // images where every pixel is x / 16, plus the camera index * 40
+    std::vector<std::vector<std::uint8_t>> images(4);
+    std::vector<const std::uint8_t*> image_ptrs;
+    for(std::size_t c = 0 ; c < 4 ; ++c)
+    {
+        const std::size_t w = c % 2 == 0 ? (std::size_t)fisheye.width() : (std::size_t)generic.width();
+        const std::size_t h = c % 2 == 0 ? (std::size_t)fisheye.height() : (std::size_t)generic.height();
+        EXPECT_EQ(table.getImageStride(c), w);
+        images[c].resize(w * h);
+        for(std::size_t i = 0 ; i < w * h ; ++i) { images[c][i] = (std::uint8_t)((i % w) / 16 + c * 40); }
+        image_ptrs.push_back(images[c].data());
+    }
+    
+    std::vector<std::uint8_t> bev(grid.width * grid.height);
+    table.render(image_ptrs.data(), 1, bev.data());
+    
+    std::size_t covered = 0, single = 0;
+    for(std::size_t y = 0 ; y < grid.height ; ++y)
+    {
+        for(std::size_t x = 0 ; x < grid.width ; ++x)
+        {
+            const camera::BirdsEyeTable::Tap* taps = table.getTaps(x, y);
+            if(!table.isCovered(x, y))
+            {
+                EXPECT_EQ(bev[y * grid.width + x], 0);
+                continue;
+            }
+            covered++;
+            
+            std::uint32_t sum = 0;
+            for(std::size_t s = 0 ; s < camera::BirdsEyeTable::MaxSources && taps[s].camera != camera::BirdsEyeTable::NoCamera ; ++s)
+            {
+                sum += taps[s].weight[0] + taps[s].weight[1] + taps[s].weight[2] + taps[s].weight[3];
+            }
+            EXPECT_EQ(sum, camera::BirdsEyeTable::One);
+            
+            if(taps[1].camera != camera::BirdsEyeTable::NoCamera) { continue; }
+            single++;
+            
+            // a single camera gives its own bilinear sample
+            const std::size_t c = taps[0].camera;
+            const Eigen::Vector3f pt = grid.getCellCentre(x, y);
+            const Eigen::Vector2f pix = c % 2 == 0 ? fisheye.forward(poses[c], pt) : generic.forward(poses[c], pt);
+            EXPECT_NEAR(float(bev[y * grid.width + x]), pix(0) / 16.0f + float(c * 40), 1.5f);
+        }
+    }
+    EXPECT_GT(covered, grid.width * grid.height / 2);
+    EXPECT_GT(single, 0u);
+    EXPECT_LT(single, covered);
+    
+    // a pixel ray back onto the ground
+    const Eigen::Vector3f pt = grid.getCellCentre(150, 100);
+    const Eigen::Vector2f pix = fisheye.forward(poses[0], pt);
+    Eigen::Vector3f ground;
+    ASSERT_TRUE(camera::inverseOnGround(fisheye, poses[0], pix(0), pix(1), 0.0f, ground));
+    EXPECT_NEAR((ground - pt).norm(), 0.0f, 1e-2f);
+    EXPECT_FALSE(camera::inverseOnGround(fisheye, getRigPose(0.0f, -0.5f, Eigen::Vector3f(2.0f, 0.0f, 1.0f)), fisheye.u0(), fisheye.v0(), 0.0f, ground));
+}
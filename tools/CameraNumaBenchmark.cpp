@@ -0,0 +1,196 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Throughput of remap table lookups with node local vs remote tables.
+ * ****************************************************************************
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CameraModels.hpp>
+#include <CameraTables.hpp>
+#include <CameraNuma.hpp>
+
+namespace
+{
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions() : width(1920), height(1080), threads(4), repetitions(20), huge_pages(false) { }
+
+    std::size_t width;
+    std::size_t height;
+    std::size_t threads;
+    std::size_t repetitions;
+    bool huge_pages;
+};
+
+void printUsage(const char* argv0)
+{
+    std::cerr << "Usage: " << argv0 << " [--size w h] [--threads per_node] [--repetitions n] [--huge]" << std::endl;
+    std::cerr << "Remaps a synthetic image through a remap table placed on every node, with the workers bound to every node." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, BenchmarkOptions& opts)
+{
+    for(int i = 1 ; i < argc ; ++i)
+    {
+        const std::string arg = argv[i];
+        if(arg == "--size" && i + 2 < argc)
+        {
+            opts.width = std::strtoul(argv[++i], nullptr, 10);
+            opts.height = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--threads" && i + 1 < argc)
+        {
+            opts.threads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--repetitions" && i + 1 < argc)
+        {
+            opts.repetitions = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--huge")
+        {
+            opts.huge_pages = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return opts.width > 0 && opts.height > 0 && opts.threads > 0 && opts.repetitions > 0;
+}
+
+// nearest neighbour remap of the rows [y0, y1), the table read dominates
+float remapRows(const camera::RemapTable<float>& table, const float* image, std::size_t y0, std::size_t y1)
+{
+    const std::size_t w = table.width(), h = table.height();
+    float sum = 0.0f;
+    for(std::size_t y = y0 ; y < y1 ; ++y)
+    {
+        const float* map = table(0, y);
+        for(std::size_t x = 0 ; x < w ; ++x, map += 2)
+        {
+            const std::size_t sx = std::min((std::size_t)std::max(map[0], 0.0f), w - 1);
+            const std::size_t sy = std::min((std::size_t)std::max(map[1], 0.0f), h - 1);
+            sum += image[sy * w + sx];
+        }
+    }
+    return sum;
+}
+
+double runBenchmark(const camera::RemapTable<float>& table, const float* image, int worker_node, const BenchmarkOptions& opts)
+{
+    std::vector<std::thread> threads;
+    std::vector<float> sums(opts.threads, 0.0f);
+    const std::size_t rows = (table.height() + opts.threads - 1) / opts.threads;
+
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for(std::size_t t = 0 ; t < opts.threads ; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            camera::bindCurrentThreadToNumaNode(worker_node);
+            const std::size_t y0 = std::min(t * rows, table.height()), y1 = std::min(y0 + rows, table.height());
+            for(std::size_t r = 0 ; r < opts.repetitions ; ++r)
+            {
+                sums[t] += remapRows(table, image, y0, y1);
+            }
+        }));
+    }
+    for(std::size_t t = 0 ; t < threads.size() ; ++t) { threads[t].join(); }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+
+    float total = 0.0f;
+    for(std::size_t t = 0 ; t < sums.size() ; ++t) { total += sums[t]; }
+    if(total == -1.0f) { std::cout << total; } // keep the work
+
+    return double(table.bytes()) * double(opts.repetitions) / elapsed.count() / 1e9;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions opts;
+    if(!parseOptions(argc, argv, opts))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const float f = float(opts.width) * 0.6f;
+    const camera::PinholeDistortedCameraModel<float> src(f, f, float(opts.width) / 2.0f, float(opts.height) / 2.0f, -0.25f, 0.07f, 0.0f, 0.0f, 0.0f, float(opts.width), float(opts.height));
+    const camera::RemapTable<float> remap = camera::buildRemapTable(src.getIdeal(), src);
+
+    std::vector<float> image(opts.width * opts.height);
+    for(std::size_t i = 0 ; i < image.size() ; ++i) { image[i] = float(i % 251); }
+
+    // one copy of the source image per worker node so only the table placement varies
+    const int nodes = camera::getNumaNodeCount();
+    std::vector<std::shared_ptr<float> > node_images(nodes);
+    std::vector<const float*> images(nodes, image.data());
+    for(int node = 0 ; node < nodes ; ++node)
+    {
+        node_images[node] = camera::allocateOnNumaNode<float>(image.size(), node, opts.huge_pages);
+        if(node_images[node])
+        {
+            std::memcpy(node_images[node].get(), image.data(), image.size() * sizeof(float));
+            images[node] = node_images[node].get();
+        }
+    }
+
+    std::cout << "Remap table " << opts.width << " x " << opts.height << " (" << remap.bytes() / (1 << 20) << " MiB), "
+              << nodes << " node(s), " << opts.threads << " thread(s)" << (opts.huge_pages ? ", huge pages" : "") << std::endl;
+    std::cout << "table node -> worker node : table GB/s" << std::endl;
+
+    for(int table_node = 0 ; table_node < nodes ; ++table_node)
+    {
+        const camera::RemapTable<float> placed = camera::copyTableToNumaNode(remap, table_node, opts.huge_pages);
+        for(int worker_node = 0 ; worker_node < nodes ; ++worker_node)
+        {
+            const double gbps = runBenchmark(placed, images[worker_node], worker_node, opts);
+            std::cout << std::setw(10) << table_node << " -> " << std::setw(11) << worker_node << " : "
+                      << std::fixed << std::setprecision(2) << gbps << (table_node == worker_node ? " (local)" : " (remote)") << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/**
+ * ****************************************************************************
+ * Copyright (c) 2015, Robert Lukierski.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * ****************************************************************************
+ * Generates C++ sources with tables of a fixed calibration compiled in.
+ * ****************************************************************************
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <CameraModels.hpp>
+#include <CameraTables.hpp>
+#include <CameraTableCodegen.hpp>
+
+namespace
+{
+
+struct GeneratorOptions
+{
+    GeneratorOptions() : use_double(false), radial_samples(1024), rectified(false) { }
+
+    std::string model_name;
+    std::string name;
+    std::string output_dir;
+    std::vector<double> parameters;
+    bool use_double;
+    std::size_t radial_samples;
+    bool rectified;
+    double rectified_parameters[6];
+};
+
+void printUsage(const char* argv0)
+{
+    std::cerr << "Usage: " << argv0 << " <Model> <name> <output_dir> <parameters...> [--double] [--radial samples] [--rectified fx fy u0 v0 w h]" << std::endl;
+    std::cerr << "Writes <output_dir>/<name>.hpp and <output_dir>/<name>.cpp with the ray table, valid mask, "
+              << "radial table (radially symmetric models) and remap table from a rectified pinhole (if given)." << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, GeneratorOptions& opts)
+{
+    if(argc < 4) { return false; }
+
+    opts.model_name = argv[1];
+    opts.name = argv[2];
+    opts.output_dir = argv[3];
+
+    for(int i = 4 ; i < argc ; ++i)
+    {
+        if(std::strcmp(argv[i], "--double") == 0)
+        {
+            opts.use_double = true;
+        }
+        else if(std::strcmp(argv[i], "--radial") == 0 && i + 1 < argc)
+        {
+            opts.radial_samples = (std::size_t)std::strtoul(argv[++i], nullptr, 10);
+            if(opts.radial_samples < 2) { return false; }
+        }
+        else if(std::strcmp(argv[i], "--rectified") == 0 && i + 6 < argc)
+        {
+            opts.rectified = true;
+            for(int j = 0 ; j < 6 ; ++j) { opts.rectified_parameters[j] = std::strtod(argv[++i], nullptr); }
+        }
+        else
+        {
+            char* end = nullptr;
+            opts.parameters.push_back(std::strtod(argv[i], &end));
+            if(end == argv[i] || *end != '\0') { return false; }
+        }
+    }
+
+    return true;
+}
+
+template<bool IsRadial>
+struct RadialWriter
+{
+    template<typename ModelT>
+    static void write(std::ostream& hdr, std::ostream& src, const GeneratorOptions& opts, const ModelT& model) { }
+};
+
+template<>
+struct RadialWriter<true>
+{
+    template<typename ModelT>
+    static void write(std::ostream& hdr, std::ostream& src, const GeneratorOptions& opts, const ModelT& model)
+    {
+        typedef camera::RadialTable<typename ModelT::Scalar> TableT;
+        camera::writeEmbeddedTableDeclaration<TableT>(hdr, opts.name + "_radial");
+        camera::writeEmbeddedTableSource(src, opts.name + "_radial", camera::getRadialTableKey(model, opts.radial_samples),
+                                         camera::buildRadialTable(model, opts.radial_samples));
+    }
+};
+
+template<typename ModelT>
+bool generate(const GeneratorOptions& opts)
+{
+    typedef typename ModelT::Scalar Scalar;
+
+    if(opts.parameters.size() != ModelT::NumParameters)
+    {
+        std::cerr << opts.model_name << " takes " << ModelT::NumParameters << " parameters, got " << opts.parameters.size() << std::endl;
+        return false;
+    }
+
+    ModelT model;
+    for(unsigned int i = 0 ; i < ModelT::NumParameters ; ++i)
+    {
+        model.data()[i] = Scalar(opts.parameters[i]);
+    }
+
+    const std::string hdr_path = opts.output_dir + "/" + opts.name + ".hpp";
+    const std::string src_path = opts.output_dir + "/" + opts.name + ".cpp";
+    std::ofstream hdr(hdr_path.c_str()), src(src_path.c_str());
+    if(!hdr.good() || !src.good())
+    {
+        std::cerr << "Cannot write " << hdr_path << " / " << src_path << std::endl;
+        return false;
+    }
+
+    std::string guard = opts.name + "_HPP";
+    for(std::size_t i = 0 ; i < guard.size() ; ++i) { guard[i] = (char)std::toupper((unsigned char)guard[i]); }
+
+    hdr << "// Generated by CameraTableGenerator, do not edit.\n// " << model << "\n\n";
+    hdr << "#ifndef " << guard << "\n#define " << guard << "\n\n#include <CameraTableCodegen.hpp>\n\n";
+    src << "// Generated by CameraTableGenerator, do not edit.\n// " << model << "\n\n";
+    src << "#include <limits>\n#include <CameraTableCodegen.hpp>\n#include \"" << opts.name << ".hpp\"\n\n";
+
+    camera::writeEmbeddedTableDeclaration<camera::RayTable<Scalar>>(hdr, opts.name + "_ray");
+    camera::writeEmbeddedTableSource(src, opts.name + "_ray", camera::getTableKey(camera::TableKind::Ray, model), camera::buildRayTable(model));
+
+    camera::writeEmbeddedTableDeclaration<camera::ValidMaskTable>(hdr, opts.name + "_valid");
+    camera::writeEmbeddedTableSource(src, opts.name + "_valid", camera::getTableKey(camera::TableKind::ValidMask, model), camera::buildValidMask(model));
+
+    RadialWriter<camera::RadialSymmetry<ModelT::ModelType>::Value>::write(hdr, src, opts, model);
+
+    if(opts.rectified)
+    {
+        const double* rp = opts.rectified_parameters;
+        const camera::PinholeCameraModel<Scalar> rectified((Scalar)rp[0], (Scalar)rp[1], (Scalar)rp[2], (Scalar)rp[3], (Scalar)rp[4], (Scalar)rp[5]);
+        const typename camera::ComplexTypes<Scalar>::RotationT identity;
+
+        camera::writeEmbeddedTableDeclaration<camera::RemapTable<Scalar>>(hdr, opts.name + "_remap");
+        camera::writeEmbeddedTableSource(src, opts.name + "_remap", camera::getRemapTableKey(rectified, model, identity),
+                                         camera::buildRemapTable(rectified, model, identity));
+    }
+
+    hdr << "\n#endif // " << guard << "\n";
+
+    return hdr.good() && src.good();
+}
+
+template<camera::CameraModelType cmt>
+bool dispatch(const GeneratorOptions& opts, bool& found)
+{
+    typedef camera::CameraModelToTypeAndName<cmt> InfoT;
+
+    if(found || opts.model_name != InfoT::Name)
+    {
+        return true;
+    }
+
+    found = true;
+    if(opts.use_double)
+    {
+        return generate<typename InfoT::template ModelT<double>>(opts);
+    }
+    else
+    {
+        return generate<typename InfoT::template ModelT<float>>(opts);
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    GeneratorOptions opts;
+    if(!parseOptions(argc, argv, opts))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool found = false;
+    const bool ok = dispatch<camera::CameraModelType::Pinhole>(opts, found) &&
+                    dispatch<camera::CameraModelType::PinholeDistorted>(opts, found) &&
+                    dispatch<camera::CameraModelType::IdealGeneric>(opts, found) &&
+                    dispatch<camera::CameraModelType::FullGeneric>(opts, found) &&
+                    dispatch<camera::CameraModelType::Spherical>(opts, found) &&
+                    dispatch<camera::CameraModelType::SphericalPovRay>(opts, found) &&
+                    dispatch<camera::CameraModelType::Fisheye>(opts, found) &&
+                    dispatch<camera::CameraModelType::IdealFisheye>(opts, found) &&
+                    dispatch<camera::CameraModelType::PinholeDisparity>(opts, found) &&
+                    dispatch<camera::CameraModelType::PinholeDisparityDistorted>(opts, found) &&
+                    dispatch<camera::CameraModelType::PinholeDisparityBrownConrady>(opts, found);
+
+    if(!found)
+    {
+        std::cerr << "Unknown model " << opts.model_name << std::endl;
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}